@@ -0,0 +1,636 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+/*
+ * Benchmark for the plugin. It generates a synthetic catalog, puts the fake apx and
+ * podman from stubs/ on PATH and drives the plugin directly, reporting latency
+ * percentiles and the number of commands each operation ran.
+ */
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gnome-software.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gs-vanilla-meta-catalog.h"
+
+#define COMPONENTS_MIN 100
+#define COMPONENTS_MAX 50000
+#define STRESS_THREADS_MAX 64
+// Microseconds between rewrites of the catalog during stress runs, longer than the
+// plugin waits for it to settle so every rewrite reloads it
+#define STRESS_RELOAD_INTERVAL (1500 * G_TIME_SPAN_MILLISECOND)
+// Microseconds stress calls may still run past the deadline before they're considered hung
+#define STRESS_HANG_TIMEOUT (60 * G_TIME_SPAN_SECOND)
+
+static const gchar *const containers[] = {
+    "apx_managed",     "apx_managed_aur",    "apx_managed_dnf",
+    "apx_managed_apk", "apx_managed_zypper", "apx_managed_xbps",
+};
+
+static const gchar *const categories[] = {
+    "AudioVideo", "Development", "Education", "Game", "Graphics", "Network", "Office", "Utility",
+};
+
+static gint n_components   = 1000;
+static gint n_containers   = 3;
+static gint n_iterations   = 20;
+static gint n_refine_apps  = 100;
+static gdouble latency     = 0;
+static gboolean cold_cache = FALSE;
+static gboolean stress     = FALSE;
+static gint stress_threads = 8;
+static gint stress_seconds = 5;
+
+static const GOptionEntry entries[] = {
+    {"components", 'n', 0, G_OPTION_ARG_INT, &n_components,
+     "Components in the synthetic catalog (100 to 50000)", "N"},
+    {"containers", 'c', 0, G_OPTION_ARG_INT, &n_containers,
+     "Containers the components are spread over (1 to 6)", "N"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &n_iterations, "Times each operation is run", "N"},
+    {"refine-apps", 'r', 0, G_OPTION_ARG_INT, &n_refine_apps, "Apps refined at once", "N"},
+    {"latency", 'l', 0, G_OPTION_ARG_DOUBLE, &latency,
+     "Milliseconds every fake apx and podman command takes", "MS"},
+    {"cold", 0, 0, G_OPTION_ARG_NONE, &cold_cache,
+     "Drop the silo and size caches and the installed manifest before every iteration", NULL},
+    {"stress", 0, 0, G_OPTION_ARG_NONE, &stress,
+     "Also run refine, list_apps and add_sources from several threads at once, while the "
+     "catalog is reloaded, and fail on wrong results or hangs",
+     NULL},
+    {"stress-threads", 0, 0, G_OPTION_ARG_INT, &stress_threads, "Threads of the stress run", "N"},
+    {"stress-seconds", 0, 0, G_OPTION_ARG_INT, &stress_seconds,
+     "Seconds each stress run lasts", "S"},
+    {NULL},
+};
+
+typedef struct {
+    const gchar *name;
+    GArray *samples; /* (element-type gdouble): milliseconds */
+    guint commands;  /* run by the fake apx and podman, over all iterations */
+} BenchOperation;
+
+typedef enum {
+    OPERATION_SETUP,
+    OPERATION_LIST_APPS_FIRST, /* fills the plugin cache */
+    OPERATION_LIST_APPS,
+    OPERATION_SEARCH,
+    OPERATION_REFINE,
+    OPERATION_ADD_SOURCES,
+    OPERATION_LOOKUP_INDEX, /* the ids refine looks up, through the catalog's id index */
+    OPERATION_LOOKUP_XPATH, /* the same, with the per-app query refine used before it */
+    OPERATION_STRESS, /* only with --stress */
+    OPERATION_LAST,
+} BenchOperationId;
+
+static BenchOperation operations[OPERATION_LAST] = {
+    [OPERATION_SETUP]           = {"setup_async", NULL, 0},
+    [OPERATION_LIST_APPS_FIRST] = {"list_apps_async (first)", NULL, 0},
+    [OPERATION_LIST_APPS]       = {"list_apps_async", NULL, 0},
+    [OPERATION_SEARCH]          = {"list_apps_async (search)", NULL, 0},
+    [OPERATION_REFINE]          = {"refine_async", NULL, 0},
+    [OPERATION_ADD_SOURCES]     = {"gs_plugin_add_sources", NULL, 0},
+    [OPERATION_LOOKUP_INDEX]    = {"component lookup (index)", NULL, 0},
+    [OPERATION_LOOKUP_XPATH]    = {"component lookup (xpath)", NULL, 0},
+    [OPERATION_STRESS]          = {"concurrent calls", NULL, 0},
+};
+
+// Calls completed by stress runs, over all iterations
+static guint stress_calls = 0;
+
+/*
+ * Generates the catalog, revision only changes a comment so that rewriting it makes
+ * the plugin compile a new silo
+ */
+static gchar *
+generate_catalog(guint revision)
+{
+    GString *xml = g_string_new(NULL);
+
+    g_string_append(xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                         "<components version=\"0.14\" origin=\"vanilla_meta\">\n");
+    for (gint i = 0; i < n_components; i++) {
+        g_string_append_printf(xml,
+                               "  <component type=\"desktop-application\">\n"
+                               "    <id>org.vanillaos.bench.App%d</id>\n"
+                               "    <name>Bench App %d</name>\n"
+                               "    <summary>Synthetic app number %d</summary>\n"
+                               "    <pkgname container=\"%s\">bench-app-%d</pkgname>\n"
+                               "    <categories><category>%s</category></categories>\n"
+                               "    <releases><release version=\"1.%d\"/></releases>\n"
+                               "  </component>\n",
+                               i, i, i, containers[i % n_containers], i,
+                               categories[i % G_N_ELEMENTS(categories)], i);
+    }
+    g_string_append(xml, "</components>\n");
+    g_string_append_printf(xml, "<!-- revision %u -->\n", revision);
+
+    return g_string_free(xml, FALSE);
+}
+
+static guint
+count_commands(const gchar *log_path)
+{
+    g_autofree gchar *contents = NULL;
+    guint count                = 0;
+
+    if (!g_file_get_contents(log_path, &contents, NULL, NULL))
+        return 0;
+
+    for (const gchar *p = contents; *p != '\0'; p++) {
+        if (*p == '\n')
+            count++;
+    }
+
+    return count;
+}
+
+static void
+async_result_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    GAsyncResult **out_result = user_data;
+
+    *out_result = g_object_ref(result);
+}
+
+static GAsyncResult *
+wait_for_result(GAsyncResult **result)
+{
+    // Stress threads get their results in a main context of their own
+    GMainContext *context = g_main_context_get_thread_default();
+
+    while (*result == NULL)
+        g_main_context_iteration(context, TRUE);
+
+    return *result;
+}
+
+static gboolean
+run_setup(GsPlugin *plugin, GError **error)
+{
+    GsPluginClass *klass           = GS_PLUGIN_GET_CLASS(plugin);
+    g_autoptr(GAsyncResult) result = NULL;
+
+    klass->setup_async(plugin, NULL, async_result_cb, &result);
+    return klass->setup_finish(plugin, wait_for_result(&result), error);
+}
+
+static gboolean
+run_list_apps(GsPlugin *plugin, GError **error)
+{
+    GsPluginClass *klass           = GS_PLUGIN_GET_CLASS(plugin);
+    g_autoptr(GAsyncResult) result = NULL;
+    g_autoptr(GsAppQuery) query    = NULL;
+    g_autoptr(GsAppList) list      = NULL;
+
+    query = gs_app_query_new("is-installed", GS_APP_QUERY_TRISTATE_TRUE, NULL);
+    klass->list_apps_async(plugin, query, GS_PLUGIN_LIST_APPS_FLAGS_NONE, NULL, async_result_cb,
+                           &result);
+    list = klass->list_apps_finish(plugin, wait_for_result(&result), error);
+
+    return list != NULL;
+}
+
+static gboolean
+run_search(GsPlugin *plugin, guint iteration, GError **error)
+{
+    GsPluginClass *klass           = GS_PLUGIN_GET_CLASS(plugin);
+    g_autoptr(GAsyncResult) result = NULL;
+    g_autoptr(GsAppQuery) query    = NULL;
+    g_autoptr(GsAppList) list      = NULL;
+    g_autofree gchar *prefix       = g_strdup_printf("%u", iteration % 10);
+    const gchar *keywords[]        = {"bench", prefix, NULL};
+
+    // Both a whole word and a prefix matching a tenth of the catalog
+    query = gs_app_query_new("keywords", keywords, NULL);
+    klass->list_apps_async(plugin, query, GS_PLUGIN_LIST_APPS_FLAGS_NONE, NULL, async_result_cb,
+                           &result);
+    list = klass->list_apps_finish(plugin, wait_for_result(&result), error);
+
+    return list != NULL;
+}
+
+/*
+ * Checks every app was found installed or not like the fake apx says: the first
+ * installed_count packages of the catalog are installed
+ */
+static gboolean
+check_refined(GsAppList *list, GError **error)
+{
+    gint installed_count = n_components / 10;
+
+    for (guint i = 0; i < gs_app_list_length(list); i++) {
+        GsApp *app         = gs_app_list_index(list, i);
+        GsAppState state   = gs_app_get_state(app);
+        gint index         = -1;
+        gboolean installed = (state == GS_APP_STATE_INSTALLED ||
+                              state == GS_APP_STATE_UPDATABLE_LIVE);
+
+        if (sscanf(gs_app_get_id(app), "org.vanillaos.bench.App%d", &index) != 1) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s isn't in the catalog",
+                        gs_app_get_id(app));
+            return FALSE;
+        }
+        if (installed != (index < installed_count) ||
+            (!installed && state != GS_APP_STATE_AVAILABLE)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s was refined to state %s",
+                        gs_app_get_id(app), gs_app_state_to_string(state));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean
+run_refine(GsPlugin *plugin, guint iteration, GError **error)
+{
+    GsPluginClass *klass           = GS_PLUGIN_GET_CLASS(plugin);
+    g_autoptr(GAsyncResult) result = NULL;
+    g_autoptr(GsAppList) list      = gs_app_list_new();
+
+    // A different slice of the catalog every iteration, like browsing would
+    for (gint i = 0; i < n_refine_apps; i++) {
+        g_autofree gchar *id = g_strdup_printf(
+            "org.vanillaos.bench.App%d", (iteration * n_refine_apps + i) % n_components);
+        g_autoptr(GsApp) app = gs_app_new(id);
+
+        gs_app_list_add(list, app);
+    }
+
+    klass->refine_async(plugin, list,
+                        GS_PLUGIN_REFINE_FLAGS_REQUIRE_ID | GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE,
+                        NULL, async_result_cb, &result);
+    if (!klass->refine_finish(plugin, wait_for_result(&result), error))
+        return FALSE;
+
+    return check_refined(list, error);
+}
+
+static gboolean
+run_add_sources(GsPlugin *plugin, GError **error)
+{
+    g_autoptr(GsAppList) list = gs_app_list_new();
+
+    return gs_plugin_add_sources(plugin, list, NULL, error);
+}
+
+/*
+ * Finds the components of the apps run_refine() refines, either in the id index or
+ * by running an XPath query for each of them
+ */
+static gboolean
+run_lookup(GsVanillaMetaCatalog *catalog, guint iteration, gboolean use_index, GError **error)
+{
+    for (gint i = 0; i < n_refine_apps; i++) {
+        g_autofree gchar *id = g_strdup_printf(
+            "org.vanillaos.bench.App%d", (iteration * n_refine_apps + i) % n_components);
+        g_autoptr(XbNode) component = NULL;
+
+        if (use_index) {
+            component = gs_vanilla_meta_catalog_lookup_component(catalog, id);
+            if (component != NULL)
+                g_object_ref(component);
+        } else {
+            g_autofree gchar *id_safe = xb_string_escape(id);
+            g_autofree gchar *xpath   = g_strdup_printf(
+                "components[@origin='vanilla_meta']/component/id[text()='%s']/..", id_safe);
+
+            component = xb_silo_query_first(catalog->silo, xpath, error);
+            if (component == NULL)
+                return FALSE;
+        }
+
+        if (component == NULL) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "%s isn't in the id index", id);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+typedef struct {
+    GsPlugin *plugin; /* (owned) */
+    guint index;
+    gint64 deadline; /* monotonic time the thread stops making calls */
+    guint calls;
+    gint *running; /* threads still making calls */
+    GError *error; /* (owned) (nullable): of the first call which failed */
+} StressThread;
+
+/*
+ * Makes calls until the deadline, every thread cycling through refine, list_apps
+ * and add_sources from a different starting point so they all overlap
+ */
+static gpointer
+stress_thread_cb(gpointer user_data)
+{
+    StressThread *thread            = user_data;
+    g_autoptr(GMainContext) context = g_main_context_new();
+
+    g_main_context_push_thread_default(context);
+
+    for (guint i = 0; g_get_monotonic_time() < thread->deadline; i++) {
+        gboolean succeeded;
+
+        switch ((thread->index + i) % 3) {
+        case 0:
+            succeeded = run_refine(thread->plugin, thread->index * 1000 + i, &thread->error);
+            break;
+        case 1:
+            succeeded = run_list_apps(thread->plugin, &thread->error);
+            break;
+        default:
+            succeeded = run_add_sources(thread->plugin, &thread->error);
+            break;
+        }
+        if (!succeeded) {
+            g_prefix_error(&thread->error, "Stress thread %u: ", thread->index);
+            break;
+        }
+        thread->calls++;
+    }
+
+    g_main_context_pop_thread_default(context);
+    g_atomic_int_dec_and_test(thread->running);
+    return NULL;
+}
+
+/*
+ * Runs calls from stress_threads threads at once for stress_seconds, rewriting the
+ * catalog meanwhile so they race with reloads. Fails if any call fails or returns
+ * wrong states, or if they don't finish, which would mean a deadlock.
+ */
+static gboolean
+run_stress(GsPlugin *plugin, const gchar *catalog_path, GError **error)
+{
+    // Left behind if the threads hang, so they don't outlive what they use
+    StressThread *threads = g_new0(StressThread, stress_threads);
+    GThread **handles     = g_new0(GThread *, stress_threads);
+    gint *running         = g_new(gint, 1);
+    gint64 deadline       = g_get_monotonic_time() + stress_seconds * G_TIME_SPAN_SECOND;
+    gint64 next_reload    = g_get_monotonic_time() + STRESS_RELOAD_INTERVAL;
+    guint revision        = 0;
+    gboolean succeeded    = TRUE;
+
+    *running = stress_threads;
+    for (gint i = 0; i < stress_threads; i++) {
+        threads[i].plugin   = g_object_ref(plugin);
+        threads[i].index    = i;
+        threads[i].deadline = deadline;
+        threads[i].running  = running;
+        handles[i]          = g_thread_new("bench-stress", stress_thread_cb, &threads[i]);
+    }
+
+    // Catalog reloads are scheduled on this thread's main context
+    while (g_atomic_int_get(running) > 0) {
+        gint64 now = g_get_monotonic_time();
+
+        if (now > deadline + STRESS_HANG_TIMEOUT) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                        "%d stress threads still running %" G_GINT64_FORMAT
+                        " seconds after the deadline, they're probably deadlocked",
+                        g_atomic_int_get(running), STRESS_HANG_TIMEOUT / G_TIME_SPAN_SECOND);
+            return FALSE;
+        }
+
+        if (now < deadline && now >= next_reload) {
+            g_autofree gchar *catalog = generate_catalog(++revision);
+
+            next_reload += STRESS_RELOAD_INTERVAL;
+            if (succeeded && !g_file_set_contents(catalog_path, catalog, -1, error))
+                succeeded = FALSE;
+        }
+
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+        g_usleep(G_TIME_SPAN_MILLISECOND);
+    }
+
+    for (gint i = 0; i < stress_threads; i++) {
+        g_thread_join(handles[i]);
+        g_object_unref(threads[i].plugin);
+        stress_calls += threads[i].calls;
+        if (threads[i].error == NULL)
+            continue;
+        if (succeeded)
+            g_propagate_error(error, g_steal_pointer(&threads[i].error));
+        g_clear_error(&threads[i].error);
+        succeeded = FALSE;
+    }
+
+    g_free(threads);
+    g_free(handles);
+    g_free(running);
+    return succeeded;
+}
+
+static void
+record(BenchOperationId id, gint64 start_time, guint commands)
+{
+    gdouble milliseconds = (g_get_monotonic_time() - start_time) / 1000.0;
+
+    g_array_append_val(operations[id].samples, milliseconds);
+    operations[id].commands += commands;
+}
+
+static gboolean
+run_iteration(guint iteration, const gchar *log_path, const gchar *catalog_path, GError **error)
+{
+    g_autoptr(GsPlugin) plugin              = g_object_new(gs_plugin_query_type(), NULL);
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    guint commands                          = count_commands(log_path);
+    gint64 start_time;
+    guint previous;
+
+#define MEASURE(id, call)                                                                          \
+    G_STMT_START                                                                                   \
+    {                                                                                              \
+        start_time = g_get_monotonic_time();                                                       \
+        if (!(call))                                                                               \
+            return FALSE;                                                                          \
+        previous = commands;                                                                       \
+        commands = count_commands(log_path);                                                       \
+        record(id, start_time, commands - previous);                                               \
+    }                                                                                              \
+    G_STMT_END
+
+    MEASURE(OPERATION_SETUP, run_setup(plugin, error));
+    MEASURE(OPERATION_LIST_APPS_FIRST, run_list_apps(plugin, error));
+    MEASURE(OPERATION_LIST_APPS, run_list_apps(plugin, error));
+    MEASURE(OPERATION_SEARCH, run_search(plugin, iteration, error));
+    MEASURE(OPERATION_REFINE, run_refine(plugin, iteration, error));
+    MEASURE(OPERATION_ADD_SOURCES, run_add_sources(plugin, error));
+
+    // Loaded apart from the plugin's, from the silo it just cached
+    catalog = gs_vanilla_meta_catalog_load(NULL, error);
+    if (catalog == NULL)
+        return FALSE;
+    MEASURE(OPERATION_LOOKUP_INDEX, run_lookup(catalog, iteration, TRUE, error));
+    MEASURE(OPERATION_LOOKUP_XPATH, run_lookup(catalog, iteration, FALSE, error));
+
+    if (stress)
+        MEASURE(OPERATION_STRESS, run_stress(plugin, catalog_path, error));
+
+#undef MEASURE
+
+    return TRUE;
+}
+
+static gint
+compare_doubles(gconstpointer a, gconstpointer b)
+{
+    gdouble x = *(const gdouble *)a;
+    gdouble y = *(const gdouble *)b;
+
+    return (x > y) - (x < y);
+}
+
+static gdouble
+percentile(GArray *sorted, guint p)
+{
+    guint index = (sorted->len * p + 99) / 100;
+
+    return g_array_index(sorted, gdouble, index > 0 ? index - 1 : 0);
+}
+
+static void
+report(void)
+{
+    g_print("%-26s %10s %10s %10s %14s\n", "operation", "p50 ms", "p95 ms", "p99 ms",
+            "commands/run");
+    for (guint i = 0; i < OPERATION_LAST; i++) {
+        GArray *samples = operations[i].samples;
+
+        if (samples->len == 0)
+            continue;
+
+        g_array_sort(samples, compare_doubles);
+        g_print("%-26s %10.2f %10.2f %10.2f %14.1f\n", operations[i].name,
+                percentile(samples, 50), percentile(samples, 95), percentile(samples, 99),
+                (gdouble)operations[i].commands / samples->len);
+    }
+
+    if (stress)
+        g_print("%u concurrent calls from %d threads, %.1f calls/s\n", stress_calls,
+                stress_threads,
+                stress_calls / (gdouble)(n_iterations * MAX(stress_seconds, 1)));
+}
+
+static void
+remove_tree(const gchar *path)
+{
+    g_autoptr(GDir) dir = g_dir_open(path, 0, NULL);
+    const gchar *name   = NULL;
+
+    while (dir != NULL && (name = g_dir_read_name(dir)) != NULL) {
+        g_autofree gchar *child = g_build_filename(path, name, NULL);
+
+        if (g_file_test(child, G_FILE_TEST_IS_DIR))
+            remove_tree(child);
+        else
+            g_unlink(child);
+    }
+    g_rmdir(path);
+}
+
+int
+main(int argc, char **argv)
+{
+    g_autoptr(GOptionContext) context = g_option_context_new(NULL);
+    g_autoptr(GError) error           = NULL;
+    g_autofree gchar *tmp_dir         = NULL;
+    g_autofree gchar *catalog_dir     = NULL;
+    g_autofree gchar *catalog_path    = NULL;
+    g_autofree gchar *cache_dir       = NULL;
+    g_autofree gchar *data_dir        = NULL;
+    g_autofree gchar *manifest_path   = NULL;
+    g_autofree gchar *log_path        = NULL;
+    g_autofree gchar *path            = NULL;
+    g_autofree gchar *stub_latency    = NULL;
+    g_autofree gchar *installed       = NULL;
+    g_autofree gchar *catalog         = NULL;
+    gint status                       = EXIT_SUCCESS;
+
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    n_components   = CLAMP(n_components, COMPONENTS_MIN, COMPONENTS_MAX);
+    n_containers   = CLAMP(n_containers, 1, (gint)G_N_ELEMENTS(containers));
+    n_iterations   = MAX(n_iterations, 1);
+    n_refine_apps  = CLAMP(n_refine_apps, 1, n_components);
+    stress_threads = CLAMP(stress_threads, 1, STRESS_THREADS_MAX);
+    stress_seconds = MAX(stress_seconds, 1);
+
+    tmp_dir = g_dir_make_tmp("gs-vanilla-meta-bench-XXXXXX", &error);
+    if (tmp_dir == NULL) {
+        g_printerr("Failed to create temporary directory: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    catalog_dir   = g_build_filename(tmp_dir, "catalog", NULL);
+    catalog_path  = g_build_filename(catalog_dir, "vanillaos-bench.xml", NULL);
+    cache_dir     = g_build_filename(tmp_dir, "cache", NULL);
+    data_dir      = g_build_filename(tmp_dir, "data", NULL);
+    manifest_path = g_build_filename(data_dir, "vanilla_meta", "installed.ini", NULL);
+    log_path      = g_build_filename(tmp_dir, "commands.log", NULL);
+    catalog       = generate_catalog(0);
+
+    g_mkdir_with_parents(catalog_dir, 0755);
+    if (!g_file_set_contents(catalog_path, catalog, -1, &error)) {
+        g_printerr("Failed to write catalog: %s\n", error->message);
+        remove_tree(tmp_dir);
+        return EXIT_FAILURE;
+    }
+
+    // Has to happen before anything reads the environment
+    path         = g_strdup_printf("%s:%s", BENCH_STUBS_DIR, g_getenv("PATH"));
+    stub_latency = g_strdup_printf("%.3f", latency / 1000.0);
+    installed    = g_strdup_printf("%d", n_components / 10);
+    g_setenv("PATH", path, TRUE);
+    g_setenv("XDG_CACHE_HOME", cache_dir, TRUE);
+    // Keeps the synthetic packages out of the user's manifest
+    g_setenv("XDG_DATA_HOME", data_dir, TRUE);
+    g_setenv("GS_VANILLA_META_CATALOG_DIR", catalog_dir, TRUE);
+    g_setenv("BENCH_STUB_LOG", log_path, TRUE);
+    g_setenv("BENCH_STUB_LATENCY", stub_latency, TRUE);
+    g_setenv("BENCH_STUB_INSTALLED", installed, TRUE);
+    // Pre-warming would run commands in the background and skew the counts
+    g_setenv("GS_VANILLA_META_PREWARM", "none", FALSE);
+    // The stubs stand in for podman, unless pointed to a fake socket
+    g_setenv("GS_VANILLA_META_PODMAN_SOCKET", "", FALSE);
+
+    for (guint i = 0; i < OPERATION_LAST; i++)
+        operations[i].samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+    g_print("%d components in %d containers, %d iterations, %.1f ms per command%s\n",
+            n_components, n_containers, n_iterations, latency, cold_cache ? ", cold caches" : "");
+
+    for (gint i = 0; i < n_iterations; i++) {
+        if (cold_cache) {
+            remove_tree(cache_dir);
+            g_unlink(manifest_path);
+        }
+
+        if (!run_iteration(i, log_path, catalog_path, &error)) {
+            g_printerr("Iteration %d failed: %s\n", i, error->message);
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    if (status == EXIT_SUCCESS)
+        report();
+
+    for (guint i = 0; i < OPERATION_LAST; i++)
+        g_array_unref(operations[i].samples);
+    remove_tree(tmp_dir);
+
+    return status;
+}
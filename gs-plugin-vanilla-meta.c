@@ -9,6 +9,14 @@
 
 #include "gs-appstream.h"
 #include "gs-plugin-vanilla-meta.h"
+#include "gs-vanilla-meta-catalog.h"
+#include "gs-vanilla-meta-libpod.h"
+#include "gs-vanilla-meta-manifest.h"
+#include "gs-vanilla-meta-metrics.h"
+#include "gs-vanilla-meta-podman.h"
+#include "gs-vanilla-meta-progress.h"
+#include "gs-vanilla-meta-sizes.h"
+#include "gs-vanilla-meta-subprocess.h"
 #include "gs-vanilla-meta-util.h"
 
 static gint get_priority_for_interactivity(gboolean interactive);
@@ -23,13 +31,39 @@ static gboolean refine_app(GsPluginVanillaMeta *self,
                            GsPluginRefineFlags flags,
                            GCancellable *cancellable,
                            GError **error);
+static gboolean refine_apps(GsPluginVanillaMeta *self,
+                            GPtrArray *apps,
+                            GsPluginRefineFlags flags,
+                            GCancellable *cancellable,
+                            GError **error);
+static void refine_job_run_cb(gpointer data, gpointer user_data);
 static void
 setup_thread_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
+static void catalog_changed_cb(GFileMonitor *monitor,
+                               GFile *file,
+                               GFile *other_file,
+                               GFileMonitorEvent event_type,
+                               gpointer user_data);
+static void reload_catalog_thread_cb(GTask *task,
+                                     gpointer source_object,
+                                     gpointer task_data,
+                                     GCancellable *cancellable);
 static void enable_repository_thread_cb(GTask *task,
                                         gpointer source_object,
                                         gpointer task_data,
                                         GCancellable *cancellable);
-gboolean check_app_is_installed(GsApp *app,
+static GHashTable *lookup_installed_packages(GsPluginVanillaMeta *self,
+                                             const gchar *container,
+                                             GCancellable *cancellable);
+static void installed_cache_update(GsPluginVanillaMeta *self,
+                                   const gchar *container,
+                                   const gchar *package_name,
+                                   gboolean installed);
+static void installed_cache_invalidate(GsPluginVanillaMeta *self, const gchar *container);
+static void queue_reconcile(GsPluginVanillaMeta *self, const gchar *container);
+static const gchar *component_get_container_name(XbNode *component);
+gboolean check_app_is_installed(GsPluginVanillaMeta *self,
+                                GsApp *app,
                                 GCancellable *cancellable,
                                 GError *error,
                                 gboolean update_status);
@@ -41,34 +75,191 @@ static void refine_thread_cb(GTask *task,
                              gpointer source_object,
                              gpointer task_data,
                              GCancellable *cancellable);
-
-const gchar *gz_metadata_filename   = "/usr/share/swcatalog/xml/vanillaos-kinetic-main.xml.gz";
-const gchar *metadata_silo_filename = ".cache/vanilla_meta/metadata.xmlb";
+static void queue_prewarm(GsPluginVanillaMeta *self);
+
+// Seconds a container's installed package list is trusted before listing it again
+#define INSTALLED_CACHE_TTL_DEFAULT 300
+// Upper bound for the refine pool, regardless of the number of CPUs
+#define REFINE_THREADS_MAX 8
+// Refines allowed to run at once against the same container
+#define REFINE_JOBS_PER_CONTAINER_DEFAULT 2
+// Milliseconds to wait for the catalog files to settle before reloading them
+#define CATALOG_RELOAD_DELAY 1000
+// Seconds a query against a container (listing, show, ls) may run before it's killed
+#define PROBE_TIMEOUT_DEFAULT 60
+// Milliseconds installs into the same container are collected for before running them together
+#define INSTALL_BATCH_WINDOW_DEFAULT 500
+// Seconds sizes of packages without a version in the catalog are trusted
+#define SIZE_CACHE_MAX_AGE_DEFAULT (7 * 24 * 60 * 60)
+// Seconds the updates found in the containers are shown before checking them again
+#define UPDATES_CACHE_TTL_DEFAULT (60 * 60)
+// Upper bound for the containers checked for updates at once
+#define UPDATES_THREADS_MAX 4
+// Seconds between metrics dumps, when they're enabled
+#define METRICS_DUMP_INTERVAL_DEFAULT 60
+
+typedef struct {
+    GHashTable *packages; /* (owned) (nullable): NULL if the container couldn't be listed */
+    gint64 timestamp;
+    gboolean probing;     /* a thread is listing the container, wait for it on installed_cond */
+    gboolean invalidated; /* changed while probing, the listing is stale once it arrives */
+} InstalledCacheEntry;
+
+typedef enum {
+    PREWARM_NONE,  /* leave containers alone */
+    PREWARM_START, /* start the containers which exist */
+    PREWARM_INIT,  /* also initialize the missing ones */
+} PrewarmPolicy;
+
+static const gchar *const prewarm_policies[] = {"none", "start", "init", NULL};
+
+typedef enum {
+    INSTALL_REQUEST_QUEUED,
+    INSTALL_REQUEST_RUNNING,
+    INSTALL_REQUEST_DONE,
+} InstallRequestState;
+
+typedef struct {
+    const gchar *package_name;
+    GsVanillaMetaProgress *progress; /* (unowned) */
+    gboolean update;                 /* update the installed package instead of installing it */
+    GCancellable *cancellable;       /* (unowned) (nullable): of the thread waiting on it */
+    InstallRequestState state;
+    GError *error; /* (owned) (nullable): set if the package wasn't installed */
+} InstallRequest;
+
+typedef struct {
+    gchar *container;          /* (owned) */
+    GPtrArray *requests;       /* (element-type InstallRequest): owned by their threads */
+    gint64 deadline;           /* no more requests are collected after this, monotonic time */
+    GCancellable *cancellable; /* (owned): cancelled once every running request is */
+} InstallBatch;
 
 struct _GsPluginVanillaMeta {
     GsPlugin parent;
-    GsWorkerThread *worker; /* (owned) */
-    GMutex silo_mutex;
-    XbSilo *silo;
+    GsWorkerThread *worker;        /* (owned) */
+    GRWLock catalog_lock;          /* only guards the catalog pointer, not its contents */
+    GsVanillaMetaCatalog *catalog; /* (owned) (nullable): use acquire_catalog() to read it */
+    GFileMonitor *catalog_monitor; /* (owned) (nullable) */
+    guint catalog_reload_id;
+    GCancellable *catalog_reload_cancellable; /* (owned) */
+    GsVanillaMetaPodman *podman;              /* (owned) (nullable): existing containers */
+
+    /* Only accessed from the worker */
+    gchar *cached_silo_guid;           /* silo the plugin cache was last refreshed from */
+    GHashTable *cached_ids;            /* component ids already added to the plugin cache */
+    GCancellable *prewarm_cancellable; /* (owned) (nullable): of the running pre-warm */
+
+    GMutex installed_mutex;
+    GCond installed_cond;
+    GHashTable *installed_cache;     /* container name -> InstalledCacheEntry */
+    gint64 installed_cache_ttl;      /* microseconds */
+    guint probe_timeout;             /* seconds */
+    GHashTable *reconcile_pending;   /* containers to check the manifest against */
+    gboolean reconcile_queued;       /* reconcile_thread_cb() is queued on the worker */
+    GsVanillaMetaManifest *manifest; /* (owned) */
+
+    GThreadPool *refine_pool; /* (owned) (nullable): NULL when refining sequentially */
+    guint refine_jobs_per_container;
+
+    GMutex install_mutex;
+    GCond install_cond;
+    GHashTable *install_batches; /* container name -> InstallBatch still collecting requests */
+    GHashTable *install_running; /* container -> InstallBatch running, NULL if pre-warming */
+    gint64 install_batch_window; /* microseconds */
+    PrewarmPolicy prewarm_policy;
+
+    GsVanillaMetaSizeCache *sizes; /* (owned) */
+
+    GMutex sources_mutex;
+    GPtrArray *sources_related; /* (owned) (nullable): installed apps, as last found */
+    GsApp *sources_app;         /* (owned) (nullable): repository last returned */
+    gboolean sources_refreshing;
+
+    GMutex updates_mutex;
+    GPtrArray *updates;       /* (owned) (nullable): updatable apps, as last found */
+    gint64 updates_timestamp; /* when the containers were last checked, monotonic time */
+    gint64 updates_cache_ttl; /* microseconds */
+    gboolean updates_refreshing;
+    guint metrics_dump_id;
 };
 
 G_DEFINE_TYPE(GsPluginVanillaMeta, gs_plugin_vanilla_meta, GS_TYPE_PLUGIN)
 
 #define assert_in_worker(self) g_assert(gs_worker_thread_is_in_worker_context(self->worker))
 
+/*
+ * Writes the collected metrics out, periodically and when the plugin goes away
+ */
+static gboolean
+metrics_dump_cb(gpointer user_data)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!gs_vanilla_meta_metrics_dump(&error))
+        g_warning("Failed to dump metrics: %s", error->message);
+
+    return G_SOURCE_CONTINUE;
+}
+
 static void
 gs_plugin_vanilla_meta_dispose(GObject *object)
 {
     GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(object);
 
+    if (self->refine_pool != NULL) {
+        g_thread_pool_free(self->refine_pool, FALSE, TRUE);
+        self->refine_pool = NULL;
+    }
+    g_cancellable_cancel(self->catalog_reload_cancellable);
+    g_cancellable_cancel(self->prewarm_cancellable);
+    if (self->podman != NULL) {
+        gs_vanilla_meta_podman_stop(self->podman);
+        g_clear_pointer(&self->podman, gs_vanilla_meta_podman_unref);
+    }
+    if (self->catalog_monitor != NULL) {
+        g_signal_handlers_disconnect_by_data(self->catalog_monitor, self);
+        g_clear_object(&self->catalog_monitor);
+    }
+    if (self->catalog_reload_id != 0) {
+        g_source_remove(self->catalog_reload_id);
+        self->catalog_reload_id = 0;
+    }
+    if (self->metrics_dump_id != 0) {
+        g_source_remove(self->metrics_dump_id);
+        self->metrics_dump_id = 0;
+        metrics_dump_cb(self);
+    }
     g_clear_object(&self->worker);
-    g_mutex_clear(&self->silo_mutex);
+    g_clear_pointer(&self->catalog, gs_vanilla_meta_catalog_unref);
     G_OBJECT_CLASS(gs_plugin_vanilla_meta_parent_class)->dispose(object);
 }
 
 static void
 gs_plugin_vanilla_meta_finalize(GObject *object)
 {
+    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(object);
+
+    g_clear_pointer(&self->updates, g_ptr_array_unref);
+    g_mutex_clear(&self->updates_mutex);
+    g_clear_pointer(&self->sources_related, g_ptr_array_unref);
+    g_clear_object(&self->sources_app);
+    g_mutex_clear(&self->sources_mutex);
+    gs_vanilla_meta_size_cache_free(self->sizes);
+    gs_vanilla_meta_manifest_free(self->manifest);
+    g_hash_table_unref(self->reconcile_pending);
+    g_hash_table_unref(self->install_batches);
+    g_hash_table_unref(self->install_running);
+    g_mutex_clear(&self->install_mutex);
+    g_cond_clear(&self->install_cond);
+    g_hash_table_unref(self->installed_cache);
+    g_mutex_clear(&self->installed_mutex);
+    g_cond_clear(&self->installed_cond);
+    g_hash_table_unref(self->cached_ids);
+    g_free(self->cached_silo_guid);
+    g_object_unref(self->catalog_reload_cancellable);
+    g_clear_object(&self->prewarm_cancellable);
+    g_rw_lock_clear(&self->catalog_lock);
     G_OBJECT_CLASS(gs_plugin_vanilla_meta_parent_class)->finalize(object);
 }
 
@@ -84,115 +275,290 @@ gs_plugin_vanilla_meta_setup_async(GsPlugin *plugin,
                                    GAsyncReadyCallback callback,
                                    gpointer user_data)
 {
-    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(plugin);
-    g_autoptr(GTask) task     = NULL;
+    GsPluginVanillaMeta *self          = GS_PLUGIN_VANILLA_META(plugin);
+    g_autoptr(GTask) task              = NULL;
+    g_autoptr(GFile) catalog_directory = gs_vanilla_meta_catalog_get_source_directory();
+    g_autoptr(GError) error            = NULL;
+    gint64 *start_time                 = g_new(gint64, 1);
+    guint refine_threads;
+    guint metrics_interval;
 
-    g_mutex_init(&self->silo_mutex);
+    *start_time = g_get_monotonic_time();
 
     task = g_task_new(plugin, cancellable, callback, user_data);
     g_task_set_source_tag(task, gs_plugin_vanilla_meta_setup_async);
+    g_task_set_task_data(task, start_time, g_free);
 
     // Start up a worker thread to process all the plugin's function calls.
     self->worker = gs_worker_thread_new("gs-plugin-vanilla-meta");
 
+    // Refines are fanned out from the worker to this pool, 1 thread means sequential
+    refine_threads = gs_vanilla_meta_get_setting_uint(
+        "REFINE_THREADS", MIN(g_get_num_processors(), REFINE_THREADS_MAX));
+    self->refine_jobs_per_container = MAX(
+        gs_vanilla_meta_get_setting_uint("REFINE_JOBS_PER_CONTAINER",
+                                         REFINE_JOBS_PER_CONTAINER_DEFAULT),
+        1);
+    if (refine_threads > 1) {
+        self->refine_pool =
+            g_thread_pool_new((GFunc)refine_job_run_cb, self, refine_threads, FALSE, &error);
+        if (self->refine_pool == NULL)
+            g_debug("Failed to create refine pool, refining sequentially: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    // Reload the catalog when it's updated. Created here so it reports to the main context.
+    self->catalog_monitor =
+        g_file_monitor_directory(catalog_directory, G_FILE_MONITOR_NONE, NULL, &error);
+    if (self->catalog_monitor != NULL)
+        g_signal_connect(self->catalog_monitor, "changed", G_CALLBACK(catalog_changed_cb), self);
+    else
+        g_debug("Failed to watch catalog directory, it won't be reloaded: %s", error->message);
+
+    // Track containers from events instead of listing them on every install. Started here
+    // so events are handled on the main context.
+    self->podman = gs_vanilla_meta_podman_new();
+    gs_vanilla_meta_podman_start(self->podman);
+
+    // Dumped on a timer rather than on a signal, which belongs to gnome-software
+    if (gs_vanilla_meta_metrics_enabled()) {
+        metrics_interval =
+            gs_vanilla_meta_get_setting_uint("METRICS_INTERVAL", METRICS_DUMP_INTERVAL_DEFAULT);
+        self->metrics_dump_id =
+            g_timeout_add_seconds(MAX(metrics_interval, 1), metrics_dump_cb, self);
+    }
+
     gs_worker_thread_queue(self->worker, G_PRIORITY_DEFAULT, setup_thread_cb,
                            g_steal_pointer(&task));
 }
 
+/*
+ * Takes a reference to the current catalog, or returns NULL if it isn't loaded.
+ * The lock is only held to take the reference, the catalog itself is immutable.
+ */
+static GsVanillaMetaCatalog *
+acquire_catalog(GsPluginVanillaMeta *self)
+{
+    GsVanillaMetaCatalog *catalog = NULL;
+
+    g_rw_lock_reader_lock(&self->catalog_lock);
+    if (self->catalog != NULL)
+        catalog = gs_vanilla_meta_catalog_ref(self->catalog);
+    g_rw_lock_reader_unlock(&self->catalog_lock);
+
+    return catalog;
+}
+
+/*
+ * Publishes a new catalog. Readers holding the old one keep using it until they
+ * drop their reference.
+ */
 static void
-setup_thread_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+replace_catalog(GsPluginVanillaMeta *self, GsVanillaMetaCatalog *catalog)
 {
-    GsPluginVanillaMeta *self         = GS_PLUGIN_VANILLA_META(source_object);
-    const gchar *const *locales       = g_get_language_names();
-    g_autoptr(XbBuilder) builder      = xb_builder_new();
-    g_autoptr(XbBuilderNode) info     = NULL;
-    g_autoptr(XbBuilderSource) source = xb_builder_source_new();
-    g_autoptr(GFile) silo_file        = g_file_new_for_path(metadata_silo_filename);
-    g_autoptr(GFile) metadata_file    = g_file_new_for_path(gz_metadata_filename);
-    g_autoptr(GError) error           = NULL;
+    GsVanillaMetaCatalog *old_catalog = NULL;
 
-    assert_in_worker(self);
+    g_rw_lock_writer_lock(&self->catalog_lock);
+    old_catalog   = self->catalog;
+    self->catalog = gs_vanilla_meta_catalog_ref(catalog);
+    g_rw_lock_writer_unlock(&self->catalog_lock);
+
+    if (old_catalog != NULL)
+        gs_vanilla_meta_catalog_unref(old_catalog);
+}
+
+static gboolean
+catalog_reload_timeout_cb(gpointer user_data)
+{
+    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(user_data);
+    g_autoptr(GTask) task     = NULL;
+
+    self->catalog_reload_id = 0;
+
+    task = g_task_new(self, self->catalog_reload_cancellable, NULL, NULL);
+    g_task_set_source_tag(task, catalog_reload_timeout_cb);
+
+    gs_worker_thread_queue(self->worker, G_PRIORITY_LOW, reload_catalog_thread_cb,
+                           g_steal_pointer(&task));
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+catalog_changed_cb(GFileMonitor *monitor,
+                   GFile *file,
+                   GFile *other_file,
+                   GFileMonitorEvent event_type,
+                   gpointer user_data)
+{
+    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(user_data);
 
-    g_debug("Loading app silo");
+    if (!gs_vanilla_meta_catalog_is_source_file(file) &&
+        (other_file == NULL || !gs_vanilla_meta_catalog_is_source_file(other_file)))
+        return;
+
+    switch (event_type) {
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        break;
+    default:
+        return;
+    }
+
+    // Package upgrades touch the file several times, only reload once it settles
+    g_debug("Catalog changed, reloading it");
+    if (self->catalog_reload_id != 0)
+        g_source_remove(self->catalog_reload_id);
+    self->catalog_reload_id = g_timeout_add(CATALOG_RELOAD_DELAY, catalog_reload_timeout_cb, self);
+}
+
+/*
+ * Rebuilds the silo in the background and swaps it in. Refreshing the plugin cache
+ * is left to the next query, which will notice the new silo GUID.
+ */
+static void
+reload_catalog_thread_cb(GTask *task,
+                         gpointer source_object,
+                         gpointer task_data,
+                         GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    g_autoptr(GError) error                 = NULL;
 
-    // Add current locales
-    for (guint i = 0; locales[i] != NULL; i++)
-        xb_builder_add_locale(builder, locales[i]);
+    assert_in_worker(self);
 
-    // Load file into silo
-    if (!xb_builder_source_load_file(source, metadata_file,
-                                     XB_BUILDER_SOURCE_FLAG_WATCH_FILE |
-                                         XB_BUILDER_SOURCE_FLAG_LITERAL_TEXT,
-                                     cancellable, &error)) {
-        g_debug("Failed to load xml file for builder");
+    catalog = gs_vanilla_meta_catalog_load(cancellable, &error);
+    if (catalog == NULL) {
+        // Keep serving the catalog we have
+        g_debug("Failed to reload catalog: %s", error->message);
         g_task_return_error(task, g_steal_pointer(&error));
         return;
     }
 
-    info = xb_builder_node_insert(NULL, "info", NULL);
-    xb_builder_node_insert_text(info, "scope",
-                                as_component_scope_to_string(AS_COMPONENT_SCOPE_USER), NULL);
-    xb_builder_source_set_info(source, info);
+    replace_catalog(self, catalog);
+    g_debug("Catalog reloaded");
+    queue_prewarm(self);
 
-    // Import source to builder
-    xb_builder_import_source(builder, source);
+    gs_plugin_reload(GS_PLUGIN(self));
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+setup_thread_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    const gint64 *start_time                = task_data;
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    g_autoptr(GError) error                 = NULL;
 
-    // Save to silo
-    g_mutex_lock(&self->silo_mutex);
-    self->silo = xb_builder_ensure(builder, silo_file,
-                                   XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID |
-                                       XB_BUILDER_COMPILE_FLAG_SINGLE_LANG,
-                                   cancellable, &error);
+    assert_in_worker(self);
 
-    g_mutex_unlock(&self->silo_mutex);
-    if (self->silo == NULL) {
+    catalog = gs_vanilla_meta_catalog_load(cancellable, &error);
+    if (catalog == NULL) {
         g_debug("Failed to create silo: %s", error->message);
         g_task_return_error(task, g_steal_pointer(&error));
         return;
     }
 
+    replace_catalog(self, catalog);
+
+    // Warm means the silo was mapped from the cache, cold means it had to be compiled
+    g_debug("Setup took %.1f ms (%s)", (g_get_monotonic_time() - *start_time) / 1000.0,
+            catalog->from_cache ? "warm" : "cold");
+
+    queue_prewarm(self);
     g_task_return_boolean(task, TRUE);
 }
 
+/*
+ * Makes sure every component in the silo has a refined app in the plugin cache.
+ * Only ids added or removed since the last pass are processed, and nothing is done
+ * at all while the silo stays the same.
+ */
 static gboolean
 refresh_plugin_cache(GsPluginVanillaMeta *self, GCancellable *cancellable, GError **error)
 {
-    g_autofree gchar *xpath         = NULL;
-    g_autoptr(GPtrArray) components = NULL;
-    g_autoptr(GError) local_error   = NULL;
+    g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+    g_autoptr(GPtrArray) new_apps           = g_ptr_array_new_with_free_func(g_object_unref);
+    g_autoptr(GError) local_error           = NULL;
+    GHashTable *ids                         = NULL;
+    GHashTableIter iter;
+    gpointer key;
     GsPluginRefineFlags refine_flags;
 
-    g_mutex_lock(&self->silo_mutex);
-    xpath      = g_strdup_printf("components[@origin='vanilla_meta']/component/id");
-    components = xb_silo_query(self->silo, xpath, 0, &local_error);
-    g_mutex_unlock(&self->silo_mutex);
+    assert_in_worker(self);
 
-    if (local_error != NULL) {
-        g_debug("Plugin cache query returned error: %s", local_error->message);
+    if (catalog == NULL) {
+        g_debug("Plugin cache refresh: silo is not initialized");
         return FALSE;
     }
 
-    for (guint i = 0; i < components->len; i++) {
-        XbNode *node = components->pdata[i];
-        g_debug("Ensure: %s", xb_node_get_text(node));
+    if (g_strcmp0(gs_vanilla_meta_catalog_get_guid(catalog), self->cached_silo_guid) == 0)
+        return TRUE;
+
+    ids = catalog->component_index;
+
+    // Forget apps which are no longer in the catalog
+    g_hash_table_iter_init(&iter, self->cached_ids);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        if (!g_hash_table_contains(ids, key)) {
+            g_debug("Forget: %s", (const gchar *)key);
+            gs_plugin_cache_remove(GS_PLUGIN(self), key);
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    g_hash_table_iter_init(&iter, ids);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const gchar *id = key;
 
-        g_autoptr(GsApp) app = gs_plugin_cache_lookup(GS_PLUGIN(self), xb_node_get_text(node));
+        if (g_hash_table_contains(self->cached_ids, id))
+            continue;
+
+        g_debug("Ensure: %s", id);
+
+        g_autoptr(GsApp) app = gs_plugin_cache_lookup(GS_PLUGIN(self), id);
+        gs_vanilla_meta_metrics_count(app != NULL ? "plugin-cache-hit" : "plugin-cache-miss");
         if (app == NULL) {
-            app = gs_app_new(xb_node_get_text(node));
+            app = gs_app_new(id);
             gs_app_set_management_plugin(app, GS_PLUGIN(self));
             gs_app_set_origin(app, "vanilla_meta");
 
-            gs_plugin_cache_add(GS_PLUGIN(self), xb_node_get_text(node), app);
-
-            refine_flags = GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON |
-                           GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE | GS_PLUGIN_REFINE_FLAGS_REQUIRE_ID;
-            if (!refine_app(self, app, refine_flags, cancellable, &local_error)) {
-                g_debug("Could not refine app %s", gs_app_get_id(app));
-                return FALSE;
-            }
+            gs_plugin_cache_add(GS_PLUGIN(self), id, app);
+            g_ptr_array_add(new_apps, g_steal_pointer(&app));
+            continue;
         }
+
+        g_hash_table_add(self->cached_ids, g_strdup(id));
     }
 
+    // Sizes are left to the refines of the pages showing them, querying them for the whole
+    // catalog would hold up the first listing
+    refine_flags = GS_PLUGIN_REFINE_FLAGS_REQUIRE_ICON | GS_PLUGIN_REFINE_FLAGS_REQUIRE_ID;
+    if (!refine_apps(self, new_apps, refine_flags, cancellable, &local_error)) {
+        g_debug("Could not refine new apps: %s", local_error->message);
+        g_propagate_error(error, g_steal_pointer(&local_error));
+
+        // Created again and refined by the next refresh, instead of being found as is
+        for (guint i = 0; i < new_apps->len; i++)
+            gs_plugin_cache_remove(GS_PLUGIN(self), gs_app_get_id(new_apps->pdata[i]));
+        return FALSE;
+    }
+
+    // New apps are only known once they're refined, so a failure retries them
+    for (guint i = 0; i < new_apps->len; i++)
+        g_hash_table_add(self->cached_ids, g_strdup(gs_app_get_id(new_apps->pdata[i])));
+
+    // Only now we know the whole silo was processed
+    g_free(self->cached_silo_guid);
+    self->cached_silo_guid = g_strdup(gs_vanilla_meta_catalog_get_guid(catalog));
+
     return TRUE;
 }
 
@@ -202,24 +568,67 @@ gs_plugin_vanilla_meta_setup_finish(GsPlugin *plugin, GAsyncResult *result, GErr
     return g_task_propagate_boolean(G_TASK(result), error);
 }
 
+static void
+installed_cache_entry_free(InstalledCacheEntry *entry)
+{
+    g_clear_pointer(&entry->packages, g_hash_table_unref);
+    g_free(entry);
+}
+
 static void
 gs_plugin_vanilla_meta_init(GsPluginVanillaMeta *self)
 {
     GsPlugin *plugin = GS_PLUGIN(self);
 
+    g_rw_lock_init(&self->catalog_lock);
+    g_mutex_init(&self->installed_mutex);
+    g_cond_init(&self->installed_cond);
+    self->installed_cache     = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                      (GDestroyNotify)installed_cache_entry_free);
+    self->installed_cache_ttl = (gint64)gs_vanilla_meta_get_setting_uint(
+                                    "INSTALLED_CACHE_TTL", INSTALLED_CACHE_TTL_DEFAULT) *
+                                G_TIME_SPAN_SECOND;
+    self->reconcile_pending          = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->manifest                   = gs_vanilla_meta_manifest_new();
+    self->cached_ids                 = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->catalog_reload_cancellable = g_cancellable_new();
+
+    self->probe_timeout = gs_vanilla_meta_get_setting_uint("PROBE_TIMEOUT", PROBE_TIMEOUT_DEFAULT);
+
+    g_mutex_init(&self->install_mutex);
+    g_cond_init(&self->install_cond);
+    self->install_batches      = g_hash_table_new(g_str_hash, g_str_equal);
+    self->install_running      = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->install_batch_window = (gint64)gs_vanilla_meta_get_setting_uint(
+                                     "INSTALL_BATCH_WINDOW", INSTALL_BATCH_WINDOW_DEFAULT) *
+                                 G_TIME_SPAN_MILLISECOND;
+
+    self->prewarm_policy =
+        gs_vanilla_meta_get_setting_choice("PREWARM", prewarm_policies, PREWARM_NONE);
+
+    self->sizes = gs_vanilla_meta_size_cache_new(
+        gs_vanilla_meta_get_setting_uint("SIZE_CACHE_MAX_AGE", SIZE_CACHE_MAX_AGE_DEFAULT));
+
+    g_mutex_init(&self->sources_mutex);
+
+    g_mutex_init(&self->updates_mutex);
+    self->updates_cache_ttl = (gint64)gs_vanilla_meta_get_setting_uint(
+                                  "UPDATES_CACHE_TTL", UPDATES_CACHE_TTL_DEFAULT) *
+                              G_TIME_SPAN_SECOND;
+
     gs_plugin_set_appstream_id(plugin, "org.gnome.Software.Plugin.VanillaMeta");
 
     gs_plugin_add_rule(plugin, GS_PLUGIN_RULE_RUN_AFTER, "appstream");
     gs_plugin_add_rule(plugin, GS_PLUGIN_RULE_RUN_BEFORE, "icons");
 }
 
-gboolean
-gs_plugin_add_sources(GsPlugin *plugin, GsAppList *list, GCancellable *cancellable, GError **error)
+/*
+ * Creates the app for the catalog shown in the repositories dialog
+ */
+static GsApp *
+create_repository_app(GsPlugin *plugin)
 {
-    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(plugin);
-    g_autoptr(GsApp) app      = NULL;
-
-    g_debug("Adding sources");
+    GsApp *app = NULL;
 
     // Create source
     /* app = gs_app_new("org.vanillaos.vanilla-meta"); */
@@ -250,35 +659,118 @@ gs_plugin_add_sources(GsPlugin *plugin, GsAppList *list, GCancellable *cancellab
                            "are using the most compatible container and configurations.");
     gs_app_set_url(app, AS_URL_KIND_HOMEPAGE, "https://vanillaos.org");
 
-    gs_app_list_add(list, app);
+    return app;
+}
 
-    // Add related apps (the ones installed from our repo)
-    g_mutex_lock(&self->silo_mutex);
-    if (self->silo != NULL) {
-        g_autofree gchar *xpath         = NULL;
-        g_autoptr(GPtrArray) components = NULL;
-        g_autoptr(GError) local_error   = NULL;
-
-        xpath      = g_strdup_printf("components[@origin='vanilla_meta']/component");
-        components = xb_silo_query(self->silo, xpath, 0, &local_error);
-        if (local_error != NULL) {
-            g_debug("Failed to add sources");
-            g_mutex_unlock(&self->silo_mutex);
+static gint
+compare_app_ids(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(gs_app_get_id(*(GsApp **)a), gs_app_get_id(*(GsApp **)b));
+}
+
+static gboolean
+same_apps(GPtrArray *a, GPtrArray *b)
+{
+    if (a == NULL || b == NULL || a->len != b->len)
+        return FALSE;
+
+    for (guint i = 0; i < a->len; i++) {
+        if (a->pdata[i] != b->pdata[i])
             return FALSE;
-        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Finds the installed apps of the catalog from the states of the cached apps, which
+ * refines set from the manifest or a single listing per container. If they changed
+ * since the repositories dialog last asked, it's told to ask again.
+ */
+static void
+sources_thread_cb(GTask *task,
+                  gpointer source_object,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    g_autoptr(GPtrArray) related            = g_ptr_array_new_with_free_func(g_object_unref);
+    g_autoptr(GsApp) repository             = NULL;
+    g_autoptr(GError) local_error           = NULL;
+    gboolean changed;
+    GHashTableIter iter;
+    gpointer key;
+
+    assert_in_worker(self);
+
+    if (!refresh_plugin_cache(self, cancellable, &local_error))
+        g_debug("Sources: Plugin cache may be incomplete: %s",
+                local_error != NULL ? local_error->message : "silo is not initialized");
 
-        for (guint i = 0; i < components->len; i++) {
-            g_autoptr(GsApp) related =
-                gs_appstream_create_app(plugin, self->silo, components->pdata[i], &local_error);
+    catalog = acquire_catalog(self);
+    if (catalog != NULL) {
+        g_hash_table_iter_init(&iter, catalog->component_index);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            g_autoptr(GsApp) app = gs_plugin_cache_lookup(GS_PLUGIN(self), key);
 
-            g_debug("Created app %s", gs_app_get_name(related));
-            if (check_app_is_installed(related, cancellable, local_error, TRUE))
-                gs_app_add_related(app, related);
+            if (app != NULL && (gs_app_get_state(app) == GS_APP_STATE_INSTALLED ||
+                                gs_app_get_state(app) == GS_APP_STATE_UPDATABLE_LIVE))
+                g_ptr_array_add(related, g_steal_pointer(&app));
         }
-    } else {
-        g_debug("Silo is not initialized");
+        g_ptr_array_sort(related, compare_app_ids);
+    }
+
+    g_mutex_lock(&self->sources_mutex);
+    changed = !same_apps(self->sources_related, related);
+    if (changed) {
+        g_clear_pointer(&self->sources_related, g_ptr_array_unref);
+        self->sources_related = g_ptr_array_ref(related);
+    }
+    if (self->sources_app != NULL)
+        repository = g_object_ref(self->sources_app);
+    self->sources_refreshing = FALSE;
+    g_mutex_unlock(&self->sources_mutex);
+
+    g_debug("Sources: %u related apps installed%s", related->len, changed ? ", changed" : "");
+    if (changed && repository != NULL)
+        gs_plugin_repository_changed(GS_PLUGIN(self), repository);
+
+    g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * Returns the repository right away, with the related apps found the last time.
+ * They're looked up again in the background, and the dialog is notified if they
+ * changed.
+ */
+gboolean
+gs_plugin_add_sources(GsPlugin *plugin, GsAppList *list, GCancellable *cancellable, GError **error)
+{
+    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(plugin);
+    g_autoptr(GsApp) app      = create_repository_app(plugin);
+    g_autoptr(GTask) task     = NULL;
+    gboolean queue;
+
+    g_debug("Adding sources");
+
+    // Add related apps (the ones installed from our repo)
+    g_mutex_lock(&self->sources_mutex);
+    for (guint i = 0; self->sources_related != NULL && i < self->sources_related->len; i++)
+        gs_app_add_related(app, self->sources_related->pdata[i]);
+    g_set_object(&self->sources_app, app);
+    queue                    = !self->sources_refreshing;
+    self->sources_refreshing = TRUE;
+    g_mutex_unlock(&self->sources_mutex);
+
+    gs_app_list_add(list, app);
+
+    if (queue) {
+        task = g_task_new(plugin, self->catalog_reload_cancellable, NULL, NULL);
+        g_task_set_source_tag(task, gs_plugin_add_sources);
+        gs_worker_thread_queue(self->worker, G_PRIORITY_LOW, sources_thread_cb,
+                               g_steal_pointer(&task));
     }
-    g_mutex_unlock(&self->silo_mutex);
 
     return TRUE;
 }
@@ -393,170 +885,1205 @@ gs_plugin_launch(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError
                                          NULL, error);
 }
 
-gboolean
-gs_plugin_app_install(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError **error)
+/*
+ * Logs the output of commands we don't otherwise parse
+ */
+static void
+log_line_cb(const gchar *line, gpointer user_data)
 {
-    const gchar *package_name       = NULL;
-    const gchar *container_flag     = NULL;
-    const gchar *app_container_name = gs_app_get_metadata_item(app, "Vanilla::container");
-    SubprocessOutput *output        = NULL;
-
-    // Only process this app if was created by this plugin
-    if (!gs_app_has_management_plugin(app, plugin))
-        return TRUE;
+    g_debug("%s", line);
+}
 
-    // Check container exists, otherwise run init for it
-    output = gs_vanilla_meta_run_subprocess(
-        "podman container ls --noheading -a | rev | cut -d\' \' -f 1 | rev",
-        G_SUBPROCESS_FLAGS_STDOUT_PIPE, cancellable, error);
+typedef struct {
+    const gchar *name;
+    gboolean found;
+} ContainerLookup;
 
-    if (output->input_stream != NULL) {
-        g_autoptr(GByteArray) ls_out = g_byte_array_new();
-        gchar buffer[4096];
-        gsize nread = 0;
-        gboolean success;
-        g_auto(GStrv) splits = NULL;
+static void
+container_ls_line_cb(const gchar *line, gpointer user_data)
+{
+    ContainerLookup *lookup = user_data;
 
-        gs_app_set_state(app, GS_APP_STATE_INSTALLING);
+    if (g_strcmp0(line, lookup->name) == 0)
+        lookup->found = TRUE;
+}
 
-        while (success = g_input_stream_read_all(output->input_stream, buffer, sizeof(buffer),
-                                                 &nread, cancellable, error),
-               success && nread > 0) {
-            g_byte_array_append(ls_out, (const guint8 *)buffer, nread);
-        }
+/*
+ * Checks if a container exists, from the registry when it's following podman events,
+ * then asking podman's socket, and by listing containers otherwise. Returns FALSE if
+ * that couldn't be found out.
+ */
+static gboolean
+check_container_exists(GsPluginVanillaMeta *self,
+                       const gchar *name,
+                       GCancellable *cancellable,
+                       gboolean *out_exists)
+{
+    const gchar *program          = gs_vanilla_meta_podman_get_program();
+    GsVanillaMetaLibpod *libpod   = gs_vanilla_meta_libpod_get_default();
+    ContainerLookup lookup        = {name, FALSE};
+    g_autoptr(GError) local_error = NULL;
+    gint exit_status;
 
-        // If we have a valid output
-        if (success && ls_out->len > 0) {
-            // NUL-terminate the array, to use it as a string
-            g_byte_array_append(ls_out, (const guint8 *)"", 1);
+    if (self->podman != NULL &&
+        gs_vanilla_meta_podman_lookup_container(self->podman, name, out_exists))
+        return TRUE;
 
-            splits = g_strsplit((gchar *)ls_out->data, "\n", -1);
+    if (libpod != NULL) {
+        if (gs_vanilla_meta_libpod_container_exists(libpod, name, self->probe_timeout, out_exists,
+                                                    cancellable, &local_error))
+            return TRUE;
 
-            if (app_container_name == NULL) {
-                g_debug("Install: Container name not set for %s, cannot install",
-                        gs_app_get_name(app));
-                gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
-                free(output);
-                return FALSE;
-            }
+        g_debug("Failed to ask podman's socket about container %s: %s", name,
+                local_error->message);
+        if (!gs_vanilla_meta_libpod_can_fall_back(local_error))
+            return FALSE;
+        g_clear_error(&local_error);
+    }
 
-            gboolean container_installed = FALSE;
-            for (guint i = 0; i < g_strv_length(splits); i++) {
-                if (g_strcmp0(splits[i], app_container_name) == 0) {
-                    // Container is installed, nothing to do for now
-                    g_debug("Container %s already initialized", app_container_name);
-                    container_installed = TRUE;
-                    break;
-                }
-            }
+    const gchar *ls_argv[] = {program, "container", "ls", "-a", "--format", "{{.Names}}", NULL};
+    if (!gs_vanilla_meta_subprocess_run(ls_argv, self->probe_timeout, container_ls_line_cb, NULL,
+                                        &lookup, &exit_status, cancellable, &local_error)) {
+        g_debug("Failed to list containers: %s", local_error->message);
+        return FALSE;
+    }
+    if (exit_status != EXIT_SUCCESS) {
+        g_debug("Failed to list containers, podman exited with status %d", exit_status);
+        return FALSE;
+    }
 
-            // Initialize container
-            if (!container_installed) {
-                g_debug("Install: Running init for container %s", app_container_name);
+    *out_exists = lookup.found;
+    return TRUE;
+}
 
-                container_flag = apx_container_flag_from_name(app_container_name);
+/*
+ * Runs apx init for container if it doesn't exist yet. A failed init isn't an error,
+ * installing into the container will report it.
+ */
+static gboolean
+ensure_container(GsPluginVanillaMeta *self,
+                 const gchar *container,
+                 GCancellable *cancellable,
+                 GError **error)
+{
+    const gchar *container_flag = apx_container_flag_from_name(container);
+    gboolean container_exists   = FALSE;
+    gint exit_status;
 
-                const gchar *init_cmd = g_strdup_printf("apx %s init", container_flag);
-                gs_vanilla_meta_run_subprocess(init_cmd, G_SUBPROCESS_FLAGS_STDOUT_SILENCE,
-                                               cancellable, error);
-            }
-        }
+    if (!check_container_exists(self, container, cancellable, &container_exists)) {
+        // Let install fail on its own if the container is really missing
+        g_debug("Install: Couldn't check if container %s exists", container);
+        return TRUE;
+    }
+    if (container_exists) {
+        g_debug("Container %s already initialized", container);
+        return TRUE;
     }
-    free(output);
 
-    // Install package and process output
-    if (container_flag == NULL)
-        container_flag = apx_container_flag_from_name(app_container_name);
+    const gchar *init_argv[] = {"apx", container_flag, "init", NULL};
 
-    package_name = gs_app_get_source_default(app);
-    if (package_name == NULL) {
-        g_debug("Install: Package name for %s is null, can't install", gs_app_get_name(app));
-        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
+    g_debug("Install: Running init for container %s", container);
+    if (!gs_vanilla_meta_subprocess_run(init_argv, 0, log_line_cb, log_line_cb, NULL,
+                                        &exit_status, cancellable, error))
         return FALSE;
-    }
 
-    g_debug("Installing app %s, using container flag `%s` and package name `%s`",
-            gs_app_get_name(app), container_flag, package_name);
+    installed_cache_invalidate(self, container);
+    if (exit_status == EXIT_SUCCESS && self->podman != NULL)
+        gs_vanilla_meta_podman_add_container(self->podman, container);
 
-    const gchar *install_cmd =
-        g_strdup_printf("apx %s install -y %s", container_flag, package_name);
-
-    output = gs_vanilla_meta_run_subprocess(install_cmd, G_SUBPROCESS_FLAGS_STDOUT_SILENCE,
-                                            cancellable, error);
-    if (output->input_stream != NULL) {
-        gs_app_set_state(app, GS_APP_STATE_INSTALLED);
-        free(output);
-        return TRUE;
-    } else {
-        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
-        free(output);
-        return FALSE;
-    }
+    return TRUE;
 }
 
-gboolean
-gs_plugin_app_remove(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError **error)
+static InstallBatch *
+install_batch_new(const gchar *container, gint64 deadline)
 {
-    const gchar *package_name       = NULL;
-    const gchar *container_flag     = NULL;
-    const gchar *app_container_name = gs_app_get_metadata_item(app, "Vanilla::container");
+    InstallBatch *batch = g_new0(InstallBatch, 1);
 
-    // Only process this app if was created by this plugin
-    if (!gs_app_has_management_plugin(app, plugin))
-        return TRUE;
+    batch->container   = g_strdup(container);
+    batch->requests    = g_ptr_array_new();
+    batch->deadline    = deadline;
+    batch->cancellable = g_cancellable_new();
 
-    container_flag = apx_container_flag_from_name(app_container_name);
-    package_name   = gs_app_get_source_default(app);
-    if (package_name == NULL) {
-        g_debug("Remove: Package name for %s is null, can't remove", gs_app_get_name(app));
-        gs_app_set_state(app, GS_APP_STATE_UNKNOWN); // We have no idea if remove actually ran
-        return FALSE;
-    }
+    return batch;
+}
 
-    const gchar *remove_cmd = g_strdup_printf("apx %s remove -y %s", container_flag, package_name);
+static void
+install_batch_free(InstallBatch *batch)
+{
+    g_ptr_array_unref(batch->requests);
+    g_object_unref(batch->cancellable);
+    g_free(batch->container);
+    g_free(batch);
+}
 
-    SubprocessOutput *output = gs_vanilla_meta_run_subprocess(
-        remove_cmd, G_SUBPROCESS_FLAGS_STDOUT_SILENCE, cancellable, error);
+/*
+ * Whether every request of a running batch was cancelled, so nobody wants its
+ * packages anymore
+ */
+static gboolean
+install_batch_is_cancelled(InstallBatch *batch)
+{
+    for (guint i = 0; i < batch->requests->len; i++) {
+        InstallRequest *request = g_ptr_array_index(batch->requests, i);
 
-    if (output->input_stream != NULL) {
-        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
-        free(output);
-        return TRUE;
-    } else {
-        gs_app_set_state(app, GS_APP_STATE_UNKNOWN);
-        free(output);
-        return FALSE;
+        if (!g_cancellable_is_cancelled(request->cancellable))
+            return FALSE;
     }
+
+    return TRUE;
 }
 
-void
-gs_plugin_adopt_app(GsPlugin *plugin, GsApp *app)
+/*
+ * Every package in the batch is in the same transaction, so they all get its progress
+ */
+static void
+install_batch_line_cb(const gchar *line, gpointer user_data)
 {
-    if (!g_strcmp0(gs_app_get_origin(app), "vanilla_meta")) {
-        g_debug("I should adopt app %s", gs_app_get_name(app));
-        gs_app_set_management_plugin(app, plugin);
-        gs_app_set_scope(app, AS_COMPONENT_SCOPE_USER);
-        gs_app_add_quirk(app, GS_APP_QUIRK_PROVENANCE);
-        gs_vanilla_meta_app_set_packaging_info(app);
+    GPtrArray *requests = user_data;
 
-        if (gs_plugin_cache_lookup(plugin, gs_app_get_id(app)) == NULL) {
-            gs_plugin_cache_add(plugin, gs_app_get_id(app), app);
-        }
+    g_debug("%s", line);
+    for (guint i = 0; i < requests->len; i++) {
+        InstallRequest *request = g_ptr_array_index(requests, i);
+        gs_vanilla_meta_progress_feed(request->progress, line);
     }
 }
 
-gboolean
-check_app_is_installed(GsApp *app, GCancellable *cancellable, GError *error, gboolean update_status)
-{
-    const gchar *package_name       = NULL;
+/*
+ * Installs the packages of requests with a single apx call, or updates them with the
+ * package manager's own command when update is set
+ */
+static gboolean
+install_packages(const gchar *container,
+                 GPtrArray *requests,
+                 gboolean update,
+                 GCancellable *cancellable,
+                 GError **error)
+{
+    const ApxContainer *info    = apx_container_lookup(container);
+    g_autoptr(GPtrArray) argv   = g_ptr_array_new();
+    g_autoptr(GString) packages = g_string_new(NULL);
+    g_auto(GStrv) upgrade_argv  = NULL;
+    gint exit_status;
+
+    g_ptr_array_add(argv, "apx");
+    g_ptr_array_add(argv, (gpointer)info->flag);
+    if (update) {
+        const gchar *upgrade_cmd =
+            gs_vanilla_meta_upgrade_cmd_for_package_manager(info->package_manager);
+
+        if (upgrade_cmd == NULL) {
+            g_set_error(error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_NOT_SUPPORTED,
+                        "Don't know how to update packages in container %s", container);
+            return FALSE;
+        }
+        upgrade_argv = g_strsplit(upgrade_cmd, " ", -1);
+        g_ptr_array_add(argv, "run");
+        for (guint i = 0; upgrade_argv[i] != NULL; i++)
+            g_ptr_array_add(argv, upgrade_argv[i]);
+    } else {
+        g_ptr_array_add(argv, "install");
+        g_ptr_array_add(argv, "-y");
+    }
+    for (guint i = 0; i < requests->len; i++) {
+        InstallRequest *request = g_ptr_array_index(requests, i);
+
+        g_ptr_array_add(argv, (gpointer)request->package_name);
+        g_string_append_printf(packages, "%s%s", i > 0 ? " " : "", request->package_name);
+    }
+    g_ptr_array_add(argv, NULL);
+
+    g_debug("%s `%s` using container flag `%s`", update ? "Updating" : "Installing",
+            packages->str, info->flag);
+
+    if (!gs_vanilla_meta_subprocess_run((const gchar *const *)argv->pdata, 0,
+                                        install_batch_line_cb, log_line_cb, requests,
+                                        &exit_status, cancellable, error))
+        return FALSE;
+
+    if (exit_status != EXIT_SUCCESS) {
+        g_set_error(error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED,
+                    "Failed to %s %s, apx exited with status %d", update ? "update" : "install",
+                    packages->str, exit_status);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Installs or updates every package in requests with a single transaction, recording
+ * the outcome in each request. If the transaction fails, packages are retried one at
+ * a time so a single bad package doesn't fail the others.
+ */
+static void
+run_install_requests(GsPluginVanillaMeta *self,
+                     const gchar *container,
+                     GPtrArray *requests,
+                     gboolean update,
+                     GCancellable *cancellable)
+{
+    g_autoptr(GError) local_error = NULL;
+
+    if (requests->len == 0)
+        return;
+
+    if (install_packages(container, requests, update, cancellable, &local_error)) {
+        for (guint i = 0; i < requests->len; i++) {
+            InstallRequest *request = g_ptr_array_index(requests, i);
+            installed_cache_update(self, container, request->package_name, TRUE);
+            gs_vanilla_meta_manifest_set(self->manifest, container, request->package_name, TRUE);
+        }
+        return;
+    }
+
+    installed_cache_invalidate(self, container);
+
+    if (requests->len == 1 || g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+        g_error_matches(local_error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_NOT_SUPPORTED)) {
+        for (guint i = 0; i < requests->len; i++) {
+            InstallRequest *request = g_ptr_array_index(requests, i);
+            request->error          = g_error_copy(local_error);
+        }
+        return;
+    }
+
+    g_debug("%s %u packages in %s failed, retrying them one at a time: %s",
+            update ? "Updating" : "Installing", requests->len, container, local_error->message);
+
+    for (guint i = 0; i < requests->len; i++) {
+        InstallRequest *request     = g_ptr_array_index(requests, i);
+        g_autoptr(GPtrArray) single = g_ptr_array_new();
+
+        g_ptr_array_add(single, request);
+        if (install_packages(container, single, update, cancellable, &request->error)) {
+            installed_cache_update(self, container, request->package_name, TRUE);
+            gs_vanilla_meta_manifest_set(self->manifest, container, request->package_name, TRUE);
+        }
+    }
+}
+
+/*
+ * Installs every package in batch, then updates the ones it was asked to update, as
+ * an install transaction can't update packages on every package manager
+ */
+static void
+run_install_batch(GsPluginVanillaMeta *self, InstallBatch *batch, GCancellable *cancellable)
+{
+    g_autoptr(GPtrArray) installs = g_ptr_array_new();
+    g_autoptr(GPtrArray) updates  = g_ptr_array_new();
+    g_autoptr(GError) local_error = NULL;
+
+    if (!ensure_container(self, batch->container, cancellable, &local_error)) {
+        for (guint i = 0; i < batch->requests->len; i++) {
+            InstallRequest *request = g_ptr_array_index(batch->requests, i);
+            request->error          = g_error_copy(local_error);
+        }
+        return;
+    }
+
+    for (guint i = 0; i < batch->requests->len; i++) {
+        InstallRequest *request = g_ptr_array_index(batch->requests, i);
+        g_ptr_array_add(request->update ? updates : installs, request);
+    }
+
+    run_install_requests(self, batch->container, installs, FALSE, cancellable);
+    run_install_requests(self, batch->container, updates, TRUE, cancellable);
+}
+
+static void
+install_cancelled_cb(GCancellable *cancellable, gpointer user_data)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(user_data);
+    g_autoptr(GPtrArray) batch_cancellables = g_ptr_array_new_with_free_func(g_object_unref);
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock(&self->install_mutex);
+
+    // Running batches are only stopped once all of their requests are cancelled
+    g_hash_table_iter_init(&iter, self->install_running);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        InstallBatch *batch = value;
+
+        if (batch != NULL && install_batch_is_cancelled(batch))
+            g_ptr_array_add(batch_cancellables, g_object_ref(batch->cancellable));
+    }
+
+    // Wake up the waiting thread so it can leave its batch
+    g_cond_broadcast(&self->install_cond);
+    g_mutex_unlock(&self->install_mutex);
+
+    for (guint i = 0; i < batch_cancellables->len; i++)
+        g_cancellable_cancel(batch_cancellables->pdata[i]);
+}
+
+/*
+ * Installs or updates request in container. Requests for the same container arriving
+ * within the batch window are run as a single transaction, by whichever of their
+ * threads wakes up first once the window is over and no other batch is being
+ * installed into the container. The others wait for it to finish.
+ *
+ * A request can be cancelled until its batch starts. After that, the batch goes on
+ * for the requests which weren't cancelled, and is only cancelled when all are.
+ */
+static gboolean
+install_package(GsPluginVanillaMeta *self,
+                const gchar *container,
+                InstallRequest *request,
+                GCancellable *cancellable,
+                GError **error)
+{
+    InstallBatch *batch = NULL;
+    gboolean running    = FALSE;
+    gboolean cancelled  = FALSE;
+    gulong cancelled_id = 0;
+
+    request->cancellable = cancellable;
+    if (cancellable != NULL)
+        cancelled_id =
+            g_cancellable_connect(cancellable, G_CALLBACK(install_cancelled_cb), self, NULL);
+
+    g_mutex_lock(&self->install_mutex);
+
+    batch = g_hash_table_lookup(self->install_batches, container);
+    if (batch == NULL) {
+        batch = install_batch_new(container, g_get_monotonic_time() + self->install_batch_window);
+        g_hash_table_insert(self->install_batches, batch->container, batch);
+    }
+    g_ptr_array_add(batch->requests, request);
+
+    // batch can't be freed while our request is queued in it
+    while (request->state == INSTALL_REQUEST_QUEUED) {
+        gboolean busy = g_hash_table_contains(self->install_running, container);
+
+        if (g_cancellable_is_cancelled(cancellable)) {
+            g_ptr_array_remove(batch->requests, request);
+            if (batch->requests->len == 0) {
+                g_hash_table_remove(self->install_batches, container);
+                install_batch_free(batch);
+            }
+            cancelled = TRUE;
+            break;
+        }
+
+        if (!busy && g_get_monotonic_time() >= batch->deadline) {
+            g_hash_table_remove(self->install_batches, container);
+            g_hash_table_insert(self->install_running, g_strdup(container), batch);
+
+            // Requests cancelled before their threads noticed are left out
+            for (guint i = 0; i < batch->requests->len;) {
+                InstallRequest *queued = g_ptr_array_index(batch->requests, i);
+
+                if (queued != request &&
+                    g_cancellable_set_error_if_cancelled(queued->cancellable, &queued->error)) {
+                    queued->state = INSTALL_REQUEST_DONE;
+                    g_ptr_array_remove_index(batch->requests, i);
+                    continue;
+                }
+                queued->state = INSTALL_REQUEST_RUNNING;
+                i++;
+            }
+            running = TRUE;
+            break;
+        }
+
+        if (busy)
+            g_cond_wait(&self->install_cond, &self->install_mutex);
+        else
+            g_cond_wait_until(&self->install_cond, &self->install_mutex, batch->deadline);
+    }
+
+    if (running) {
+        g_mutex_unlock(&self->install_mutex);
+        g_debug("Installing batch of %u packages into %s", batch->requests->len, container);
+        run_install_batch(self, batch, batch->cancellable);
+        g_mutex_lock(&self->install_mutex);
+
+        g_hash_table_remove(self->install_running, container);
+        for (guint i = 0; i < batch->requests->len; i++) {
+            InstallRequest *done = g_ptr_array_index(batch->requests, i);
+            done->state          = INSTALL_REQUEST_DONE;
+        }
+        install_batch_free(batch);
+        g_cond_broadcast(&self->install_cond);
+    } else {
+        while (!cancelled && request->state != INSTALL_REQUEST_DONE)
+            g_cond_wait(&self->install_cond, &self->install_mutex);
+    }
+
+    g_mutex_unlock(&self->install_mutex);
+    g_cancellable_disconnect(cancellable, cancelled_id);
+
+    if (cancelled)
+        return !g_cancellable_set_error_if_cancelled(cancellable, error);
+    if (request->error != NULL) {
+        g_propagate_error(error, g_steal_pointer(&request->error));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Keeps installs and pre-warming from running in container at the same time. Returns
+ * FALSE if something else already holds it.
+ */
+static gboolean
+claim_container(GsPluginVanillaMeta *self, const gchar *container)
+{
+    gboolean claimed;
+
+    g_mutex_lock(&self->install_mutex);
+    claimed = !g_hash_table_contains(self->install_running, container);
+    if (claimed)
+        g_hash_table_insert(self->install_running, g_strdup(container), NULL);
+    g_mutex_unlock(&self->install_mutex);
+
+    return claimed;
+}
+
+static void
+release_container(GsPluginVanillaMeta *self, const gchar *container)
+{
+    // Batches waiting for the container can run now
+    g_mutex_lock(&self->install_mutex);
+    g_hash_table_remove(self->install_running, container);
+    g_cond_broadcast(&self->install_cond);
+    g_mutex_unlock(&self->install_mutex);
+}
+
+typedef struct {
+    GPtrArray *containers; /* (element-type utf8) (owned): used by the catalog */
+    guint next;            /* index of the next container to pre-warm */
+    const gchar *current;  /* (nullable): container being pre-warmed, claimed from installs */
+    gboolean initializing; /* current is being initialized, not started */
+    GHashTable *existing;  /* (owned) (nullable): listed by podman, if the registry can't tell */
+    gboolean listed;       /* podman was asked for existing, whether it answered or not */
+} PrewarmData;
+
+static void
+prewarm_data_free(PrewarmData *data)
+{
+    g_ptr_array_unref(data->containers);
+    g_clear_pointer(&data->existing, g_hash_table_unref);
+    g_free(data);
+}
+
+static void prewarm_next(GTask *task);
+
+static void
+prewarm_list_line_cb(const gchar *line, gpointer user_data)
+{
+    PrewarmData *data = user_data;
+
+    if (*line != '\0')
+        g_hash_table_add(data->existing, g_strdup(line));
+}
+
+static void
+prewarm_list_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    g_autoptr(GTask) task         = G_TASK(user_data);
+    PrewarmData *data             = g_task_get_task_data(task);
+    g_autoptr(GError) local_error = NULL;
+    gint exit_status;
+
+    if (!gs_vanilla_meta_subprocess_run_finish(result, &exit_status, &local_error)) {
+        if (g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_task_return_error(task, g_steal_pointer(&local_error));
+            return;
+        }
+        g_debug("Pre-warm: Failed to list containers: %s", local_error->message);
+        g_clear_pointer(&data->existing, g_hash_table_unref);
+    } else if (exit_status != EXIT_SUCCESS) {
+        g_debug("Pre-warm: Failed to list containers, podman exited with status %d",
+                exit_status);
+        g_clear_pointer(&data->existing, g_hash_table_unref);
+    }
+
+    prewarm_next(task);
+}
+
+/*
+ * Lists the existing containers for the pre-warm, for when the registry isn't
+ * following podman's events yet
+ */
+static void
+prewarm_list_containers(GTask *task)
+{
+    GsPluginVanillaMeta *self = g_task_get_source_object(task);
+    PrewarmData *data         = g_task_get_task_data(task);
+    const gchar *program      = gs_vanilla_meta_podman_get_program();
+
+    const gchar *ls_argv[] = {program, "container", "ls", "-a", "--format", "{{.Names}}", NULL};
+    data->listed   = TRUE;
+    data->existing = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gs_vanilla_meta_subprocess_run_async(ls_argv, self->probe_timeout, prewarm_list_line_cb,
+                                         NULL, data, g_task_get_cancellable(task),
+                                         prewarm_list_cb, g_object_ref(task));
+}
+
+/*
+ * Checks if container exists without blocking, returning FALSE if that isn't known
+ */
+static gboolean
+prewarm_lookup_container(GsPluginVanillaMeta *self,
+                         PrewarmData *data,
+                         const gchar *container,
+                         gboolean *out_exists)
+{
+    if (self->podman != NULL &&
+        gs_vanilla_meta_podman_lookup_container(self->podman, container, out_exists))
+        return TRUE;
+
+    if (data->existing != NULL) {
+        *out_exists = g_hash_table_contains(data->existing, container);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+prewarm_run_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    g_autoptr(GTask) task         = G_TASK(user_data);
+    GsPluginVanillaMeta *self     = g_task_get_source_object(task);
+    PrewarmData *data             = g_task_get_task_data(task);
+    g_autoptr(GError) local_error = NULL;
+    gint exit_status;
+
+    if (!gs_vanilla_meta_subprocess_run_finish(result, &exit_status, &local_error)) {
+        release_container(self, data->current);
+        if (g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_task_return_error(task, g_steal_pointer(&local_error));
+            return;
+        }
+        g_debug("Pre-warm: Failed to run for %s: %s", data->current, local_error->message);
+    } else if (exit_status != EXIT_SUCCESS) {
+        release_container(self, data->current);
+        g_debug("Pre-warm: Failed to %s %s, exit status %d",
+                data->initializing ? "initialize" : "start", data->current, exit_status);
+    } else {
+        if (data->initializing) {
+            installed_cache_invalidate(self, data->current);
+            if (self->podman != NULL)
+                gs_vanilla_meta_podman_add_container(self->podman, data->current);
+        }
+        release_container(self, data->current);
+    }
+
+    data->current = NULL;
+    prewarm_next(task);
+}
+
+/*
+ * Starts or initializes the next container which needs it. The commands run
+ * asynchronously, so the worker stays free for other jobs meanwhile, and whether
+ * containers exist comes from the registry, or a single podman listing when it
+ * can't tell yet.
+ */
+static void
+prewarm_next(GTask *task)
+{
+    GsPluginVanillaMeta *self = g_task_get_source_object(task);
+    PrewarmData *data         = g_task_get_task_data(task);
+    GCancellable *cancellable = g_task_get_cancellable(task);
+
+    while (data->next < data->containers->len) {
+        const gchar *container    = data->containers->pdata[data->next++];
+        gboolean container_exists = FALSE;
+
+        if (g_task_return_error_if_cancelled(task))
+            return;
+
+        if (!prewarm_lookup_container(self, data, container, &container_exists)) {
+            if (data->listed)
+                continue;
+            data->next--;
+            prewarm_list_containers(task);
+            return;
+        }
+        if (!container_exists && self->prewarm_policy < PREWARM_INIT)
+            continue;
+
+        // Leave containers being installed into alone, their install initializes them
+        if (!claim_container(self, container))
+            continue;
+
+        data->current      = container;
+        data->initializing = !container_exists;
+
+        if (container_exists) {
+            const gchar *start_argv[] = {gs_vanilla_meta_podman_get_program(), "start", container,
+                                         NULL};
+
+            g_debug("Pre-warm: Starting container %s", container);
+            gs_vanilla_meta_subprocess_run_async(start_argv, self->probe_timeout, log_line_cb,
+                                                 log_line_cb, NULL, cancellable, prewarm_run_cb,
+                                                 g_object_ref(task));
+        } else {
+            const gchar *init_argv[] = {"apx", apx_container_flag_from_name(container), "init",
+                                        NULL};
+
+            g_debug("Pre-warm: Initializing container %s", container);
+            gs_vanilla_meta_subprocess_run_async(init_argv, 0, log_line_cb, log_line_cb, NULL,
+                                                 cancellable, prewarm_run_cb, g_object_ref(task));
+        }
+        return;
+    }
+
+    g_debug("Pre-warm: Done");
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+prewarm_thread_cb(GTask *task,
+                  gpointer source_object,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    PrewarmData *data                       = task_data;
+    g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+    g_autoptr(GHashTable) containers        = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTableIter iter;
+    gpointer component;
+
+    assert_in_worker(self);
+
+    if (catalog == NULL) {
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    // Every container some component of the catalog is installed into
+    g_hash_table_iter_init(&iter, catalog->component_index);
+    while (g_hash_table_iter_next(&iter, NULL, &component)) {
+        const gchar *container = component_get_container_name(component);
+
+        if (container != NULL && g_hash_table_add(containers, (gpointer)container))
+            g_ptr_array_add(data->containers, g_strdup(container));
+    }
+
+    g_debug("Pre-warm: Catalog uses %u containers", data->containers->len);
+    prewarm_next(task);
+}
+
+/*
+ * Queues pre-warming the containers of the current catalog on the low priority lane
+ * of the worker, so it only runs when there's nothing else to do. A pre-warm still
+ * running for the previous catalog is cancelled.
+ */
+static void
+queue_prewarm(GsPluginVanillaMeta *self)
+{
+    g_autoptr(GTask) task = NULL;
+    PrewarmData *data     = NULL;
+
+    assert_in_worker(self);
+
+    if (self->prewarm_policy == PREWARM_NONE)
+        return;
+
+    g_cancellable_cancel(self->prewarm_cancellable);
+    g_clear_object(&self->prewarm_cancellable);
+    self->prewarm_cancellable = g_cancellable_new();
+
+    data             = g_new0(PrewarmData, 1);
+    data->containers = g_ptr_array_new_with_free_func(g_free);
+
+    task = g_task_new(self, self->prewarm_cancellable, NULL, NULL);
+    g_task_set_source_tag(task, queue_prewarm);
+    g_task_set_task_data(task, data, (GDestroyNotify)prewarm_data_free);
+
+    gs_worker_thread_queue(self->worker, G_PRIORITY_LOW, prewarm_thread_cb,
+                           g_steal_pointer(&task));
+}
+
+gboolean
+gs_plugin_app_install(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError **error)
+{
+    GsPluginVanillaMeta *self                 = GS_PLUGIN_VANILLA_META(plugin);
+    const gchar *package_name                 = NULL;
+    const gchar *app_container_name           = gs_app_get_metadata_item(app, "Vanilla::container");
+    g_autoptr(GsVanillaMetaProgress) progress = NULL;
+    InstallRequest request                    = {0};
+
+    // Only process this app if was created by this plugin
+    if (!gs_app_has_management_plugin(app, plugin))
+        return TRUE;
+
+    if (app_container_name == NULL) {
+        g_debug("Install: Container name not set for %s, cannot install", gs_app_get_name(app));
+        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
+        return FALSE;
+    }
+
+    package_name = gs_app_get_source_default(app);
+    if (package_name == NULL) {
+        g_debug("Install: Package name for %s is null, can't install", gs_app_get_name(app));
+        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
+        return FALSE;
+    }
+
+    gs_app_set_state(app, GS_APP_STATE_INSTALLING);
+
+    // Progress is unknown while waiting for the batch and initializing the container
+    progress = gs_vanilla_meta_progress_new(
+        app, apx_container_package_manager_from_name(app_container_name), FALSE);
+
+    g_debug("Installing app %s from container %s", gs_app_get_name(app), app_container_name);
+
+    request.package_name = package_name;
+    request.progress     = progress;
+    if (!install_package(self, app_container_name, &request, cancellable, error)) {
+        gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
+        return FALSE;
+    }
+
+    gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+    return TRUE;
+}
+
+/*
+ * Updates an app found updatable by gs_plugin_add_updates(), batched with the other
+ * installs and updates into its container
+ */
+gboolean
+gs_plugin_update_app(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError **error)
+{
+    GsPluginVanillaMeta *self                 = GS_PLUGIN_VANILLA_META(plugin);
+    const gchar *package_name                 = gs_app_get_source_default(app);
+    const gchar *app_container_name           = gs_app_get_metadata_item(app, "Vanilla::container");
+    g_autoptr(GsVanillaMetaProgress) progress = NULL;
+    InstallRequest request                    = {0};
+
+    // Only process this app if was created by this plugin
+    if (!gs_app_has_management_plugin(app, plugin))
+        return TRUE;
+
+    if (gs_app_get_state(app) != GS_APP_STATE_UPDATABLE_LIVE)
+        return TRUE;
+
+    if (package_name == NULL) {
+        g_set_error(error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED,
+                    "Package name for %s is null, can't update", gs_app_get_name(app));
+        return FALSE;
+    }
+
+    gs_app_set_state(app, GS_APP_STATE_INSTALLING);
+    progress = gs_vanilla_meta_progress_new(
+        app, apx_container_package_manager_from_name(app_container_name), FALSE);
+
+    g_debug("Updating app %s in container %s", gs_app_get_name(app), app_container_name);
+
+    request.package_name = package_name;
+    request.progress     = progress;
+    request.update       = TRUE;
+    if (!install_package(self, app_container_name != NULL ? app_container_name : "apx_managed",
+                         &request, cancellable, error)) {
+        gs_app_set_state_recover(app);
+        return FALSE;
+    }
+
+    gs_app_set_update_version(app, NULL);
+    gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+    return TRUE;
+}
+
+gboolean
+gs_plugin_app_remove(GsPlugin *plugin, GsApp *app, GCancellable *cancellable, GError **error)
+{
+    GsPluginVanillaMeta *self                 = GS_PLUGIN_VANILLA_META(plugin);
+    const gchar *package_name                 = NULL;
+    const gchar *container_flag               = NULL;
+    const gchar *app_container_name           = gs_app_get_metadata_item(app, "Vanilla::container");
+    g_autoptr(GsVanillaMetaProgress) progress = NULL;
+    gint exit_status;
+
+    // Only process this app if was created by this plugin
+    if (!gs_app_has_management_plugin(app, plugin))
+        return TRUE;
+
+    container_flag = apx_container_flag_from_name(app_container_name);
+    package_name   = gs_app_get_source_default(app);
+    if (package_name == NULL) {
+        g_debug("Remove: Package name for %s is null, can't remove", gs_app_get_name(app));
+        gs_app_set_state(app, GS_APP_STATE_UNKNOWN); // We have no idea if remove actually ran
+        return FALSE;
+    }
+
+    gs_app_set_state(app, GS_APP_STATE_REMOVING);
+    progress = gs_vanilla_meta_progress_new(
+        app, apx_container_package_manager_from_name(app_container_name), TRUE);
+
+    const gchar *remove_argv[] = {"apx", container_flag, "remove", "-y", package_name, NULL};
+    if (!gs_vanilla_meta_subprocess_run(remove_argv, 0, gs_vanilla_meta_progress_line_cb,
+                                        log_line_cb, progress, &exit_status, cancellable, error)) {
+        gs_app_set_state(app, GS_APP_STATE_UNKNOWN);
+        installed_cache_invalidate(self, app_container_name);
+        gs_vanilla_meta_manifest_forget(self->manifest, app_container_name, package_name);
+        return FALSE;
+    }
+
+    if (exit_status != EXIT_SUCCESS) {
+        g_set_error(error, GS_PLUGIN_ERROR, GS_PLUGIN_ERROR_FAILED,
+                    "Failed to remove %s, apx exited with status %d", package_name, exit_status);
+        gs_app_set_state(app, GS_APP_STATE_UNKNOWN);
+        installed_cache_invalidate(self, app_container_name);
+        gs_vanilla_meta_manifest_forget(self->manifest, app_container_name, package_name);
+        return FALSE;
+    }
+
+    gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
+    installed_cache_update(self, app_container_name, package_name, FALSE);
+    gs_vanilla_meta_manifest_set(self->manifest, app_container_name, package_name, FALSE);
+    return TRUE;
+}
+
+void
+gs_plugin_adopt_app(GsPlugin *plugin, GsApp *app)
+{
+    if (!g_strcmp0(gs_app_get_origin(app), "vanilla_meta")) {
+        g_debug("I should adopt app %s", gs_app_get_name(app));
+        gs_app_set_management_plugin(app, plugin);
+        gs_app_set_scope(app, AS_COMPONENT_SCOPE_USER);
+        gs_app_add_quirk(app, GS_APP_QUIRK_PROVENANCE);
+        gs_vanilla_meta_app_set_packaging_info(app);
+
+        g_autoptr(GsApp) cached_app = gs_plugin_cache_lookup(plugin, gs_app_get_id(app));
+
+        gs_vanilla_meta_metrics_count(cached_app != NULL ? "plugin-cache-hit"
+                                                         : "plugin-cache-miss");
+        if (cached_app == NULL) {
+            gs_plugin_cache_add(plugin, gs_app_get_id(app), app);
+        }
+    }
+}
+
+/*
+ * Returns the set of packages installed in container, listing it with a single apx
+ * call if the cached listing is missing or older than the TTL. Returns NULL if the
+ * container couldn't be listed, so callers can fall back to querying packages
+ * individually.
+ */
+static GHashTable *
+lookup_installed_packages(GsPluginVanillaMeta *self,
+                          const gchar *container,
+                          GCancellable *cancellable)
+{
+    InstalledCacheEntry *entry    = NULL;
+    GHashTable *packages          = NULL;
+    gint64 now                    = g_get_monotonic_time();
+    g_autoptr(GError) local_error = NULL;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->installed_mutex);
+
+    // Parallel refines share a single listing per container
+    while ((entry = g_hash_table_lookup(self->installed_cache, container)) != NULL &&
+           entry->probing)
+        g_cond_wait(&self->installed_cond, &self->installed_mutex);
+
+    if (entry != NULL && now - entry->timestamp < self->installed_cache_ttl) {
+        packages = entry->packages != NULL ? g_hash_table_ref(entry->packages) : NULL;
+        g_mutex_unlock(&self->installed_mutex);
+        return packages;
+    }
+
+    if (entry == NULL) {
+        entry = g_new0(InstalledCacheEntry, 1);
+        g_hash_table_insert(self->installed_cache, g_strdup(container), entry);
+    }
+    entry->probing = TRUE;
+    g_mutex_unlock(&self->installed_mutex);
+
+    packages = gs_vanilla_meta_list_installed_packages(container, self->probe_timeout, cancellable,
+                                                       &local_error);
+    if (packages == NULL)
+        g_debug("Failed to list packages in %s: %s", container, local_error->message);
+
+    // Probing entries are never removed, so entry is still ours. Also remember failures,
+    // so we don't retry the same container until the TTL expires, unless we were cancelled.
+    g_mutex_lock(&self->installed_mutex);
+    g_clear_pointer(&entry->packages, g_hash_table_unref);
+    entry->packages = packages != NULL ? g_hash_table_ref(packages) : NULL;
+    if (entry->invalidated ||
+        g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        entry->timestamp = 0;
+    else
+        entry->timestamp = g_get_monotonic_time();
+    entry->probing     = FALSE;
+    entry->invalidated = FALSE;
+    g_cond_broadcast(&self->installed_cond);
+    g_mutex_unlock(&self->installed_mutex);
+
+    return packages;
+}
+
+/*
+ * Records the outcome of an install or remove in the cached listing of container.
+ * If the listing doesn't exist, there's nothing to update, it will be fetched on
+ * next use.
+ *
+ * Listings are handed out to readers which don't hold installed_mutex, so they're
+ * never modified: the change goes into a copy which replaces the listing.
+ */
+static void
+installed_cache_update(GsPluginVanillaMeta *self,
+                       const gchar *container,
+                       const gchar *package_name,
+                       gboolean installed)
+{
+    InstalledCacheEntry *entry     = NULL;
+    g_autoptr(GHashTable) packages = NULL;
+    GHashTableIter iter;
+    gpointer key;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->installed_mutex);
+    entry = g_hash_table_lookup(self->installed_cache, container);
+    if (entry != NULL && entry->probing) {
+        // The listing in flight may predate this change
+        entry->invalidated = TRUE;
+    } else if (entry != NULL && entry->packages != NULL &&
+               g_hash_table_contains(entry->packages, package_name) != installed) {
+        packages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_iter_init(&iter, entry->packages);
+        while (g_hash_table_iter_next(&iter, &key, NULL))
+            g_hash_table_add(packages, g_strdup(key));
+
+        if (installed)
+            g_hash_table_add(packages, g_strdup(package_name));
+        else
+            g_hash_table_remove(packages, package_name);
+
+        g_hash_table_unref(entry->packages);
+        entry->packages = g_steal_pointer(&packages);
+    }
+    g_mutex_unlock(&self->installed_mutex);
+}
+
+/*
+ * Drops the cached listing of container, for when we can't tell what an operation
+ * did to it.
+ */
+static void
+installed_cache_invalidate(GsPluginVanillaMeta *self, const gchar *container)
+{
+    InstalledCacheEntry *entry = NULL;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->installed_mutex);
+    entry = g_hash_table_lookup(self->installed_cache, container);
+    if (entry != NULL && entry->probing)
+        entry->invalidated = TRUE;
+    else
+        g_hash_table_remove(self->installed_cache, container);
+    g_mutex_unlock(&self->installed_mutex);
+}
+
+/*
+ * Returns the cached listing of container if it's still within the TTL, without
+ * ever listing it
+ */
+static GHashTable *
+peek_installed_packages(GsPluginVanillaMeta *self, const gchar *container)
+{
+    InstalledCacheEntry *entry = NULL;
+    GHashTable *packages       = NULL;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->installed_mutex);
+    entry = g_hash_table_lookup(self->installed_cache, container);
+    if (entry != NULL && !entry->probing && entry->packages != NULL &&
+        g_get_monotonic_time() - entry->timestamp < self->installed_cache_ttl)
+        packages = g_hash_table_ref(entry->packages);
+    g_mutex_unlock(&self->installed_mutex);
+
+    return packages;
+}
+
+/*
+ * Sets whether app is installed, keeping the update found for it while it still is
+ */
+static void
+app_set_installed(GsApp *app, gboolean installed)
+{
+    GsAppState state = gs_app_get_state(app);
+
+    if (installed && state == GS_APP_STATE_UPDATABLE_LIVE)
+        return;
+
+    // Updatable apps can't become available directly
+    if (!installed && state == GS_APP_STATE_UPDATABLE_LIVE)
+        gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+    gs_app_set_state(app, installed ? GS_APP_STATE_INSTALLED : GS_APP_STATE_AVAILABLE);
+}
+
+/*
+ * Lists container and brings the manifest and the state of the cached apps in line
+ * with what's actually installed in it
+ */
+static void
+reconcile_container(GsPluginVanillaMeta *self,
+                    GsVanillaMetaCatalog *catalog,
+                    const gchar *container,
+                    GCancellable *cancellable)
+{
+    g_autoptr(GHashTable) installed    = NULL;
+    g_autoptr(GPtrArray) package_names = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer key, value;
+
+    installed = lookup_installed_packages(self, container, cancellable);
+    if (installed == NULL) {
+        // Keep trusting the manifest until the container can be listed
+        g_debug("Reconcile: Failed to list %s", container);
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, catalog->component_index);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const gchar *component_container = component_get_container_name(value);
+        const gchar *package_name        = xb_node_query_text(value, "pkgname", NULL);
+        g_autoptr(GsApp) app             = NULL;
+        gboolean is_installed;
+
+        if (g_strcmp0(component_container != NULL ? component_container : "apx_managed",
+                      container) != 0 ||
+            package_name == NULL)
+            continue;
+
+        g_ptr_array_add(package_names, (gpointer)package_name);
+
+        // Leave apps being installed or removed to the operation
+        is_installed = g_hash_table_contains(installed, package_name);
+        app          = gs_plugin_cache_lookup(GS_PLUGIN(self), key);
+        if (app == NULL)
+            continue;
+        if (is_installed && (gs_app_get_state(app) == GS_APP_STATE_AVAILABLE ||
+                             gs_app_get_state(app) == GS_APP_STATE_UNKNOWN))
+            gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+        else if (!is_installed && (gs_app_get_state(app) == GS_APP_STATE_INSTALLED ||
+                                   gs_app_get_state(app) == GS_APP_STATE_UPDATABLE_LIVE))
+            app_set_installed(app, FALSE);
+    }
+
+    gs_vanilla_meta_manifest_reconcile(self->manifest, container, package_names, installed);
+}
+
+static void
+reconcile_thread_cb(GTask *task,
+                    gpointer source_object,
+                    gpointer task_data,
+                    GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+    g_autoptr(GHashTable) containers        = NULL;
+    GHashTableIter iter;
+    gpointer container;
+
+    assert_in_worker(self);
+
+    g_mutex_lock(&self->installed_mutex);
+    containers              = g_steal_pointer(&self->reconcile_pending);
+    self->reconcile_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->reconcile_queued  = FALSE;
+    g_mutex_unlock(&self->installed_mutex);
+
+    if (catalog == NULL) {
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    g_hash_table_iter_init(&iter, containers);
+    while (g_hash_table_iter_next(&iter, &container, NULL)) {
+        if (g_cancellable_is_cancelled(cancellable))
+            break;
+        reconcile_container(self, catalog, container, cancellable);
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * Queues checking the manifest against container on the low priority lane of the
+ * worker. Can be called from any thread, containers queued before it runs are
+ * checked together.
+ */
+static void
+queue_reconcile(GsPluginVanillaMeta *self, const gchar *container)
+{
+    g_autoptr(GTask) task = NULL;
+    gboolean queue        = FALSE;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->installed_mutex);
+    if (!g_hash_table_contains(self->reconcile_pending, container))
+        g_hash_table_add(self->reconcile_pending, g_strdup(container));
+    queue                  = !self->reconcile_queued;
+    self->reconcile_queued = TRUE;
+    g_mutex_unlock(&self->installed_mutex);
+
+    if (!queue)
+        return;
+
+    // Like catalog reloads, only cancelled when the plugin goes away
+    task = g_task_new(self, self->catalog_reload_cancellable, NULL, NULL);
+    g_task_set_source_tag(task, queue_reconcile);
+    gs_worker_thread_queue(self->worker, G_PRIORITY_LOW, reconcile_thread_cb,
+                           g_steal_pointer(&task));
+}
+
+/*
+ * Finds the container name defined for a component in the catalog
+ */
+static const gchar *
+component_get_container_name(XbNode *component)
+{
+    XbNode *child               = NULL;
+    const gchar *container_name = NULL;
+    XbNodeChildIter iter;
+
+    // Iterate node's children until we find container name, each child is a new reference
+    xb_node_child_iter_init(&iter, component);
+    while (container_name == NULL && xb_node_child_iter_next(&iter, &child)) {
+        container_name = xb_node_get_attr(child, "container");
+        g_clear_object(&child);
+    }
+
+    return container_name;
+}
+
+gboolean
+check_app_is_installed(GsPluginVanillaMeta *self,
+                       GsApp *app,
+                       GCancellable *cancellable,
+                       GError *error,
+                       gboolean update_status)
+{
+    const gchar *package_name       = NULL;
     const gchar *container_flag     = NULL;
-    const gchar *check_cmd          = NULL;
     const gchar *app_container_name = NULL;
-    SubprocessOutput *output        = NULL;
+    g_autoptr(GHashTable) packages  = NULL;
+    g_autoptr(GError) local_error   = NULL;
     gboolean query_result           = FALSE;
+    gint exit_status;
 
     app_container_name = gs_app_get_metadata_item(app, "Vanilla::container");
-    container_flag     = apx_container_flag_from_name(app_container_name);
     package_name       = gs_app_get_source_default(app);
     if (package_name == NULL) {
         g_debug("Check installed: Package name for %s is null, can't verify", gs_app_get_name(app));
@@ -564,29 +2091,338 @@ check_app_is_installed(GsApp *app, GCancellable *cancellable, GError *error, gbo
         return FALSE;
     }
 
-    check_cmd = g_strdup_printf("apx %s show -i %s", container_flag, package_name);
+    // A fresh listing of the container is the most reliable answer, then the manifest,
+    // which is checked against the container in the background
+    packages = peek_installed_packages(self, app_container_name);
+    if (packages == NULL && gs_vanilla_meta_manifest_lookup(self->manifest, app_container_name,
+                                                            package_name, &query_result)) {
+        g_debug("Package %s is %sinstalled, according to the manifest", gs_app_get_name(app),
+                query_result ? "" : "not ");
+        if (update_status)
+            app_set_installed(app, query_result);
+        queue_reconcile(self, app_container_name);
+        return query_result;
+    }
 
-    output = gs_vanilla_meta_run_subprocess(check_cmd, G_SUBPROCESS_FLAGS_STDOUT_SILENCE,
-                                            cancellable, &error);
+    // Answer from the container listing, and record it in the manifest
+    if (packages == NULL) {
+        packages = lookup_installed_packages(self, app_container_name, cancellable);
+        if (packages != NULL)
+            queue_reconcile(self, app_container_name);
+    }
+    if (packages != NULL) {
+        query_result = g_hash_table_contains(packages, package_name);
+        g_debug("Package %s is %sinstalled", gs_app_get_name(app), query_result ? "" : "not ");
+        if (update_status)
+            app_set_installed(app, query_result);
+        return query_result;
+    }
 
-    if (output != NULL) {
-        if (output->exit_code == EXIT_SUCCESS) {
-            g_debug("Package %s is installed", gs_app_get_name(app));
-            if (update_status)
-                gs_app_set_state(app, GS_APP_STATE_INSTALLED);
-            query_result = TRUE;
-        } else {
-            g_debug("Package %s is not installed", gs_app_get_name(app));
-            if (update_status)
-                gs_app_set_state(app, GS_APP_STATE_AVAILABLE);
-            query_result = FALSE;
-        }
+    // Fall back to asking apx about this package alone
+    container_flag = apx_container_flag_from_name(app_container_name);
+
+    const gchar *show_argv[] = {"apx", container_flag, "show", "-i", package_name, NULL};
+    if (!gs_vanilla_meta_subprocess_run(show_argv, self->probe_timeout, NULL, NULL, NULL,
+                                        &exit_status, cancellable, &local_error)) {
+        g_debug("Failed to check if %s is installed: %s", gs_app_get_name(app),
+                local_error->message);
+        return FALSE;
+    }
+
+    if (exit_status == EXIT_SUCCESS) {
+        g_debug("Package %s is installed", gs_app_get_name(app));
+        if (update_status)
+            app_set_installed(app, TRUE);
+        query_result = TRUE;
+    } else {
+        g_debug("Package %s is not installed", gs_app_get_name(app));
+        if (update_status)
+            app_set_installed(app, FALSE);
+        query_result = FALSE;
     }
 
-    free(output);
     return query_result;
 }
 
+typedef struct {
+    const gchar *container; /* (unowned): key of the catalog's package index */
+    GHashTable *upgradable; /* (owned) (nullable): package -> version, NULL if it wasn't checked */
+} UpdatesJob;
+
+typedef struct {
+    GsPluginVanillaMeta *self;
+    GsVanillaMetaCatalog *catalog;
+    GCancellable *cancellable;
+} UpdatesCheck;
+
+static void
+updates_job_clear(UpdatesJob *job)
+{
+    g_clear_pointer(&job->upgradable, g_hash_table_unref);
+}
+
+/*
+ * Asks one container for its updates, if it exists and has packages of the catalog
+ * installed, otherwise it has none
+ */
+static void
+updates_job_run_cb(gpointer data, gpointer user_data)
+{
+    UpdatesJob *job                 = data;
+    UpdatesCheck *check             = user_data;
+    GsPluginVanillaMeta *self       = check->self;
+    GHashTable *packages            = NULL;
+    g_autoptr(GHashTable) installed = NULL;
+    g_autoptr(GError) local_error   = NULL;
+    gboolean exists                 = FALSE;
+    gboolean any_installed          = FALSE;
+    GHashTableIter iter;
+    gpointer package_name;
+
+    if (g_cancellable_is_cancelled(check->cancellable))
+        return;
+
+    // Checking for updates must never create the container
+    if (!check_container_exists(self, job->container, check->cancellable, &exists))
+        return;
+    if (!exists) {
+        job->upgradable = g_hash_table_new(g_str_hash, g_str_equal);
+        return;
+    }
+
+    installed = lookup_installed_packages(self, job->container, check->cancellable);
+    if (installed == NULL)
+        return;
+
+    packages = g_hash_table_lookup(check->catalog->package_index, job->container);
+    g_hash_table_iter_init(&iter, packages);
+    while (!any_installed && g_hash_table_iter_next(&iter, &package_name, NULL))
+        any_installed = g_hash_table_contains(installed, package_name);
+    if (!any_installed) {
+        job->upgradable = g_hash_table_new(g_str_hash, g_str_equal);
+        return;
+    }
+
+    job->upgradable = gs_vanilla_meta_list_upgradable_packages(
+        job->container, self->probe_timeout, check->cancellable, &local_error);
+    if (job->upgradable == NULL)
+        g_debug("Updates: Failed to check container %s: %s", job->container,
+                local_error->message);
+}
+
+/*
+ * Marks app as updatable to version, unless an operation is running on it
+ */
+static gboolean
+app_set_updatable(GsApp *app, const gchar *version)
+{
+    switch (gs_app_get_state(app)) {
+    case GS_APP_STATE_UNKNOWN:
+    case GS_APP_STATE_AVAILABLE:
+        gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+        break;
+    case GS_APP_STATE_INSTALLED:
+    case GS_APP_STATE_UPDATABLE_LIVE:
+        break;
+    default:
+        return FALSE;
+    }
+
+    gs_app_set_update_version(app, version);
+    gs_app_set_state(app, GS_APP_STATE_UPDATABLE_LIVE);
+    return TRUE;
+}
+
+/*
+ * Checks every container the catalog installs into for updates, a single command
+ * per container and several containers at once, then finds the apps of the updated
+ * packages through the catalog's package index. Software is told to ask again if
+ * they changed.
+ */
+static void
+updates_check_thread_cb(GTask *task,
+                        gpointer source_object,
+                        gpointer task_data,
+                        GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self     = GS_PLUGIN_VANILLA_META(source_object);
+    GsVanillaMetaCatalog *catalog = task_data;
+    g_autoptr(GArray) jobs        = g_array_new(FALSE, TRUE, sizeof(UpdatesJob));
+    g_autoptr(GPtrArray) updates  = g_ptr_array_new_with_free_func(g_object_unref);
+    g_autoptr(GPtrArray) previous = NULL;
+    g_autoptr(GHashTable) checked = g_hash_table_new(g_str_hash, g_str_equal);
+    g_autoptr(GError) local_error = NULL;
+    UpdatesCheck check            = {self, catalog, cancellable};
+    GThreadPool *pool             = NULL;
+    gboolean changed;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_array_set_clear_func(jobs, (GDestroyNotify)updates_job_clear);
+    g_hash_table_iter_init(&iter, catalog->package_index);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        UpdatesJob job = {key, NULL};
+
+        g_array_append_val(jobs, job);
+    }
+
+    if (jobs->len > 1)
+        pool = g_thread_pool_new(updates_job_run_cb, &check, MIN(jobs->len, UPDATES_THREADS_MAX),
+                                 FALSE, &local_error);
+    if (pool == NULL && local_error != NULL)
+        g_debug("Failed to create updates pool, checking containers sequentially: %s",
+                local_error->message);
+
+    for (guint i = 0; i < jobs->len; i++) {
+        if (pool != NULL)
+            g_thread_pool_push(pool, &g_array_index(jobs, UpdatesJob, i), NULL);
+        else
+            updates_job_run_cb(&g_array_index(jobs, UpdatesJob, i), &check);
+    }
+
+    // Waits for every container to be checked
+    if (pool != NULL)
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+    for (guint i = 0; i < jobs->len; i++) {
+        UpdatesJob *job = &g_array_index(jobs, UpdatesJob, i);
+
+        if (job->upgradable == NULL)
+            continue;
+
+        g_hash_table_add(checked, (gpointer)job->container);
+        g_hash_table_iter_init(&iter, job->upgradable);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            const gchar *id =
+                gs_vanilla_meta_catalog_lookup_package(catalog, job->container, key);
+            g_autoptr(GsApp) app = NULL;
+
+            if (id != NULL)
+                app = gs_plugin_cache_lookup(GS_PLUGIN(self), id);
+            if (app != NULL && app_set_updatable(app, value))
+                g_ptr_array_add(updates, g_steal_pointer(&app));
+        }
+    }
+
+    g_mutex_lock(&self->updates_mutex);
+    if (self->updates != NULL)
+        previous = g_ptr_array_ref(self->updates);
+    g_mutex_unlock(&self->updates_mutex);
+
+    // Containers which couldn't be checked keep the updates found before
+    for (guint i = 0; previous != NULL && i < previous->len; i++) {
+        GsApp *app             = previous->pdata[i];
+        const gchar *container = gs_app_get_metadata_item(app, "Vanilla::container");
+
+        if (gs_app_get_state(app) != GS_APP_STATE_UPDATABLE_LIVE ||
+            g_ptr_array_find(updates, app, NULL))
+            continue;
+
+        if (g_hash_table_contains(checked, container != NULL ? container : "apx_managed"))
+            gs_app_set_state(app, GS_APP_STATE_INSTALLED);
+        else
+            g_ptr_array_add(updates, g_object_ref(app));
+    }
+    g_ptr_array_sort(updates, compare_app_ids);
+
+    g_mutex_lock(&self->updates_mutex);
+    changed = !same_apps(self->updates, updates);
+    if (changed) {
+        g_clear_pointer(&self->updates, g_ptr_array_unref);
+        self->updates = g_ptr_array_ref(updates);
+    }
+    // A cancelled check is retried on the next request
+    if (!g_cancellable_is_cancelled(cancellable))
+        self->updates_timestamp = g_get_monotonic_time();
+    self->updates_refreshing = FALSE;
+    g_mutex_unlock(&self->updates_mutex);
+
+    g_debug("Updates: %u apps can be updated%s", updates->len, changed ? ", changed" : "");
+    if (changed)
+        gs_plugin_updates_changed(GS_PLUGIN(self));
+
+    g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * Makes sure every component is in the plugin cache, then checks the containers in
+ * a thread of their own, so the worker is free for interactive requests meanwhile
+ */
+static void
+updates_thread_cb(GTask *task,
+                  gpointer source_object,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+    GsPluginVanillaMeta *self               = GS_PLUGIN_VANILLA_META(source_object);
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    g_autoptr(GTask) check_task             = NULL;
+    g_autoptr(GError) local_error           = NULL;
+
+    assert_in_worker(self);
+
+    if (!refresh_plugin_cache(self, cancellable, &local_error))
+        g_debug("Updates: Plugin cache may be incomplete: %s",
+                local_error != NULL ? local_error->message : "silo is not initialized");
+
+    catalog = acquire_catalog(self);
+    if (catalog == NULL) {
+        g_mutex_lock(&self->updates_mutex);
+        self->updates_refreshing = FALSE;
+        g_mutex_unlock(&self->updates_mutex);
+        g_task_return_boolean(task, TRUE);
+        return;
+    }
+
+    check_task = g_task_new(self, cancellable, NULL, NULL);
+    g_task_set_source_tag(check_task, updates_thread_cb);
+    g_task_set_priority(check_task, G_PRIORITY_LOW);
+    g_task_set_task_data(check_task, g_steal_pointer(&catalog),
+                         (GDestroyNotify)gs_vanilla_meta_catalog_unref);
+    g_task_run_in_thread(check_task, updates_check_thread_cb);
+
+    g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * Returns the updates found the last time right away. Once they're older than the
+ * TTL, the containers are checked again in the background, and Software is notified
+ * if the updates changed.
+ */
+gboolean
+gs_plugin_add_updates(GsPlugin *plugin, GsAppList *list, GCancellable *cancellable, GError **error)
+{
+    GsPluginVanillaMeta *self = GS_PLUGIN_VANILLA_META(plugin);
+    g_autoptr(GTask) task     = NULL;
+    gint64 now                = g_get_monotonic_time();
+    gboolean queue;
+
+    g_mutex_lock(&self->updates_mutex);
+    for (guint i = 0; self->updates != NULL && i < self->updates->len; i++) {
+        GsApp *app = self->updates->pdata[i];
+
+        // Apps removed or updated since aren't updatable anymore
+        if (gs_app_get_state(app) == GS_APP_STATE_UPDATABLE_LIVE)
+            gs_app_list_add(list, app);
+    }
+    queue = !self->updates_refreshing &&
+            (self->updates_timestamp == 0 ||
+             now - self->updates_timestamp >= self->updates_cache_ttl);
+    if (queue)
+        self->updates_refreshing = TRUE;
+    g_mutex_unlock(&self->updates_mutex);
+
+    if (queue) {
+        // Like catalog reloads, only cancelled when the plugin goes away
+        task = g_task_new(plugin, self->catalog_reload_cancellable, NULL, NULL);
+        g_task_set_source_tag(task, gs_plugin_add_updates);
+        gs_worker_thread_queue(self->worker, G_PRIORITY_LOW, updates_thread_cb,
+                               g_steal_pointer(&task));
+    }
+
+    return TRUE;
+}
+
 static void
 gs_plugin_vanilla_meta_list_apps_async(GsPlugin *plugin,
                                        GsAppQuery *query,
@@ -620,6 +2456,7 @@ list_apps_thread_cb(GTask *task,
     GsAppQueryTristate is_installed = GS_APP_QUERY_TRISTATE_UNSET;
     GsCategory *category            = NULL;
     GsApp *alternate_of             = NULL;
+    const gchar *const *keywords    = NULL;
     g_autoptr(GError) local_error   = NULL;
 
     assert_in_worker(self);
@@ -630,6 +2467,7 @@ list_apps_thread_cb(GTask *task,
         category     = gs_app_query_get_category(data->query);
         is_installed = gs_app_query_get_is_installed(data->query);
         alternate_of = gs_app_query_get_alternate_of(data->query);
+        keywords     = gs_app_query_get_keywords(data->query);
     }
 
     /* Currently only support a subset of query properties, and only one set at once. */
@@ -644,22 +2482,28 @@ list_apps_thread_cb(GTask *task,
         GsAppList *installed_apps = gs_app_list_new();
 
         gs_plugin_cache_lookup_by_state(GS_PLUGIN(self), installed_apps, GS_APP_STATE_INSTALLED);
+        gs_plugin_cache_lookup_by_state(GS_PLUGIN(self), installed_apps,
+                                        GS_APP_STATE_UPDATABLE_LIVE);
         gs_app_list_add_list(list, installed_apps);
     }
 
     if (category != NULL) {
-        g_autoptr(GsAppList) list_tmp = gs_app_list_new();
+        g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+        g_autoptr(GPtrArray) ids                = NULL;
 
-        if (!gs_appstream_add_category_apps(GS_PLUGIN(self), self->silo, category, list_tmp,
-                                            cancellable, &local_error)) {
-            g_task_return_error(task, local_error);
+        if (catalog == NULL) {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                                    "Silo is not initialized");
             return;
         }
 
-        for (guint i = 0; i < gs_app_list_length(list_tmp); i++) {
-            GsApp *app        = gs_app_list_index(list_tmp, i);
-            GsApp *cached_app = gs_plugin_cache_lookup(GS_PLUGIN(self), gs_app_get_id(app));
+        // refresh_plugin_cache() above added every component of the catalog
+        ids = gs_vanilla_meta_catalog_get_category_ids(catalog, category);
+        for (guint i = 0; i < ids->len; i++) {
+            g_autoptr(GsApp) cached_app = gs_plugin_cache_lookup(GS_PLUGIN(self), ids->pdata[i]);
 
+            gs_vanilla_meta_metrics_count(cached_app != NULL ? "plugin-cache-hit"
+                                                             : "plugin-cache-miss");
             if (cached_app != NULL) {
                 g_debug("category: Adding app %s", gs_app_get_name(cached_app));
                 gs_app_list_add(list, cached_app);
@@ -667,9 +2511,44 @@ list_apps_thread_cb(GTask *task,
         }
     }
 
+    if (keywords != NULL) {
+        g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+        g_autoptr(GArray) results               = NULL;
+        guint max_results                       = gs_app_query_get_max_results(data->query);
+        gint64 begin_time                       = gs_vanilla_meta_metrics_begin();
+
+        if (catalog == NULL) {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                                    "Silo is not initialized");
+            return;
+        }
+
+        results = gs_vanilla_meta_search_index_query(catalog->search_index, keywords);
+        gs_vanilla_meta_metrics_end(begin_time, "search", keywords[0]);
+
+        // Results are ranked already, the match value lets Software merge them with other
+        // plugins' results
+        for (guint i = 0; i < results->len; i++) {
+            GsVanillaMetaSearchResult *result =
+                &g_array_index(results, GsVanillaMetaSearchResult, i);
+            g_autoptr(GsApp) cached_app = gs_plugin_cache_lookup(GS_PLUGIN(self), result->id);
+
+            gs_vanilla_meta_metrics_count(cached_app != NULL ? "plugin-cache-hit"
+                                                             : "plugin-cache-miss");
+            if (cached_app == NULL)
+                continue;
+
+            gs_app_set_match_value(cached_app, result->score);
+            gs_app_list_add(list, cached_app);
+            if (max_results > 0 && gs_app_list_length(list) >= max_results)
+                break;
+        }
+    }
+
     if (alternate_of != NULL) {
         GsApp *app = gs_plugin_cache_lookup(GS_PLUGIN(self), gs_app_get_id(alternate_of));
 
+        gs_vanilla_meta_metrics_count(app != NULL ? "plugin-cache-hit" : "plugin-cache-miss");
         if (app != NULL)
             gs_app_list_add(list, app);
     }
@@ -710,27 +2589,315 @@ refine_thread_cb(GTask *task, gpointer source_object, gpointer task_data, GCance
 {
     GsPluginVanillaMeta *self     = GS_PLUGIN_VANILLA_META(source_object);
     GsPluginRefineData *data      = task_data;
+    g_autoptr(GPtrArray) apps     = g_ptr_array_new_with_free_func(g_object_unref);
     g_autoptr(GError) local_error = NULL;
 
     assert_in_worker(self);
 
-    refresh_plugin_cache(self, cancellable, &local_error);
+    if (!refresh_plugin_cache(self, cancellable, &local_error))
+        g_clear_error(&local_error);
 
     for (guint i = 0; i < gs_app_list_length(data->list); i++) {
-        GsApp *app               = gs_app_list_index(data->list, i);
-        GsPluginRefineData *data = task_data;
+        GsApp *app = gs_app_list_index(data->list, i);
 
         if (g_strcmp0(gs_app_get_origin(app), "vanilla_meta"))
             continue;
 
-        if (!refine_app(self, app, data->flags, cancellable, &local_error)) {
-            g_task_return_error(task, g_steal_pointer(&local_error));
-        }
+        g_ptr_array_add(apps, g_object_ref(app));
+    }
+
+    if (!refine_apps(self, apps, data->flags, cancellable, &local_error)) {
+        g_task_return_error(task, g_steal_pointer(&local_error));
+        return;
     }
 
     g_task_return_boolean(task, TRUE);
 }
 
+typedef struct {
+    GMutex mutex;
+    GCond cond;
+    guint pending;       /* jobs not finished yet */
+    GHashTable *running; /* container name -> number of jobs running against it */
+    GQueue waiting;      /* jobs held back by the per-container limit */
+    GError *first_error;
+} RefineBatch;
+
+typedef struct {
+    RefineBatch *batch; /* (unowned) */
+    GsApp *app;         /* (owned) */
+    gchar *container;   /* (owned) */
+    GsPluginRefineFlags flags;
+    GCancellable *cancellable; /* (unowned) (nullable) */
+} RefineJob;
+
+static void
+refine_job_free(RefineJob *job)
+{
+    g_object_unref(job->app);
+    g_free(job->container);
+    g_free(job);
+}
+
+/*
+ * Finds the container an app will be probed in, before it's refined
+ */
+static gchar *
+lookup_app_container(GsPluginVanillaMeta *self, GsApp *app)
+{
+    const gchar *container                  = gs_app_get_metadata_item(app, "Vanilla::container");
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    XbNode *component                       = NULL;
+
+    if (container != NULL)
+        return g_strdup(container);
+
+    catalog = acquire_catalog(self);
+    if (catalog != NULL)
+        component = gs_vanilla_meta_catalog_lookup_component(catalog, gs_app_get_id(app));
+    if (component != NULL)
+        container = component_get_container_name(component);
+
+    return g_strdup(container != NULL ? container : "apx_managed");
+}
+
+/*
+ * Queues job on the pool if its container is below the limit, otherwise holds it
+ * back until a job for the same container finishes. Called with batch->mutex held.
+ */
+static void
+refine_batch_schedule(GsPluginVanillaMeta *self, RefineBatch *batch, RefineJob *job)
+{
+    guint running = GPOINTER_TO_UINT(g_hash_table_lookup(batch->running, job->container));
+
+    if (running >= self->refine_jobs_per_container) {
+        g_queue_push_tail(&batch->waiting, job);
+        return;
+    }
+
+    g_hash_table_insert(batch->running, g_strdup(job->container), GUINT_TO_POINTER(running + 1));
+    g_thread_pool_push(self->refine_pool, job, NULL);
+}
+
+static void
+refine_job_run_cb(gpointer data, gpointer user_data)
+{
+    GsPluginVanillaMeta *self     = GS_PLUGIN_VANILLA_META(user_data);
+    RefineJob *job                = data;
+    RefineBatch *batch            = job->batch;
+    g_autoptr(GError) local_error = NULL;
+    gint64 begin_time             = gs_vanilla_meta_metrics_begin();
+    guint running;
+
+    if (!g_cancellable_set_error_if_cancelled(job->cancellable, &local_error) &&
+        !refine_app(self, job->app, job->flags, job->cancellable, &local_error))
+        g_debug("Could not refine app %s", gs_app_get_id(job->app));
+    gs_vanilla_meta_metrics_end(begin_time, "refine-app", gs_app_get_id(job->app));
+
+    g_mutex_lock(&batch->mutex);
+    if (local_error != NULL && batch->first_error == NULL)
+        batch->first_error = g_steal_pointer(&local_error);
+
+    // Free up the container slot, and hand it to the next job waiting on it
+    running = GPOINTER_TO_UINT(g_hash_table_lookup(batch->running, job->container)) - 1;
+    if (running == 0)
+        g_hash_table_remove(batch->running, job->container);
+    else
+        g_hash_table_insert(batch->running, g_strdup(job->container), GUINT_TO_POINTER(running));
+
+    for (GList *l = batch->waiting.head; l != NULL; l = l->next) {
+        RefineJob *next = l->data;
+
+        if (g_strcmp0(next->container, job->container) == 0) {
+            g_queue_delete_link(&batch->waiting, l);
+            refine_batch_schedule(self, batch, next);
+            break;
+        }
+    }
+
+    refine_job_free(job);
+
+    batch->pending--;
+    if (batch->pending == 0)
+        g_cond_signal(&batch->cond);
+    g_mutex_unlock(&batch->mutex);
+}
+
+/*
+ * Gets the version of the latest release of a component, if the catalog has one
+ */
+static const gchar *
+component_get_catalog_version(XbNode *component)
+{
+    return xb_node_query_attr(component, "releases/release", "version", NULL);
+}
+
+/*
+ * Queries the sizes of the apps which aren't cached yet, with one call per container,
+ * so refining them afterwards only has to read the cache.
+ */
+static void
+query_missing_sizes(GsPluginVanillaMeta *self, GPtrArray *apps, GCancellable *cancellable)
+{
+    g_autoptr(GsVanillaMetaCatalog) catalog = acquire_catalog(self);
+    g_autoptr(GHashTable) missing           = NULL;
+    GHashTableIter iter;
+    gpointer container, packages;
+
+    if (catalog == NULL)
+        return;
+
+    // container name -> (package name -> catalog version)
+    missing = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                    (GDestroyNotify)g_hash_table_unref);
+
+    for (guint i = 0; i < apps->len; i++) {
+        GsApp *app                     = apps->pdata[i];
+        XbNode *component              = NULL;
+        const gchar *container_name    = NULL;
+        const gchar *package_name      = NULL;
+        const gchar *catalog_version   = NULL;
+        GHashTable *container_packages = NULL;
+        guint64 download, installed;
+
+        component = gs_vanilla_meta_catalog_lookup_component(catalog, gs_app_get_id(app));
+        if (component == NULL)
+            continue;
+
+        container_name  = component_get_container_name(component);
+        package_name    = xb_node_query_text(component, "pkgname", NULL);
+        catalog_version = component_get_catalog_version(component);
+        if (container_name == NULL)
+            container_name = "apx_managed";
+        if (package_name == NULL ||
+            gs_vanilla_meta_size_cache_lookup(self->sizes, container_name, package_name,
+                                              catalog_version, &download, &installed))
+            continue;
+
+        container_packages = g_hash_table_lookup(missing, container_name);
+        if (container_packages == NULL) {
+            container_packages = g_hash_table_new(g_str_hash, g_str_equal);
+            g_hash_table_insert(missing, (gpointer)container_name, container_packages);
+        }
+        g_hash_table_insert(container_packages, (gpointer)package_name,
+                            (gpointer)(catalog_version != NULL ? catalog_version : ""));
+    }
+
+    g_hash_table_iter_init(&iter, missing);
+    while (g_hash_table_iter_next(&iter, &container, &packages)) {
+        g_autoptr(GError) local_error = NULL;
+
+        if (!gs_vanilla_meta_size_cache_query(self->sizes, container, packages,
+                                              self->probe_timeout, cancellable, &local_error))
+            g_debug("Failed to query sizes in %s: %s", (const gchar *)container,
+                    local_error->message);
+    }
+}
+
+/*
+ * Sets the sizes of app from the cache, filled in by query_missing_sizes()
+ */
+static void
+refine_app_size(GsPluginVanillaMeta *self, GsApp *app, XbNode *component, const gchar *container)
+{
+    const gchar *package_name = xb_node_query_text(component, "pkgname", NULL);
+    guint64 download          = 0;
+    guint64 installed         = 0;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    if (package_name == NULL ||
+        !gs_vanilla_meta_size_cache_lookup(self->sizes, container, package_name,
+                                           component_get_catalog_version(component), &download,
+                                           &installed)) {
+        g_debug("No sizes known for %s", gs_app_get_id(app));
+    }
+
+    // Don't leave the UI waiting for sizes which won't come
+    gs_app_set_size_download(app, download > 0 ? GS_SIZE_TYPE_VALID : GS_SIZE_TYPE_UNKNOWABLE,
+                             download);
+    gs_app_set_size_installed(app, installed > 0 ? GS_SIZE_TYPE_VALID : GS_SIZE_TYPE_UNKNOWABLE,
+                              installed);
+}
+
+/*
+ * Refines apps on the refine pool, at most refine_jobs_per_container at once for each
+ * container, and waits for all of them. Falls back to refining one by one on the
+ * calling thread if there's no pool.
+ */
+static gboolean
+refine_apps(GsPluginVanillaMeta *self,
+            GPtrArray *apps,
+            GsPluginRefineFlags flags,
+            GCancellable *cancellable,
+            GError **error)
+{
+    RefineBatch batch = {
+        0,
+    };
+    gint64 begin_time                 = gs_vanilla_meta_metrics_begin();
+    g_autofree gchar *metrics_message = NULL;
+
+    if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)
+        query_missing_sizes(self, apps, cancellable);
+
+    if (self->refine_pool == NULL || apps->len <= 1) {
+        for (guint i = 0; i < apps->len; i++) {
+            g_autoptr(GError) local_error = NULL;
+            gint64 app_begin_time         = gs_vanilla_meta_metrics_begin();
+            gboolean ret;
+
+            ret = refine_app(self, apps->pdata[i], flags, cancellable, &local_error);
+            gs_vanilla_meta_metrics_end(app_begin_time, "refine-app",
+                                        gs_app_get_id(apps->pdata[i]));
+            if (!ret && local_error != NULL) {
+                g_propagate_error(error, g_steal_pointer(&local_error));
+                return FALSE;
+            }
+        }
+        metrics_message = g_strdup_printf("%u apps", apps->len);
+        gs_vanilla_meta_metrics_end(begin_time, "refine", metrics_message);
+        return TRUE;
+    }
+
+    g_mutex_init(&batch.mutex);
+    g_cond_init(&batch.cond);
+    g_queue_init(&batch.waiting);
+    batch.running = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    batch.pending = apps->len;
+
+    g_mutex_lock(&batch.mutex);
+    for (guint i = 0; i < apps->len; i++) {
+        RefineJob *job   = g_new0(RefineJob, 1);
+        job->batch       = &batch;
+        job->app         = g_object_ref(apps->pdata[i]);
+        job->container   = lookup_app_container(self, job->app);
+        job->flags       = flags;
+        job->cancellable = cancellable;
+
+        refine_batch_schedule(self, &batch, job);
+    }
+
+    while (batch.pending > 0)
+        g_cond_wait(&batch.cond, &batch.mutex);
+    g_mutex_unlock(&batch.mutex);
+
+    g_hash_table_unref(batch.running);
+    g_cond_clear(&batch.cond);
+    g_mutex_clear(&batch.mutex);
+
+    metrics_message = g_strdup_printf("%u apps", apps->len);
+    gs_vanilla_meta_metrics_end(begin_time, "refine", metrics_message);
+
+    if (batch.first_error != NULL) {
+        g_propagate_error(error, batch.first_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static gboolean
 refine_app(GsPluginVanillaMeta *self,
            GsApp *app,
@@ -738,13 +2905,10 @@ refine_app(GsPluginVanillaMeta *self,
            GCancellable *cancellable,
            GError **error)
 {
-    g_autofree gchar *id_safe     = NULL;
-    g_autofree gchar *xpath       = NULL;
-    g_autoptr(XbNode) component   = NULL;
-    const gchar *container_name   = NULL;
-    g_autoptr(XbNode) child       = NULL;
-    g_autoptr(GError) local_error = NULL;
-    XbNodeChildIter iter;
+    g_autoptr(GsVanillaMetaCatalog) catalog = NULL;
+    XbNode *component                       = NULL;
+    const gchar *container_name             = NULL;
+    g_autoptr(GError) local_error           = NULL;
 
     if (!gs_app_has_management_plugin(app, NULL))
         gs_app_set_management_plugin(app, GS_PLUGIN(self));
@@ -754,26 +2918,10 @@ refine_app(GsPluginVanillaMeta *self,
         return FALSE;
     }
 
-    /* find using source and origin */
-    id_safe = xb_string_escape(gs_app_get_id(app));
-    xpath   = g_strdup_printf("components[@origin='vanilla_meta']/component/"
-                                "id[text()='%s']/..",
-                              id_safe);
-
-    g_mutex_lock(&self->silo_mutex);
-    component = xb_silo_query_first(self->silo, xpath, &local_error);
-    if (local_error != NULL) {
-        g_debug("Failed to refine app %s in query stage", gs_app_get_name(app));
-        return FALSE;
-    }
-
-    // TODO: Find a way to query file sizes
-    /* if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE) { */
-    /*     gs_app_set_size_download(app, GS_SIZE_TYPE_VALID, 0); */
-    /*     gs_app_set_size_cache_data(app, GS_SIZE_TYPE_VALID, 0); */
-    /*     gs_app_set_size_user_data(app, GS_SIZE_TYPE_VALID, 0); */
-    /*     gs_app_set_size_installed(app, GS_SIZE_TYPE_VALID, 0); */
-    /* } */
+    // The component belongs to this catalog, keep it alive even if it gets reloaded
+    catalog = acquire_catalog(self);
+    if (catalog != NULL)
+        component = gs_vanilla_meta_catalog_lookup_component(catalog, gs_app_get_id(app));
 
     gs_app_add_quirk(app, GS_APP_QUIRK_PROVENANCE);
 
@@ -782,31 +2930,26 @@ refine_app(GsPluginVanillaMeta *self,
     gs_app_set_origin_hostname(app, "https://vanillaos.org");
 
     if (component == NULL) {
-        g_debug("no match for %s: %s", xpath, local_error->message);
-        g_clear_error(&local_error);
+        g_debug("no match for %s", gs_app_get_id(app));
         return FALSE;
     }
 
-    gs_appstream_refine_app(GS_PLUGIN(self), app, self->silo, component, flags, &local_error);
+    gs_appstream_refine_app(GS_PLUGIN(self), app, catalog->silo, component, flags, &local_error);
     if (local_error != NULL) {
         g_debug("Failed to refine app %s", gs_app_get_name(app));
         return FALSE;
     }
-    g_mutex_unlock(&self->silo_mutex);
-
-    check_app_is_installed(app, cancellable, local_error, TRUE);
-
-    // Iterate node's children until we find container name
-    xb_node_child_iter_init(&iter, component);
-    while (xb_node_child_iter_next(&iter, &child)) {
-        container_name = xb_node_get_attr(child, "container");
-        if (container_name != NULL)
-            break;
-    }
 
+    container_name = component_get_container_name(component);
     gs_app_set_metadata(app, "Vanilla::container", container_name);
     g_debug("Adding container %s to app %s", container_name, gs_app_get_name(app));
 
+    // Needs the container set above
+    check_app_is_installed(self, app, cancellable, local_error, TRUE);
+
+    if (flags & GS_PLUGIN_REFINE_FLAGS_REQUIRE_SIZE)
+        refine_app_size(self, app, component, container_name);
+
     gs_app_set_metadata(app, "GnomeSoftware::PackagingFormat",
                         apx_container_name_to_alias(container_name));
 
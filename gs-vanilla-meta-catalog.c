@@ -0,0 +1,649 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <errno.h>
+#include <glib/gstdio.h>
+
+#include "gs-vanilla-meta-catalog.h"
+#include "gs-vanilla-meta-metrics.h"
+
+// Bump when anything that affects the compiled silo changes outside of its inputs
+#define SILO_CACHE_VERSION "1"
+#define SILO_COMPILE_FLAGS                                                                         \
+    (XB_BUILDER_COMPILE_FLAG_IGNORE_INVALID | XB_BUILDER_COMPILE_FLAG_SINGLE_LANG)
+
+static const gchar *default_catalog_directory = "/usr/share/swcatalog/xml";
+
+/*
+ * Gets the directory catalogs are loaded from, GS_VANILLA_META_CATALOG_DIR overrides it
+ */
+static const gchar *
+get_catalog_directory(void)
+{
+    const gchar *directory = g_getenv("GS_VANILLA_META_CATALOG_DIR");
+
+    return directory != NULL ? directory : default_catalog_directory;
+}
+
+/*
+ * One catalog file. It's mapped to compute the cache key and, if the silo has to be
+ * compiled, decompressed from the mapping.
+ */
+typedef struct {
+    gchar *path;         /* (owned) */
+    GMappedFile *mapped; /* (owned) */
+    GBytes *xml;         /* (owned) (nullable): set once decompressed */
+    GError *error;       /* (owned) (nullable): set if decompressing failed */
+} CatalogSource;
+
+static void
+catalog_source_free(CatalogSource *source)
+{
+    g_free(source->path);
+    g_mapped_file_unref(source->mapped);
+    g_clear_pointer(&source->xml, g_bytes_unref);
+    g_clear_error(&source->error);
+    g_free(source);
+}
+
+/*
+ * Checks if basename names a catalog we ship: vanillaos-*.xml, optionally gzipped
+ */
+static gboolean
+is_catalog_filename(const gchar *basename)
+{
+    return g_pattern_match_simple("vanillaos-*.xml.gz", basename) ||
+           g_pattern_match_simple("vanillaos-*.xml", basename);
+}
+
+static gint
+compare_paths(gconstpointer a, gconstpointer b)
+{
+    return g_strcmp0(*(const gchar **)a, *(const gchar **)b);
+}
+
+/*
+ * Maps every catalog in the catalog directory, sorted by path so the cache key doesn't
+ * depend on directory order.
+ */
+static GPtrArray *
+open_catalog_sources(GError **error)
+{
+    const gchar *catalog_directory = get_catalog_directory();
+    g_autoptr(GPtrArray) sources   = NULL;
+    g_autoptr(GPtrArray) paths     = g_ptr_array_new_with_free_func(g_free);
+    g_autoptr(GDir) dir            = NULL;
+    const gchar *name              = NULL;
+
+    dir = g_dir_open(catalog_directory, 0, error);
+    if (dir == NULL)
+        return NULL;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (is_catalog_filename(name))
+            g_ptr_array_add(paths, g_build_filename(catalog_directory, name, NULL));
+    }
+
+    if (paths->len == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No catalogs found in %s",
+                    catalog_directory);
+        return NULL;
+    }
+    g_ptr_array_sort(paths, compare_paths);
+
+    sources = g_ptr_array_new_with_free_func((GDestroyNotify)catalog_source_free);
+    for (guint i = 0; i < paths->len; i++) {
+        g_autoptr(GMappedFile) mapped = g_mapped_file_new(paths->pdata[i], FALSE, error);
+        CatalogSource *source         = NULL;
+
+        if (mapped == NULL)
+            return NULL;
+
+        source         = g_new0(CatalogSource, 1);
+        source->path   = g_strdup(paths->pdata[i]);
+        source->mapped = g_steal_pointer(&mapped);
+        g_ptr_array_add(sources, source);
+    }
+
+    return g_steal_pointer(&sources);
+}
+
+/*
+ * Fills source->xml with the decompressed catalog, or source->error. Runs on the
+ * decompression pool, one source per call.
+ */
+static void
+decompress_source_cb(CatalogSource *source, GCancellable *cancellable)
+{
+    g_autoptr(GBytes) contents         = g_mapped_file_get_bytes(source->mapped);
+    g_autoptr(GInputStream) base       = NULL;
+    g_autoptr(GConverter) decompressor = NULL;
+    g_autoptr(GInputStream) stream     = NULL;
+    g_autoptr(GOutputStream) output    = NULL;
+
+    if (!g_str_has_suffix(source->path, ".gz")) {
+        source->xml = g_steal_pointer(&contents);
+        return;
+    }
+
+    base         = g_memory_input_stream_new_from_bytes(contents);
+    decompressor = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+    stream       = g_converter_input_stream_new(base, decompressor);
+    output       = g_memory_output_stream_new_resizable();
+
+    if (g_output_stream_splice(output, stream,
+                               G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+                                   G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                               cancellable, &source->error) < 0) {
+        g_prefix_error(&source->error, "Failed to decompress %s: ", source->path);
+        return;
+    }
+
+    source->xml = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(output));
+}
+
+/*
+ * Decompresses all the sources at once, so it takes about as long as the largest
+ * one instead of the sum of all of them.
+ */
+static gboolean
+decompress_sources(GPtrArray *sources, GCancellable *cancellable, GError **error)
+{
+    GThreadPool *pool             = NULL;
+    g_autoptr(GError) local_error = NULL;
+
+    if (sources->len > 1)
+        pool = g_thread_pool_new((GFunc)decompress_source_cb, cancellable,
+                                 MIN(sources->len, g_get_num_processors()), FALSE,
+                                 &local_error);
+    if (pool == NULL && local_error != NULL)
+        g_debug("Failed to create decompression pool, decompressing sequentially: %s",
+                local_error->message);
+
+    for (guint i = 0; i < sources->len; i++) {
+        if (pool != NULL)
+            g_thread_pool_push(pool, sources->pdata[i], NULL);
+        else
+            decompress_source_cb(sources->pdata[i], cancellable);
+    }
+
+    // Waits for every source to be processed
+    if (pool != NULL)
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+    for (guint i = 0; i < sources->len; i++) {
+        CatalogSource *source = sources->pdata[i];
+
+        if (source->error != NULL) {
+            g_propagate_error(error, g_steal_pointer(&source->error));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Adds id to the set of every desktop category the component is in. Only desktop
+ * applications are listed in category pages.
+ */
+static void
+index_component_categories(GHashTable *category_index, XbNode *component, const gchar *id)
+{
+    g_autoptr(GPtrArray) categories = NULL;
+
+    if (g_strcmp0(xb_node_get_attr(component, "type"), "desktop-application") != 0)
+        return;
+
+    categories = xb_node_query(component, "categories/category", 0, NULL);
+    if (categories == NULL)
+        return;
+
+    for (guint i = 0; i < categories->len; i++) {
+        const gchar *category = xb_node_get_text(categories->pdata[i]);
+        GHashTable *ids       = NULL;
+
+        if (category == NULL)
+            continue;
+
+        ids = g_hash_table_lookup(category_index, category);
+        if (ids == NULL) {
+            ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+            g_hash_table_insert(category_index, g_strdup(category), ids);
+        }
+        g_hash_table_add(ids, g_strdup(id));
+    }
+}
+
+/*
+ * Adds the text searches look at: name, summary, keywords and package name
+ */
+static void
+index_component_text(GsVanillaMetaSearchIndex *search_index, XbNode *component, const gchar *id)
+{
+    g_autoptr(GPtrArray) keywords = xb_node_query(component, "keywords/keyword", 0, NULL);
+
+    gs_vanilla_meta_search_index_add(search_index, id, xb_node_query_text(component, "name", NULL),
+                                     AS_SEARCH_TOKEN_MATCH_NAME);
+    gs_vanilla_meta_search_index_add(search_index, id,
+                                     xb_node_query_text(component, "summary", NULL),
+                                     AS_SEARCH_TOKEN_MATCH_SUMMARY);
+    gs_vanilla_meta_search_index_add(search_index, id,
+                                     xb_node_query_text(component, "pkgname", NULL),
+                                     AS_SEARCH_TOKEN_MATCH_PKGNAME);
+
+    for (guint i = 0; keywords != NULL && i < keywords->len; i++)
+        gs_vanilla_meta_search_index_add(search_index, id, xb_node_get_text(keywords->pdata[i]),
+                                         AS_SEARCH_TOKEN_MATCH_KEYWORD);
+}
+
+/*
+ * Adds id under the container and package it's installed from, components without a
+ * container are installed into apx_managed
+ */
+static void
+index_component_package(GHashTable *package_index, XbNode *component, const gchar *id)
+{
+    const gchar *package_name = xb_node_query_text(component, "pkgname", NULL);
+    const gchar *container    = NULL;
+    XbNode *child             = NULL;
+    GHashTable *packages      = NULL;
+    XbNodeChildIter iter;
+
+    if (package_name == NULL)
+        return;
+
+    xb_node_child_iter_init(&iter, component);
+    while (container == NULL && xb_node_child_iter_next(&iter, &child)) {
+        container = xb_node_get_attr(child, "container");
+        g_clear_object(&child);
+    }
+    if (container == NULL)
+        container = "apx_managed";
+
+    packages = g_hash_table_lookup(package_index, container);
+    if (packages == NULL) {
+        packages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+        g_hash_table_insert(package_index, g_strdup(container), packages);
+    }
+    g_hash_table_replace(packages, g_strdup(package_name), g_strdup(id));
+}
+
+/*
+ * Maps the id of every component in the silo to its node, so refines don't need to
+ * compile and run an XPath query per app, every desktop category to the ids of its
+ * components, so category pages don't either, the tokens of their text to them for
+ * searches, and the packages they're installed from to them for update checks.
+ */
+static gboolean
+build_indexes(GsVanillaMetaCatalog *catalog, GError **error)
+{
+    g_autoptr(GHashTable) index                      = NULL;
+    g_autoptr(GHashTable) category_index             = NULL;
+    g_autoptr(GHashTable) package_index              = NULL;
+    g_autoptr(GsVanillaMetaSearchIndex) search_index = gs_vanilla_meta_search_index_new();
+    g_autoptr(GPtrArray) components                  = NULL;
+    g_autoptr(GError) local_error                    = NULL;
+    gint64 begin_time                                = gs_vanilla_meta_metrics_begin();
+
+    index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    category_index =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+    package_index =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+
+    components = xb_silo_query(catalog->silo, "components[@origin='vanilla_meta']/component", 0,
+                               &local_error);
+    gs_vanilla_meta_metrics_end(begin_time, "xpath-query", "indexes");
+    if (components == NULL) {
+        // An empty catalog isn't an error
+        if (!g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return FALSE;
+        }
+    }
+
+    for (guint i = 0; components != NULL && i < components->len; i++) {
+        XbNode *component = components->pdata[i];
+        const gchar *id   = xb_node_query_text(component, "id", NULL);
+
+        if (id == NULL)
+            continue;
+
+        g_hash_table_replace(index, g_strdup(id), g_object_ref(component));
+        index_component_categories(category_index, component, id);
+        index_component_text(search_index, component, id);
+        index_component_package(package_index, component, id);
+    }
+    gs_vanilla_meta_search_index_finish(search_index);
+
+    g_debug("Indexed %u components in %u categories", g_hash_table_size(index),
+            g_hash_table_size(category_index));
+
+    catalog->component_index = g_steal_pointer(&index);
+    catalog->category_index  = g_steal_pointer(&category_index);
+    catalog->package_index   = g_steal_pointer(&package_index);
+    catalog->search_index    = g_steal_pointer(&search_index);
+    return TRUE;
+}
+
+static void
+gs_vanilla_meta_catalog_clear(GsVanillaMetaCatalog *catalog)
+{
+    g_clear_pointer(&catalog->search_index, gs_vanilla_meta_search_index_free);
+    g_clear_pointer(&catalog->package_index, g_hash_table_unref);
+    g_clear_pointer(&catalog->category_index, g_hash_table_unref);
+    g_clear_pointer(&catalog->component_index, g_hash_table_unref);
+    g_clear_object(&catalog->silo);
+}
+
+/*
+ * Hashes everything the compiled silo depends on: the catalog files and their
+ * contents, the locales and the compile flags. Two loads with the same key produce
+ * the same silo.
+ */
+static gchar *
+compute_silo_cache_key(GPtrArray *sources, const gchar *const *locales)
+{
+    g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_autofree gchar *flags       = g_strdup_printf("%u", (guint)SILO_COMPILE_FLAGS);
+
+    g_checksum_update(checksum, (const guchar *)SILO_CACHE_VERSION, -1);
+    g_checksum_update(checksum, (const guchar *)flags, -1);
+    for (guint i = 0; locales[i] != NULL; i++) {
+        // Separate entries so ["ab", "c"] and ["a", "bc"] hash differently
+        g_checksum_update(checksum, (const guchar *)"\n", 1);
+        g_checksum_update(checksum, (const guchar *)locales[i], -1);
+    }
+    for (guint i = 0; i < sources->len; i++) {
+        CatalogSource *source = sources->pdata[i];
+
+        g_checksum_update(checksum, (const guchar *)"\n", 1);
+        g_checksum_update(checksum, (const guchar *)source->path, -1);
+        g_checksum_update(checksum, (const guchar *)"\n", 1);
+        g_checksum_update(checksum, (const guchar *)g_mapped_file_get_contents(source->mapped),
+                          g_mapped_file_get_length(source->mapped));
+    }
+
+    return g_strdup(g_checksum_get_string(checksum));
+}
+
+/*
+ * Removes silos compiled for other keys, they'll never be loaded again
+ */
+static void
+prune_silo_cache(const gchar *cache_dir, const gchar *keep_basename)
+{
+    g_autoptr(GDir) dir = g_dir_open(cache_dir, 0, NULL);
+    const gchar *name   = NULL;
+
+    if (dir == NULL)
+        return;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        g_autofree gchar *path = NULL;
+
+        if (!g_str_has_suffix(name, ".xmlb") || g_strcmp0(name, keep_basename) == 0)
+            continue;
+
+        path = g_build_filename(cache_dir, name, NULL);
+        if (g_unlink(path) != 0)
+            g_debug("Failed to remove stale silo %s", path);
+    }
+}
+
+/*
+ * Compiles the catalog sources into a single silo
+ */
+static XbSilo *
+compile_silo(GPtrArray *sources,
+             const gchar *const *locales,
+             GCancellable *cancellable,
+             GError **error)
+{
+    g_autoptr(XbBuilder) builder = xb_builder_new();
+    g_autoptr(XbSilo) silo       = NULL;
+    gint64 begin_time            = gs_vanilla_meta_metrics_begin();
+
+    // Add current locales
+    for (guint i = 0; locales[i] != NULL; i++)
+        xb_builder_add_locale(builder, locales[i]);
+
+    if (!decompress_sources(sources, cancellable, error))
+        return NULL;
+
+    for (guint i = 0; i < sources->len; i++) {
+        CatalogSource *source              = sources->pdata[i];
+        g_autoptr(XbBuilderSource) bsource = xb_builder_source_new();
+        g_autoptr(XbBuilderNode) info      = NULL;
+
+        if (!xb_builder_source_load_bytes(bsource, source->xml,
+                                          XB_BUILDER_SOURCE_FLAG_LITERAL_TEXT, error)) {
+            g_prefix_error(error, "Failed to load %s: ", source->path);
+            return NULL;
+        }
+
+        info = xb_builder_node_insert(NULL, "info", NULL);
+        xb_builder_node_insert_text(info, "scope",
+                                    as_component_scope_to_string(AS_COMPONENT_SCOPE_USER), NULL);
+        xb_builder_source_set_info(bsource, info);
+
+        // Import source to builder
+        xb_builder_import_source(builder, bsource);
+    }
+
+    silo = xb_builder_compile(builder, SILO_COMPILE_FLAGS, cancellable, error);
+    gs_vanilla_meta_metrics_end(begin_time, "silo-compile", NULL);
+
+    return g_steal_pointer(&silo);
+}
+
+/*
+ * Loads the silo for the current catalogs. Silos are cached under the user cache
+ * directory, named after a key of their inputs, and mapped straight from disk when
+ * the key matches. Otherwise the catalog is compiled and the result cached.
+ */
+static XbSilo *
+load_silo(gboolean *from_cache, GCancellable *cancellable, GError **error)
+{
+    const gchar *const *locales   = g_get_language_names();
+    g_autofree gchar *cache_dir   = g_build_filename(g_get_user_cache_dir(), "vanilla_meta", NULL);
+    g_autofree gchar *key         = NULL;
+    g_autofree gchar *basename    = NULL;
+    g_autoptr(GFile) silo_file    = NULL;
+    g_autoptr(XbSilo) silo        = NULL;
+    g_autoptr(GPtrArray) sources  = NULL;
+    g_autoptr(GError) local_error = NULL;
+
+    *from_cache = FALSE;
+
+    sources = open_catalog_sources(error);
+    if (sources == NULL)
+        return NULL;
+
+    key = compute_silo_cache_key(sources, locales);
+
+    basename  = g_strdup_printf("%s.xmlb", key);
+    silo_file = g_file_new_build_filename(cache_dir, basename, NULL);
+
+    silo = xb_silo_new();
+    if (xb_silo_load_from_file(silo, silo_file, XB_SILO_LOAD_FLAG_NONE, cancellable,
+                               &local_error)) {
+        g_debug("Loaded cached silo %s", basename);
+        *from_cache = TRUE;
+        return g_steal_pointer(&silo);
+    }
+    if (!g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+        g_debug("Failed to load cached silo, recompiling: %s", local_error->message);
+    g_clear_object(&silo);
+
+    g_debug("Compiling app silo from %u catalogs", sources->len);
+    silo = compile_silo(sources, locales, cancellable, error);
+    if (silo == NULL)
+        return NULL;
+
+    // Failing to cache the silo only costs the next startup a recompile
+    g_clear_error(&local_error);
+    if (g_mkdir_with_parents(cache_dir, 0755) != 0 ||
+        !xb_silo_save_to_file(silo, silo_file, cancellable, &local_error))
+        g_debug("Failed to cache silo in %s: %s", cache_dir,
+                local_error != NULL ? local_error->message : g_strerror(errno));
+    else
+        prune_silo_cache(cache_dir, basename);
+
+    return g_steal_pointer(&silo);
+}
+
+/*
+ * Loads the silo for the catalog, reusing the one cached on disk if nothing it
+ * depends on changed, and builds its indexes.
+ */
+GsVanillaMetaCatalog *
+gs_vanilla_meta_catalog_load(GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GsVanillaMetaCatalog) catalog = g_atomic_rc_box_new0(GsVanillaMetaCatalog);
+    gint64 begin_time                       = gs_vanilla_meta_metrics_begin();
+
+    g_debug("Loading app silo");
+
+    catalog->silo = load_silo(&catalog->from_cache, cancellable, error);
+    if (catalog->silo == NULL)
+        return NULL;
+
+    if (!build_indexes(catalog, error))
+        return NULL;
+
+    gs_vanilla_meta_metrics_end(begin_time, "silo-load",
+                                catalog->from_cache ? "cached" : "compiled");
+
+    return g_steal_pointer(&catalog);
+}
+
+GsVanillaMetaCatalog *
+gs_vanilla_meta_catalog_ref(GsVanillaMetaCatalog *catalog)
+{
+    return g_atomic_rc_box_acquire(catalog);
+}
+
+void
+gs_vanilla_meta_catalog_unref(GsVanillaMetaCatalog *catalog)
+{
+    g_atomic_rc_box_release_full(catalog, (GDestroyNotify)gs_vanilla_meta_catalog_clear);
+}
+
+/*
+ * Gets an identifier which changes whenever the catalog contents do
+ */
+const gchar *
+gs_vanilla_meta_catalog_get_guid(GsVanillaMetaCatalog *catalog)
+{
+    return xb_silo_get_guid(catalog->silo);
+}
+
+/*
+ * Finds the node of the component with the given id, or NULL. The node is owned by
+ * the catalog.
+ */
+XbNode *
+gs_vanilla_meta_catalog_lookup_component(GsVanillaMetaCatalog *catalog, const gchar *id)
+{
+    if (id == NULL)
+        return NULL;
+
+    return g_hash_table_lookup(catalog->component_index, id);
+}
+
+/*
+ * Finds the id of the component installed from package_name in container, or NULL.
+ * A NULL container is apx_managed.
+ */
+const gchar *
+gs_vanilla_meta_catalog_lookup_package(GsVanillaMetaCatalog *catalog,
+                                       const gchar *container,
+                                       const gchar *package_name)
+{
+    GHashTable *packages = NULL;
+
+    if (package_name == NULL)
+        return NULL;
+
+    packages = g_hash_table_lookup(catalog->package_index,
+                                   container != NULL ? container : "apx_managed");
+    return packages != NULL ? g_hash_table_lookup(packages, package_name) : NULL;
+}
+
+/*
+ * Gets the ids of the components in category, the way gs_appstream_add_category_apps()
+ * would find them: components in any of its desktop groups, where a group such as
+ * "AudioVideo::Player" needs all of its categories. The ids are owned by the catalog.
+ */
+GPtrArray *
+gs_vanilla_meta_catalog_get_category_ids(GsVanillaMetaCatalog *catalog, GsCategory *category)
+{
+    GPtrArray *desktop_groups  = gs_category_get_desktop_groups(category);
+    g_autoptr(GHashTable) seen = g_hash_table_new(g_str_hash, g_str_equal);
+    g_autoptr(GPtrArray) ids   = g_ptr_array_new();
+
+    for (guint i = 0; i < desktop_groups->len; i++) {
+        g_auto(GStrv) split  = g_strsplit(desktop_groups->pdata[i], "::", -1);
+        GHashTable *smallest = NULL;
+        GHashTableIter iter;
+        gpointer key;
+
+        // Walk the smallest set, checking the id is in the others
+        for (guint j = 0; split[j] != NULL; j++) {
+            GHashTable *set = g_hash_table_lookup(catalog->category_index, split[j]);
+
+            if (set == NULL) {
+                smallest = NULL;
+                break;
+            }
+            if (smallest == NULL || g_hash_table_size(set) < g_hash_table_size(smallest))
+                smallest = set;
+        }
+        if (smallest == NULL)
+            continue;
+
+        g_hash_table_iter_init(&iter, smallest);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            gboolean in_group = TRUE;
+
+            for (guint j = 0; split[j] != NULL && in_group; j++)
+                in_group = g_hash_table_contains(
+                    g_hash_table_lookup(catalog->category_index, split[j]), key);
+
+            if (in_group && g_hash_table_add(seen, key))
+                g_ptr_array_add(ids, key);
+        }
+    }
+
+    return g_steal_pointer(&ids);
+}
+
+/*
+ * Gets the directory the catalog is loaded from, to watch it for changes
+ */
+GFile *
+gs_vanilla_meta_catalog_get_source_directory(void)
+{
+    return g_file_new_for_path(get_catalog_directory());
+}
+
+/*
+ * Checks if file is one of the files the catalog is loaded from
+ */
+gboolean
+gs_vanilla_meta_catalog_is_source_file(GFile *file)
+{
+    g_autofree gchar *path     = g_file_get_path(file);
+    g_autofree gchar *dirname  = NULL;
+    g_autofree gchar *basename = NULL;
+
+    if (path == NULL)
+        return FALSE;
+
+    dirname  = g_path_get_dirname(path);
+    basename = g_path_get_basename(path);
+    return g_strcmp0(dirname, get_catalog_directory()) == 0 && is_catalog_filename(basename);
+}
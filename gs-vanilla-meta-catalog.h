@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <gnome-software.h>
+#include <xmlb.h>
+
+#include "gs-vanilla-meta-search.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Snapshot of the catalog: the compiled silo and the indexes built from it. It's
+ * never modified once loaded, a new snapshot is loaded when the catalog changes on
+ * disk, so readers can keep using the one they hold a reference to.
+ */
+typedef struct {
+    XbSilo *silo;                           /* (owned) */
+    GHashTable *component_index;            /* (owned): component id -> XbNode */
+    GHashTable *category_index;             /* (owned): desktop category -> set of component ids */
+    GHashTable *package_index;              /* (owned): container -> package name -> component id */
+    GsVanillaMetaSearchIndex *search_index; /* (owned) */
+    gboolean from_cache;                    /* the silo was mapped from the cache, not compiled */
+} GsVanillaMetaCatalog;
+
+GsVanillaMetaCatalog *gs_vanilla_meta_catalog_load(GCancellable *cancellable, GError **error);
+GsVanillaMetaCatalog *gs_vanilla_meta_catalog_ref(GsVanillaMetaCatalog *catalog);
+void gs_vanilla_meta_catalog_unref(GsVanillaMetaCatalog *catalog);
+const gchar *gs_vanilla_meta_catalog_get_guid(GsVanillaMetaCatalog *catalog);
+XbNode *gs_vanilla_meta_catalog_lookup_component(GsVanillaMetaCatalog *catalog, const gchar *id);
+const gchar *gs_vanilla_meta_catalog_lookup_package(GsVanillaMetaCatalog *catalog,
+                                                    const gchar *container,
+                                                    const gchar *package_name);
+GPtrArray *gs_vanilla_meta_catalog_get_category_ids(GsVanillaMetaCatalog *catalog,
+                                                    GsCategory *category);
+GFile *gs_vanilla_meta_catalog_get_source_directory(void);
+gboolean gs_vanilla_meta_catalog_is_source_file(GFile *file);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaCatalog, gs_vanilla_meta_catalog_unref)
+
+G_END_DECLS
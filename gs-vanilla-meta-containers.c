@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <string.h>
+
+#include "gs-vanilla-meta-containers.h"
+
+#define DEFAULT_CONTAINER "apx_managed"
+
+static const ApxContainer builtin_containers[] = {
+    {"apx_managed", "--apt", "APT", APX_PACKAGE_MANAGER_APT},
+    {"apx_managed_aur", "--aur", "AUR", APX_PACKAGE_MANAGER_PACMAN},
+    {"apx_managed_dnf", "--dnf", "DNF", APX_PACKAGE_MANAGER_DNF},
+    {"apx_managed_apk", "--apk", "APK", APX_PACKAGE_MANAGER_APK},
+    {"apx_managed_zypper", "--zypper", "ZYPPER", APX_PACKAGE_MANAGER_ZYPPER},
+    {"apx_managed_xbps", "--xbps", "XBPS", APX_PACKAGE_MANAGER_XBPS},
+};
+
+static const gchar *const package_manager_names[] = {
+    [APX_PACKAGE_MANAGER_UNKNOWN] = "unknown",
+    [APX_PACKAGE_MANAGER_APT]     = "apt",
+    [APX_PACKAGE_MANAGER_PACMAN]  = "pacman",
+    [APX_PACKAGE_MANAGER_DNF]     = "dnf",
+    [APX_PACKAGE_MANAGER_APK]     = "apk",
+    [APX_PACKAGE_MANAGER_ZYPPER]  = "zypper",
+    [APX_PACKAGE_MANAGER_XBPS]    = "xbps",
+};
+
+// Containers nobody described, derived from their names on first use
+static GMutex derived_mutex;
+static GHashTable *derived_containers; /* (owned): quark of name -> ApxContainer */
+
+/*
+ * Gets the flag and alias apx uses for a container, from the suffix of apx_managed
+ */
+static void
+derive_flag_and_alias(const gchar *name, const gchar **out_flag, const gchar **out_alias)
+{
+    const gchar *suffix     = name;
+    g_autofree gchar *flag  = NULL;
+    g_autofree gchar *alias = NULL;
+
+    if (g_str_has_prefix(suffix, DEFAULT_CONTAINER))
+        suffix += strlen(DEFAULT_CONTAINER);
+    if (*suffix == '_')
+        suffix++;
+
+    flag       = g_strconcat("--", suffix, NULL);
+    alias      = g_ascii_strup(suffix, -1);
+    *out_flag  = g_intern_string(flag);
+    *out_alias = g_intern_string(alias);
+}
+
+static ApxPackageManager
+parse_package_manager(const gchar *value)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(package_manager_names); i++) {
+        if (g_strcmp0(value, package_manager_names[i]) == 0)
+            return i;
+    }
+
+    return APX_PACKAGE_MANAGER_UNKNOWN;
+}
+
+/*
+ * Adds the containers described in path, replacing the ones with the same name.
+ * Each group is a container name, with the keys Flag and Alias, which default to
+ * what apx derives from the name, and PackageManager, one of package_manager_names.
+ */
+static void
+load_containers_file(GHashTable *containers, const gchar *path)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+    g_auto(GStrv) groups         = NULL;
+    g_autoptr(GError) error      = NULL;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_warning("Failed to load containers from %s: %s", path, error->message);
+        return;
+    }
+
+    groups = g_key_file_get_groups(key_file, NULL);
+    for (guint i = 0; groups[i] != NULL; i++) {
+        ApxContainer *container = g_new0(ApxContainer, 1);
+        g_autofree gchar *flag  = g_key_file_get_string(key_file, groups[i], "Flag", NULL);
+        g_autofree gchar *alias = g_key_file_get_string(key_file, groups[i], "Alias", NULL);
+        g_autofree gchar *package_manager =
+            g_key_file_get_string(key_file, groups[i], "PackageManager", NULL);
+
+        container->name = g_intern_string(groups[i]);
+        derive_flag_and_alias(groups[i], &container->flag, &container->alias);
+        if (flag != NULL)
+            container->flag = g_intern_string(flag);
+        if (alias != NULL)
+            container->alias = g_intern_string(alias);
+        container->package_manager = parse_package_manager(package_manager);
+
+        g_debug("Container %s from %s: %s, %s, %s", container->name, path, container->flag,
+                container->alias, package_manager_names[container->package_manager]);
+        g_hash_table_replace(containers, GUINT_TO_POINTER(g_quark_from_string(groups[i])),
+                             container);
+    }
+}
+
+/*
+ * Builds the registry once: the built-in containers, then the ones described in
+ * vanilla_meta/containers.ini of the system config directories and the user's,
+ * which take precedence in that order. It's keyed by the quark of the name, and
+ * never changes afterwards.
+ */
+static GHashTable *
+get_registry(void)
+{
+    static gsize initialized      = 0;
+    static GHashTable *containers = NULL;
+
+    if (g_once_init_enter(&initialized)) {
+        const gchar *const *system_dirs = g_get_system_config_dirs();
+        g_autofree gchar *user_path     = NULL;
+        guint n_system_dirs             = g_strv_length((gchar **)system_dirs);
+
+        containers = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, NULL);
+        for (guint i = 0; i < G_N_ELEMENTS(builtin_containers); i++)
+            g_hash_table_insert(containers,
+                                GUINT_TO_POINTER(g_quark_from_static_string(
+                                    builtin_containers[i].name)),
+                                (gpointer)&builtin_containers[i]);
+
+        // The first system directory is the most important one
+        for (guint i = n_system_dirs; i > 0; i--) {
+            g_autofree gchar *path =
+                g_build_filename(system_dirs[i - 1], "vanilla_meta", "containers.ini", NULL);
+            load_containers_file(containers, path);
+        }
+        user_path =
+            g_build_filename(g_get_user_config_dir(), "vanilla_meta", "containers.ini", NULL);
+        load_containers_file(containers, user_path);
+
+        g_once_init_leave(&initialized, 1);
+    }
+
+    return containers;
+}
+
+/*
+ * Describes a container not in the registry from its name alone, like apx does, and
+ * keeps the result so it's only done once
+ */
+static const ApxContainer *
+lookup_derived(const gchar *name)
+{
+    GQuark quark            = g_quark_from_string(name);
+    ApxContainer *container = NULL;
+
+    g_mutex_lock(&derived_mutex);
+    if (derived_containers == NULL)
+        derived_containers = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    container = g_hash_table_lookup(derived_containers, GUINT_TO_POINTER(quark));
+    if (container == NULL) {
+        g_debug("Container %s isn't known, deriving its flag from its name", name);
+        container       = g_new0(ApxContainer, 1);
+        container->name = g_quark_to_string(quark);
+        derive_flag_and_alias(name, &container->flag, &container->alias);
+        container->package_manager = APX_PACKAGE_MANAGER_UNKNOWN;
+        g_hash_table_insert(derived_containers, GUINT_TO_POINTER(quark), container);
+    }
+    g_mutex_unlock(&derived_mutex);
+
+    return container;
+}
+
+/*
+ * Gets the descriptor of the container called name, or of the default one if it's
+ * NULL. Never returns NULL, containers nobody described are derived from their name.
+ */
+const ApxContainer *
+apx_container_lookup(const gchar *name)
+{
+    GHashTable *registry      = get_registry();
+    const ApxContainer *found = NULL;
+    GQuark quark;
+
+    if (name == NULL)
+        name = DEFAULT_CONTAINER;
+
+    // A name that was never interned can't be in the registry
+    quark = g_quark_try_string(name);
+    if (quark != 0)
+        found = g_hash_table_lookup(registry, GUINT_TO_POINTER(quark));
+
+    return found != NULL ? found : lookup_derived(name);
+}
+
+/*
+ * Retrieve flag to use in subcommand (e.g. "apx_managed_aur" returns "--aur")
+ */
+const gchar *
+apx_container_flag_from_name(const gchar *container)
+{
+    return apx_container_lookup(container)->flag;
+}
+
+/*
+ * Gets the "pretty" name from container name (e.g. "apx_managed_aur" returns "AUR")
+ */
+const gchar *
+apx_container_name_to_alias(const gchar *container)
+{
+    return apx_container_lookup(container)->alias;
+}
+
+/*
+ * Gets the package manager used inside a container (e.g. "apx_managed_aur" returns pacman)
+ */
+ApxPackageManager
+apx_container_package_manager_from_name(const gchar *container)
+{
+    return apx_container_lookup(container)->package_manager;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    APX_PACKAGE_MANAGER_UNKNOWN,
+    APX_PACKAGE_MANAGER_APT,
+    APX_PACKAGE_MANAGER_PACMAN,
+    APX_PACKAGE_MANAGER_DNF,
+    APX_PACKAGE_MANAGER_APK,
+    APX_PACKAGE_MANAGER_ZYPPER,
+    APX_PACKAGE_MANAGER_XBPS,
+} ApxPackageManager;
+
+/*
+ * An apx container. Descriptors are built once and never change or go away, so
+ * they and their strings can be kept without copying.
+ */
+typedef struct {
+    const gchar *name;                 /* e.g. "apx_managed_aur" */
+    const gchar *flag;                 /* selects the container in apx, e.g. "--aur" */
+    const gchar *alias;                /* shown as the packaging format, e.g. "AUR" */
+    ApxPackageManager package_manager; /* picks the parsers of its output */
+} ApxContainer;
+
+const ApxContainer *apx_container_lookup(const gchar *name);
+const gchar *apx_container_flag_from_name(const gchar *container);
+const gchar *apx_container_name_to_alias(const gchar *container);
+ApxPackageManager apx_container_package_manager_from_name(const gchar *container);
+
+G_END_DECLS
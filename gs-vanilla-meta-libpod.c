@@ -0,0 +1,784 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <gio/gunixsocketaddress.h>
+#include <json-glib/json-glib.h>
+#include <string.h>
+
+#include "gs-vanilla-meta-libpod.h"
+#include "gs-vanilla-meta-metrics.h"
+
+// Idle connections kept open for the next requests
+#define MAX_IDLE_CONNECTIONS 4
+
+// Streams of an exec, as multiplexed by podman
+#define STREAM_STDOUT 1
+#define STREAM_STDERR 2
+
+struct _GsVanillaMetaLibpod {
+    gchar *socket_path; /* (owned) */
+    GMutex mutex;
+    GPtrArray *idle; /* (owned) (element-type LibpodConnection): ready for a request */
+};
+
+typedef struct {
+    GSocketConnection *connection; /* (owned) */
+    GDataInputStream *input;       /* (owned): buffered, so it goes with the connection */
+} LibpodConnection;
+
+typedef struct {
+    guint status;
+    gint64 content_length; /* -1 if not given */
+    gboolean chunked;
+    gboolean close; /* the connection can't be used for another request */
+} ResponseHead;
+
+typedef struct {
+    GsVanillaMetaLineFunc func;
+    gpointer data;
+    GString *pending; /* (owned): output after the last complete line */
+} ExecStream;
+
+static void
+libpod_connection_free(LibpodConnection *connection)
+{
+    g_clear_object(&connection->input);
+    g_clear_object(&connection->connection);
+    g_free(connection);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LibpodConnection, libpod_connection_free)
+
+/*
+ * Gets the podman socket, which can be pointed elsewhere with
+ * GS_VANILLA_META_PODMAN_SOCKET, or disabled by setting it empty. It's also disabled
+ * when GS_VANILLA_META_PODMAN names a fake podman, so the fake isn't bypassed.
+ */
+static gchar *
+get_socket_path(void)
+{
+    const gchar *value = g_getenv("GS_VANILLA_META_PODMAN_SOCKET");
+
+    if (value != NULL)
+        return *value != '\0' ? g_strdup(value) : NULL;
+    if (g_getenv("GS_VANILLA_META_PODMAN") != NULL)
+        return NULL;
+
+    return g_build_filename(g_get_user_runtime_dir(), "podman", "podman.sock", NULL);
+}
+
+/*
+ * Gets the client of the podman socket, or NULL if there is no socket right now, in
+ * which case callers should run podman instead
+ */
+GsVanillaMetaLibpod *
+gs_vanilla_meta_libpod_get_default(void)
+{
+    static gsize initialized           = 0;
+    static GsVanillaMetaLibpod *libpod = NULL;
+
+    if (g_once_init_enter(&initialized)) {
+        g_autofree gchar *socket_path = get_socket_path();
+
+        if (socket_path != NULL) {
+            libpod              = g_new0(GsVanillaMetaLibpod, 1);
+            libpod->socket_path = g_steal_pointer(&socket_path);
+            libpod->idle        = g_ptr_array_new_with_free_func(
+                (GDestroyNotify)libpod_connection_free);
+            g_mutex_init(&libpod->mutex);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+
+    // podman may be socket activated at any time, or stopped
+    if (libpod == NULL || !g_file_test(libpod->socket_path, G_FILE_TEST_EXISTS))
+        return NULL;
+
+    return libpod;
+}
+
+/*
+ * Whether a call that failed with error can be retried by running podman. It can't
+ * when it was cancelled or timed out, as running podman would only make that worse.
+ */
+gboolean
+gs_vanilla_meta_libpod_can_fall_back(const GError *error)
+{
+    return !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+           !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+}
+
+/*
+ * Gets an idle connection, or opens a new one. out_reused tells which, as podman
+ * may have closed an idle connection in the meantime.
+ */
+static LibpodConnection *
+take_connection(GsVanillaMetaLibpod *self,
+                guint timeout_seconds,
+                gboolean *out_reused,
+                GCancellable *cancellable,
+                GError **error)
+{
+    g_autoptr(GSocketClient) client     = NULL;
+    g_autoptr(GSocketAddress) address   = NULL;
+    g_autoptr(GSocketConnection) stream = NULL;
+    LibpodConnection *connection        = NULL;
+
+    g_mutex_lock(&self->mutex);
+    if (self->idle->len > 0)
+        connection = g_ptr_array_steal_index_fast(self->idle, self->idle->len - 1);
+    g_mutex_unlock(&self->mutex);
+
+    *out_reused = connection != NULL;
+    if (connection == NULL) {
+        client  = g_socket_client_new();
+        address = g_unix_socket_address_new(self->socket_path);
+        stream  = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address), cancellable,
+                                          error);
+        if (stream == NULL)
+            return NULL;
+
+        connection             = g_new0(LibpodConnection, 1);
+        connection->connection = g_steal_pointer(&stream);
+        connection->input      = g_data_input_stream_new(
+            g_io_stream_get_input_stream(G_IO_STREAM(connection->connection)));
+        g_data_input_stream_set_newline_type(connection->input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+    }
+
+    // Applies to each read and write, 0 waits forever
+    g_socket_set_timeout(g_socket_connection_get_socket(connection->connection), timeout_seconds);
+
+    return connection;
+}
+
+/*
+ * Keeps connection for the next request if it can be used again
+ */
+static void
+release_connection(GsVanillaMetaLibpod *self, LibpodConnection *connection, gboolean reusable)
+{
+    if (reusable) {
+        g_mutex_lock(&self->mutex);
+        if (self->idle->len < MAX_IDLE_CONNECTIONS) {
+            g_ptr_array_add(self->idle, connection);
+            connection = NULL;
+        }
+        g_mutex_unlock(&self->mutex);
+    }
+
+    if (connection != NULL)
+        libpod_connection_free(connection);
+}
+
+static gboolean
+send_request(LibpodConnection *connection,
+             const gchar *method,
+             const gchar *path,
+             const gchar *body,
+             GCancellable *cancellable,
+             GError **error)
+{
+    GOutputStream *output      = g_io_stream_get_output_stream(G_IO_STREAM(connection->connection));
+    g_autoptr(GString) request = g_string_new(NULL);
+
+    g_string_printf(request, "%s %s HTTP/1.1\r\nHost: d\r\n", method, path);
+    if (body != NULL)
+        g_string_append_printf(request,
+                               "Content-Type: application/json\r\nContent-Length: %zu\r\n",
+                               strlen(body));
+    g_string_append(request, "\r\n");
+    if (body != NULL)
+        g_string_append(request, body);
+
+    return g_output_stream_write_all(output, request->str, request->len, NULL, cancellable,
+                                     error);
+}
+
+/*
+ * Reads a line, failing if the connection was closed before it
+ */
+static gchar *
+read_line(LibpodConnection *connection, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GError) local_error = NULL;
+    gchar *line;
+
+    line = g_data_input_stream_read_line(connection->input, NULL, cancellable, &local_error);
+    if (line == NULL) {
+        if (local_error != NULL)
+            g_propagate_error(error, g_steal_pointer(&local_error));
+        else
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                        "podman closed the connection");
+    }
+
+    return line;
+}
+
+static gboolean
+read_exactly(LibpodConnection *connection,
+             gpointer buffer,
+             gsize size,
+             GCancellable *cancellable,
+             GError **error)
+{
+    gsize bytes_read;
+
+    if (!g_input_stream_read_all(G_INPUT_STREAM(connection->input), buffer, size, &bytes_read,
+                                 cancellable, error))
+        return FALSE;
+
+    if (bytes_read < size) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                    "podman closed the connection");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Reads the status line and the headers of a response
+ */
+static gboolean
+read_response_head(LibpodConnection *connection,
+                   ResponseHead *head,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+    g_autofree gchar *status_line = read_line(connection, cancellable, error);
+    g_auto(GStrv) status_fields   = NULL;
+
+    if (status_line == NULL)
+        return FALSE;
+
+    status_fields = g_strsplit(status_line, " ", 3);
+    if (!g_str_has_prefix(status_fields[0], "HTTP/1.") || status_fields[1] == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Unexpected response `%s`",
+                    status_line);
+        return FALSE;
+    }
+
+    head->status         = (guint)g_ascii_strtoull(status_fields[1], NULL, 10);
+    head->content_length = -1;
+    head->chunked        = FALSE;
+    head->close          = g_str_equal(status_fields[0], "HTTP/1.0");
+
+    while (TRUE) {
+        g_autofree gchar *line = read_line(connection, cancellable, error);
+        gchar *value           = NULL;
+
+        if (line == NULL)
+            return FALSE;
+        if (*line == '\0')
+            return TRUE;
+
+        value = strchr(line, ':');
+        if (value == NULL)
+            continue;
+        *value = '\0';
+        value  = g_strstrip(value + 1);
+
+        if (g_ascii_strcasecmp(line, "Content-Length") == 0)
+            head->content_length = g_ascii_strtoll(value, NULL, 10);
+        else if (g_ascii_strcasecmp(line, "Transfer-Encoding") == 0)
+            head->chunked = g_ascii_strcasecmp(value, "chunked") == 0;
+        else if (g_ascii_strcasecmp(line, "Connection") == 0)
+            head->close = g_ascii_strcasecmp(value, "close") == 0;
+    }
+}
+
+static gboolean
+append_bytes(LibpodConnection *connection,
+             GString *body,
+             gsize size,
+             GCancellable *cancellable,
+             GError **error)
+{
+    gsize offset = body->len;
+
+    g_string_set_size(body, offset + size);
+    return read_exactly(connection, body->str + offset, size, cancellable, error);
+}
+
+/*
+ * Reads the body of a response, sized by Content-Length, chunked, or until podman
+ * closes the connection
+ */
+static gchar *
+read_response_body(LibpodConnection *connection,
+                   ResponseHead *head,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+    g_autoptr(GString) body = g_string_new(NULL);
+
+    if (head->status == 204 || head->status == 304 || head->status < 200)
+        return g_string_free(g_steal_pointer(&body), FALSE);
+
+    if (head->chunked) {
+        while (TRUE) {
+            g_autofree gchar *size_line = read_line(connection, cancellable, error);
+            g_autofree gchar *end_line  = NULL;
+            guint64 size;
+
+            if (size_line == NULL)
+                return NULL;
+
+            size = g_ascii_strtoull(size_line, NULL, 16);
+            if (size == 0)
+                break;
+
+            if (!append_bytes(connection, body, size, cancellable, error))
+                return NULL;
+            end_line = read_line(connection, cancellable, error);
+            if (end_line == NULL)
+                return NULL;
+        }
+
+        // Skip the trailers
+        while (TRUE) {
+            g_autofree gchar *line = read_line(connection, cancellable, error);
+
+            if (line == NULL)
+                return NULL;
+            if (*line == '\0')
+                break;
+        }
+    } else if (head->content_length >= 0) {
+        if (!append_bytes(connection, body, head->content_length, cancellable, error))
+            return NULL;
+    } else {
+        gchar buffer[4096];
+        gssize bytes_read;
+
+        head->close = TRUE;
+        while ((bytes_read = g_input_stream_read(G_INPUT_STREAM(connection->input), buffer,
+                                                 sizeof(buffer), cancellable, error)) > 0)
+            g_string_append_len(body, buffer, bytes_read);
+        if (bytes_read < 0)
+            return NULL;
+    }
+
+    return g_string_free(g_steal_pointer(&body), FALSE);
+}
+
+/*
+ * Sends a request and reads the head of the response, retrying once on a new
+ * connection if the idle one it was sent on turns out to be closed
+ */
+static LibpodConnection *
+start_request(GsVanillaMetaLibpod *self,
+              const gchar *method,
+              const gchar *path,
+              const gchar *body,
+              guint timeout_seconds,
+              ResponseHead *head,
+              GCancellable *cancellable,
+              GError **error)
+{
+    while (TRUE) {
+        g_autoptr(LibpodConnection) connection = NULL;
+        g_autoptr(GError) local_error          = NULL;
+        gboolean reused;
+
+        connection = take_connection(self, timeout_seconds, &reused, cancellable, error);
+        if (connection == NULL)
+            return NULL;
+
+        if (send_request(connection, method, path, body, cancellable, &local_error) &&
+            read_response_head(connection, head, cancellable, &local_error))
+            return g_steal_pointer(&connection);
+
+        if (!reused || g_cancellable_is_cancelled(cancellable)) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return NULL;
+        }
+
+        g_debug("Idle podman connection failed, reconnecting: %s", local_error->message);
+    }
+}
+
+/*
+ * Makes a request against the libpod API, and gets the status and the body of the
+ * response. Errors are only returned when there's no response.
+ */
+static gboolean
+request(GsVanillaMetaLibpod *self,
+        const gchar *method,
+        const gchar *path,
+        const gchar *body,
+        guint timeout_seconds,
+        guint *out_status,
+        gchar **out_response,
+        GCancellable *cancellable,
+        GError **error)
+{
+    g_autofree gchar *response = NULL;
+    LibpodConnection *connection;
+    ResponseHead head;
+
+    connection = start_request(self, method, path, body, timeout_seconds, &head, cancellable,
+                               error);
+    if (connection == NULL)
+        return FALSE;
+
+    response = read_response_body(connection, &head, cancellable, error);
+    if (response == NULL) {
+        libpod_connection_free(connection);
+        return FALSE;
+    }
+    release_connection(self, connection, !head.close);
+
+    *out_status = head.status;
+    if (out_response != NULL)
+        *out_response = g_steal_pointer(&response);
+    return TRUE;
+}
+
+/*
+ * Parses a JSON object in a response
+ */
+static JsonObject *
+parse_object(const gchar *response, GError **error)
+{
+    g_autoptr(JsonParser) parser = json_parser_new();
+    JsonNode *root               = NULL;
+
+    if (!json_parser_load_from_data(parser, response, -1, error))
+        return NULL;
+
+    root = json_parser_get_root(parser);
+    if (root == NULL || !JSON_NODE_HOLDS_OBJECT(root)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Expected a JSON object");
+        return NULL;
+    }
+
+    return json_object_ref(json_node_get_object(root));
+}
+
+/*
+ * Sets error from a response podman answered with an unexpected status, using the
+ * message it gave when there's one
+ */
+static void
+set_error_from_response(GError **error, const gchar *what, guint status, const gchar *response)
+{
+    g_autoptr(JsonObject) object = parse_object(response, NULL);
+    const gchar *message         = NULL;
+
+    if (object != NULL)
+        message = json_object_get_string_member_with_default(object, "message", NULL);
+
+    g_set_error(error, G_IO_ERROR, status == 404 ? G_IO_ERROR_NOT_FOUND : G_IO_ERROR_FAILED,
+                "Failed to %s, podman answered %u: %s", what, status,
+                message != NULL ? message : "no message");
+}
+
+/*
+ * Lists every container, as the JSON array `podman container ls -a --format json` prints
+ */
+gchar *
+gs_vanilla_meta_libpod_list_containers(GsVanillaMetaLibpod *self,
+                                       guint timeout_seconds,
+                                       GCancellable *cancellable,
+                                       GError **error)
+{
+    g_autofree gchar *response = NULL;
+    gint64 metrics_begin       = gs_vanilla_meta_metrics_begin();
+    guint status;
+
+    if (!request(self, "GET", "/libpod/containers/json?all=true", NULL, timeout_seconds, &status,
+                 &response, cancellable, error))
+        return NULL;
+    gs_vanilla_meta_metrics_end(metrics_begin, "libpod:containers list", NULL);
+
+    if (status != 200) {
+        set_error_from_response(error, "list containers", status, response);
+        return NULL;
+    }
+
+    return g_steal_pointer(&response);
+}
+
+/*
+ * Gets what podman knows about a container, as the JSON object `podman container
+ * inspect` prints for it
+ */
+gchar *
+gs_vanilla_meta_libpod_inspect_container(GsVanillaMetaLibpod *self,
+                                         const gchar *name,
+                                         guint timeout_seconds,
+                                         GCancellable *cancellable,
+                                         GError **error)
+{
+    g_autofree gchar *escaped  = g_uri_escape_string(name, NULL, FALSE);
+    g_autofree gchar *path     = g_strdup_printf("/libpod/containers/%s/json", escaped);
+    g_autofree gchar *response = NULL;
+    gint64 metrics_begin       = gs_vanilla_meta_metrics_begin();
+    guint status;
+
+    if (!request(self, "GET", path, NULL, timeout_seconds, &status, &response, cancellable,
+                 error))
+        return NULL;
+    gs_vanilla_meta_metrics_end(metrics_begin, "libpod:container inspect", name);
+
+    if (status != 200) {
+        set_error_from_response(error, "inspect container", status, response);
+        return NULL;
+    }
+
+    return g_steal_pointer(&response);
+}
+
+gboolean
+gs_vanilla_meta_libpod_container_exists(GsVanillaMetaLibpod *self,
+                                        const gchar *name,
+                                        guint timeout_seconds,
+                                        gboolean *out_exists,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+    g_autofree gchar *escaped  = g_uri_escape_string(name, NULL, FALSE);
+    g_autofree gchar *path     = g_strdup_printf("/libpod/containers/%s/exists", escaped);
+    g_autofree gchar *response = NULL;
+    gint64 metrics_begin       = gs_vanilla_meta_metrics_begin();
+    guint status;
+
+    if (!request(self, "GET", path, NULL, timeout_seconds, &status, &response, cancellable,
+                 error))
+        return FALSE;
+    gs_vanilla_meta_metrics_end(metrics_begin, "libpod:container exists", name);
+
+    if (status != 204 && status != 404) {
+        set_error_from_response(error, "check if container exists", status, response);
+        return FALSE;
+    }
+
+    *out_exists = status == 204;
+    return TRUE;
+}
+
+/*
+ * Passes the complete lines of output to the stream's line func, keeping the rest
+ * for later. A flush passes the rest as well.
+ */
+static void
+exec_stream_feed(ExecStream *stream, const gchar *output, gsize size, gboolean flush)
+{
+    gchar *line;
+    gchar *end;
+
+    g_string_append_len(stream->pending, output, size);
+
+    line = stream->pending->str;
+    while ((end = memchr(line, '\n', stream->pending->str + stream->pending->len - line)) !=
+           NULL) {
+        *end = '\0';
+        if (end > line && end[-1] == '\r')
+            end[-1] = '\0';
+        if (stream->func != NULL)
+            stream->func(line, stream->data);
+        line = end + 1;
+    }
+    g_string_erase(stream->pending, 0, line - stream->pending->str);
+
+    if (flush && stream->pending->len > 0) {
+        if (stream->func != NULL)
+            stream->func(stream->pending->str, stream->data);
+        g_string_truncate(stream->pending, 0);
+    }
+}
+
+/*
+ * Creates an exec instance running argv in container, returning its id
+ */
+static gchar *
+exec_create(GsVanillaMetaLibpod *self,
+            const gchar *container,
+            const gchar *const *argv,
+            guint timeout_seconds,
+            GCancellable *cancellable,
+            GError **error)
+{
+    g_autoptr(JsonBuilder) builder     = json_builder_new();
+    g_autoptr(JsonGenerator) generator = json_generator_new();
+    g_autoptr(JsonNode) root           = NULL;
+    g_autoptr(JsonObject) object       = NULL;
+    g_autofree gchar *escaped          = g_uri_escape_string(container, NULL, FALSE);
+    g_autofree gchar *path             = g_strdup_printf("/libpod/containers/%s/exec", escaped);
+    g_autofree gchar *body             = NULL;
+    g_autofree gchar *response         = NULL;
+    guint status;
+
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "AttachStdout");
+    json_builder_add_boolean_value(builder, TRUE);
+    json_builder_set_member_name(builder, "AttachStderr");
+    json_builder_add_boolean_value(builder, TRUE);
+    json_builder_set_member_name(builder, "Cmd");
+    json_builder_begin_array(builder);
+    for (guint i = 0; argv[i] != NULL; i++)
+        json_builder_add_string_value(builder, argv[i]);
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
+
+    root = json_builder_get_root(builder);
+    json_generator_set_root(generator, root);
+    body = json_generator_to_data(generator, NULL);
+
+    if (!request(self, "POST", path, body, timeout_seconds, &status, &response, cancellable,
+                 error))
+        return NULL;
+
+    // A container that isn't running can't exec, apx starts it
+    if (status != 201) {
+        set_error_from_response(error, "create exec", status, response);
+        return NULL;
+    }
+
+    object = parse_object(response, error);
+    if (object == NULL)
+        return NULL;
+    if (json_object_get_string_member_with_default(object, "Id", NULL) == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "podman didn't name the exec");
+        return NULL;
+    }
+
+    return g_strdup(json_object_get_string_member(object, "Id"));
+}
+
+/*
+ * Starts an exec instance and passes its output to the streams until it's done.
+ * podman takes over the connection for the output, so it's never reused.
+ */
+static gboolean
+exec_start(GsVanillaMetaLibpod *self,
+           const gchar *id,
+           guint timeout_seconds,
+           ExecStream *streams,
+           GCancellable *cancellable,
+           GError **error)
+{
+    g_autofree gchar *path                 = g_strdup_printf("/libpod/exec/%s/start", id);
+    g_autoptr(LibpodConnection) connection = NULL;
+    g_autofree gchar *buffer               = NULL;
+    gsize buffer_size                      = 0;
+    ResponseHead head;
+
+    connection = start_request(self, "POST", path, "{\"Detach\":false,\"Tty\":false}",
+                               timeout_seconds, &head, cancellable, error);
+    if (connection == NULL)
+        return FALSE;
+
+    if (head.status != 200) {
+        g_autofree gchar *response = read_response_body(connection, &head, cancellable, NULL);
+
+        set_error_from_response(error, "start exec", head.status, response);
+        return FALSE;
+    }
+
+    // Each frame is the stream, three bytes of padding and the big endian payload size
+    while (TRUE) {
+        guint8 header[8];
+        guint32 size;
+        gsize bytes_read;
+
+        if (!g_input_stream_read_all(G_INPUT_STREAM(connection->input), header, sizeof(header),
+                                     &bytes_read, cancellable, error))
+            return FALSE;
+        if (bytes_read == 0)
+            break;
+        if (bytes_read < sizeof(header)) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated exec output");
+            return FALSE;
+        }
+
+        memcpy(&size, header + 4, sizeof(size));
+        size = GUINT32_FROM_BE(size);
+        if (size > buffer_size) {
+            buffer_size = size;
+            buffer      = g_realloc(buffer, buffer_size);
+        }
+        if (!read_exactly(connection, buffer, size, cancellable, error))
+            return FALSE;
+
+        if (header[0] == STREAM_STDOUT)
+            exec_stream_feed(&streams[0], buffer, size, FALSE);
+        else if (header[0] == STREAM_STDERR)
+            exec_stream_feed(&streams[1], buffer, size, FALSE);
+    }
+
+    exec_stream_feed(&streams[0], NULL, 0, TRUE);
+    exec_stream_feed(&streams[1], NULL, 0, TRUE);
+    return TRUE;
+}
+
+static gboolean
+exec_inspect(GsVanillaMetaLibpod *self,
+             const gchar *id,
+             guint timeout_seconds,
+             gint *out_exit_status,
+             GCancellable *cancellable,
+             GError **error)
+{
+    g_autofree gchar *path       = g_strdup_printf("/libpod/exec/%s/json", id);
+    g_autofree gchar *response   = NULL;
+    g_autoptr(JsonObject) object = NULL;
+    guint status;
+
+    if (!request(self, "GET", path, NULL, timeout_seconds, &status, &response, cancellable,
+                 error))
+        return FALSE;
+
+    if (status != 200) {
+        set_error_from_response(error, "inspect exec", status, response);
+        return FALSE;
+    }
+
+    object = parse_object(response, error);
+    if (object == NULL)
+        return FALSE;
+
+    *out_exit_status = (gint)json_object_get_int_member_with_default(object, "ExitCode", -1);
+    return TRUE;
+}
+
+/*
+ * Runs argv in a running container, passing each line it prints to the line funcs.
+ * Like gs_vanilla_meta_subprocess_run(), a command that ran and failed isn't an
+ * error, check out_exit_status for that. timeout_seconds limits how long the command
+ * may stay silent.
+ */
+gboolean
+gs_vanilla_meta_libpod_exec(GsVanillaMetaLibpod *self,
+                            const gchar *container,
+                            const gchar *const *argv,
+                            guint timeout_seconds,
+                            GsVanillaMetaLineFunc stdout_func,
+                            GsVanillaMetaLineFunc stderr_func,
+                            gpointer line_data,
+                            gint *out_exit_status,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+    g_autofree gchar *id = NULL;
+    gint64 metrics_begin = gs_vanilla_meta_metrics_begin();
+    ExecStream streams[] = {
+        {stdout_func, line_data, g_string_new(NULL)},
+        {stderr_func, line_data, g_string_new(NULL)},
+    };
+    gboolean success;
+
+    id      = exec_create(self, container, argv, timeout_seconds, cancellable, error);
+    success = id != NULL &&
+              exec_start(self, id, timeout_seconds, streams, cancellable, error) &&
+              exec_inspect(self, id, timeout_seconds, out_exit_status, cancellable, error);
+
+    g_string_free(streams[0].pending, TRUE);
+    g_string_free(streams[1].pending, TRUE);
+    gs_vanilla_meta_metrics_end(metrics_begin, "libpod:exec", container);
+
+    return success;
+}
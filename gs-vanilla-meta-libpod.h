@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "gs-vanilla-meta-subprocess.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Client of the podman REST API on the user's podman socket. Connections are kept
+ * open between requests, so asking podman doesn't cost a podman process each time.
+ * Every call blocks, and can be made from any thread.
+ */
+typedef struct _GsVanillaMetaLibpod GsVanillaMetaLibpod;
+
+GsVanillaMetaLibpod *gs_vanilla_meta_libpod_get_default(void);
+gboolean gs_vanilla_meta_libpod_can_fall_back(const GError *error);
+gchar *gs_vanilla_meta_libpod_list_containers(GsVanillaMetaLibpod *libpod,
+                                              guint timeout_seconds,
+                                              GCancellable *cancellable,
+                                              GError **error);
+gchar *gs_vanilla_meta_libpod_inspect_container(GsVanillaMetaLibpod *libpod,
+                                                const gchar *name,
+                                                guint timeout_seconds,
+                                                GCancellable *cancellable,
+                                                GError **error);
+gboolean gs_vanilla_meta_libpod_container_exists(GsVanillaMetaLibpod *libpod,
+                                                 const gchar *name,
+                                                 guint timeout_seconds,
+                                                 gboolean *out_exists,
+                                                 GCancellable *cancellable,
+                                                 GError **error);
+gboolean gs_vanilla_meta_libpod_exec(GsVanillaMetaLibpod *libpod,
+                                     const gchar *container,
+                                     const gchar *const *argv,
+                                     guint timeout_seconds,
+                                     GsVanillaMetaLineFunc stdout_func,
+                                     GsVanillaMetaLineFunc stderr_func,
+                                     gpointer line_data,
+                                     gint *out_exit_status,
+                                     GCancellable *cancellable,
+                                     GError **error);
+
+G_END_DECLS
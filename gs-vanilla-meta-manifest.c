@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <errno.h>
+
+#include "gs-vanilla-meta-manifest.h"
+
+// Bump when the layout of the manifest changes, older files are discarded
+#define MANIFEST_VERSION 1
+
+/*
+ * Each package is stored in the group of its container, as true if it's installed
+ * and false if it isn't. Packages not in the manifest are unknown.
+ */
+struct _GsVanillaMetaManifest {
+    GMutex mutex;
+    GKeyFile *key_file; /* (owned) */
+    gchar *path;        /* (owned) */
+};
+
+static gchar *
+get_manifest_path(void)
+{
+    return g_build_filename(g_get_user_data_dir(), "vanilla_meta", "installed.ini", NULL);
+}
+
+GsVanillaMetaManifest *
+gs_vanilla_meta_manifest_new(void)
+{
+    GsVanillaMetaManifest *self = g_new0(GsVanillaMetaManifest, 1);
+    g_autoptr(GError) error     = NULL;
+
+    g_mutex_init(&self->mutex);
+    self->key_file = g_key_file_new();
+    self->path     = get_manifest_path();
+
+    if (!g_key_file_load_from_file(self->key_file, self->path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_debug("Failed to load installed manifest, starting over: %s", error->message);
+    } else if (g_key_file_get_integer(self->key_file, "Manifest", "Version", NULL) !=
+               MANIFEST_VERSION) {
+        g_debug("Installed manifest is from another version, starting over");
+        g_key_file_free(self->key_file);
+        self->key_file = g_key_file_new();
+    }
+
+    return self;
+}
+
+void
+gs_vanilla_meta_manifest_free(GsVanillaMetaManifest *self)
+{
+    g_key_file_free(self->key_file);
+    g_free(self->path);
+    g_mutex_clear(&self->mutex);
+    g_free(self);
+}
+
+/*
+ * Saves the manifest, replacing the file at once. If it can't be saved, the changes
+ * since backup was taken are rolled back, so the manifest never claims anything
+ * that isn't on disk.
+ */
+static void
+commit(GsVanillaMetaManifest *self, const gchar *backup)
+{
+    g_autofree gchar *directory = g_path_get_dirname(self->path);
+    g_autoptr(GError) error     = NULL;
+
+    g_key_file_set_integer(self->key_file, "Manifest", "Version", MANIFEST_VERSION);
+
+    if (g_mkdir_with_parents(directory, 0755) == 0 &&
+        g_key_file_save_to_file(self->key_file, self->path, &error))
+        return;
+
+    g_debug("Failed to save installed manifest, rolling back: %s",
+            error != NULL ? error->message : g_strerror(errno));
+    g_key_file_load_from_data(self->key_file, backup, (gsize)-1, G_KEY_FILE_NONE, NULL);
+}
+
+/*
+ * Gets whether package_name was last known to be installed in container. Returns
+ * FALSE if its state isn't known.
+ */
+gboolean
+gs_vanilla_meta_manifest_lookup(GsVanillaMetaManifest *self,
+                                const gchar *container,
+                                const gchar *package_name,
+                                gboolean *out_installed)
+{
+    g_autoptr(GError) error = NULL;
+    gboolean installed;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->mutex);
+    installed = g_key_file_get_boolean(self->key_file, container, package_name, &error);
+    g_mutex_unlock(&self->mutex);
+
+    if (error != NULL)
+        return FALSE;
+
+    *out_installed = installed;
+    return TRUE;
+}
+
+/*
+ * Records that package_name was installed into or removed from container
+ */
+void
+gs_vanilla_meta_manifest_set(GsVanillaMetaManifest *self,
+                             const gchar *container,
+                             const gchar *package_name,
+                             gboolean installed)
+{
+    g_autofree gchar *backup = NULL;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->mutex);
+    backup = g_key_file_to_data(self->key_file, NULL, NULL);
+    g_key_file_set_boolean(self->key_file, container, package_name, installed);
+    commit(self, backup);
+    g_mutex_unlock(&self->mutex);
+}
+
+/*
+ * Forgets the state of package_name in container, for when we can't tell what an
+ * operation did to it
+ */
+void
+gs_vanilla_meta_manifest_forget(GsVanillaMetaManifest *self,
+                                const gchar *container,
+                                const gchar *package_name)
+{
+    g_autofree gchar *backup = NULL;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->mutex);
+    backup = g_key_file_to_data(self->key_file, NULL, NULL);
+    if (g_key_file_remove_key(self->key_file, container, package_name, NULL))
+        commit(self, backup);
+    g_mutex_unlock(&self->mutex);
+}
+
+/*
+ * Records the state of every package in package_names, as listed in installed, the
+ * set of packages actually installed in container. Only saves if anything changed.
+ */
+void
+gs_vanilla_meta_manifest_reconcile(GsVanillaMetaManifest *self,
+                                   const gchar *container,
+                                   GPtrArray *package_names,
+                                   GHashTable *installed)
+{
+    g_autofree gchar *backup = NULL;
+    guint changed            = 0;
+
+    if (container == NULL)
+        container = "apx_managed";
+
+    g_mutex_lock(&self->mutex);
+    backup = g_key_file_to_data(self->key_file, NULL, NULL);
+
+    for (guint i = 0; i < package_names->len; i++) {
+        const gchar *package_name = package_names->pdata[i];
+        gboolean is_installed     = g_hash_table_contains(installed, package_name);
+        g_autoptr(GError) error   = NULL;
+        gboolean was_installed;
+
+        was_installed = g_key_file_get_boolean(self->key_file, container, package_name, &error);
+        if (error == NULL && was_installed == is_installed)
+            continue;
+
+        g_key_file_set_boolean(self->key_file, container, package_name, is_installed);
+        changed++;
+    }
+
+    if (changed > 0) {
+        g_debug("Installed manifest: %u packages changed in %s", changed, container);
+        commit(self, backup);
+    }
+    g_mutex_unlock(&self->mutex);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Whether catalog packages are installed in each container, as of the last install,
+ * remove or check against the container. Kept on disk so installed apps are known
+ * right after startup, without running anything in the containers.
+ */
+typedef struct _GsVanillaMetaManifest GsVanillaMetaManifest;
+
+GsVanillaMetaManifest *gs_vanilla_meta_manifest_new(void);
+void gs_vanilla_meta_manifest_free(GsVanillaMetaManifest *manifest);
+gboolean gs_vanilla_meta_manifest_lookup(GsVanillaMetaManifest *manifest,
+                                         const gchar *container,
+                                         const gchar *package_name,
+                                         gboolean *out_installed);
+void gs_vanilla_meta_manifest_set(GsVanillaMetaManifest *manifest,
+                                  const gchar *container,
+                                  const gchar *package_name,
+                                  gboolean installed);
+void gs_vanilla_meta_manifest_forget(GsVanillaMetaManifest *manifest,
+                                     const gchar *container,
+                                     const gchar *package_name);
+void gs_vanilla_meta_manifest_reconcile(GsVanillaMetaManifest *manifest,
+                                        const gchar *container,
+                                        GPtrArray *package_names,
+                                        GHashTable *installed);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaManifest, gs_vanilla_meta_manifest_free)
+
+G_END_DECLS
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include "config.h"
+
+#include <json-glib/json-glib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+#include "gs-vanilla-meta-metrics.h"
+
+typedef struct {
+    guint64 count;
+    gint64 total_time; /* microseconds */
+    gint64 max_time;   /* microseconds */
+} Timing;
+
+static GMutex metrics_mutex;
+static GHashTable *timings;  /* (owned): name -> Timing */
+static GHashTable *counters; /* (owned): name -> count, as a pointer */
+
+/*
+ * Gets the file metrics are dumped to, or NULL if they're disabled
+ */
+static const gchar *
+get_dump_path(void)
+{
+    static gsize initialized = 0;
+    static gchar *path       = NULL;
+
+    if (g_once_init_enter(&initialized)) {
+        const gchar *value = g_getenv("GS_VANILLA_META_METRICS");
+
+        if (value != NULL && *value != '\0') {
+            path     = g_strdup(value);
+            timings  = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+            counters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
+        g_once_init_leave(&initialized, 1);
+    }
+
+    return path;
+}
+
+gboolean
+gs_vanilla_meta_metrics_enabled(void)
+{
+    return get_dump_path() != NULL;
+}
+
+/*
+ * Starts timing an operation, pass the result to gs_vanilla_meta_metrics_end()
+ */
+gint64
+gs_vanilla_meta_metrics_begin(void)
+{
+    return gs_vanilla_meta_metrics_enabled() ? g_get_monotonic_time() : 0;
+}
+
+/*
+ * Records an operation started at begin_time under name. message is only used for
+ * the sysprof mark, to tell apart operations of the same name.
+ */
+void
+gs_vanilla_meta_metrics_end(gint64 begin_time, const gchar *name, const gchar *message)
+{
+    gint64 duration;
+    Timing *timing;
+
+    if (begin_time == 0)
+        return;
+
+    duration = g_get_monotonic_time() - begin_time;
+
+    g_mutex_lock(&metrics_mutex);
+    timing = g_hash_table_lookup(timings, name);
+    if (timing == NULL) {
+        timing = g_new0(Timing, 1);
+        g_hash_table_insert(timings, g_strdup(name), timing);
+    }
+    timing->count++;
+    timing->total_time += duration;
+    timing->max_time = MAX(timing->max_time, duration);
+    g_mutex_unlock(&metrics_mutex);
+
+#ifdef HAVE_SYSPROF
+    // Both clocks are CLOCK_MONOTONIC
+    sysprof_collector_mark(begin_time * 1000, duration * 1000, "vanilla-meta", name, message);
+#endif
+}
+
+void
+gs_vanilla_meta_metrics_count(const gchar *name)
+{
+    guint64 count;
+
+    if (!gs_vanilla_meta_metrics_enabled())
+        return;
+
+    g_mutex_lock(&metrics_mutex);
+    count = GPOINTER_TO_SIZE(g_hash_table_lookup(counters, name)) + 1;
+    g_hash_table_replace(counters, g_strdup(name), GSIZE_TO_POINTER(count));
+    g_mutex_unlock(&metrics_mutex);
+}
+
+static void
+add_timings(JsonBuilder *builder)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    json_builder_set_member_name(builder, "timings");
+    json_builder_begin_object(builder);
+
+    g_hash_table_iter_init(&iter, timings);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        Timing *timing = value;
+
+        json_builder_set_member_name(builder, key);
+        json_builder_begin_object(builder);
+        json_builder_set_member_name(builder, "count");
+        json_builder_add_int_value(builder, timing->count);
+        json_builder_set_member_name(builder, "total_ms");
+        json_builder_add_double_value(builder, timing->total_time / 1000.0);
+        json_builder_set_member_name(builder, "mean_ms");
+        json_builder_add_double_value(builder, timing->total_time / 1000.0 / timing->count);
+        json_builder_set_member_name(builder, "max_ms");
+        json_builder_add_double_value(builder, timing->max_time / 1000.0);
+        json_builder_end_object(builder);
+    }
+
+    json_builder_end_object(builder);
+}
+
+/*
+ * Counters come in "<name>-hit" and "<name>-miss" pairs, ratios are the share of hits
+ */
+static void
+add_counters(JsonBuilder *builder)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    json_builder_set_member_name(builder, "counters");
+    json_builder_begin_object(builder);
+    g_hash_table_iter_init(&iter, counters);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        json_builder_set_member_name(builder, key);
+        json_builder_add_int_value(builder, GPOINTER_TO_SIZE(value));
+    }
+    json_builder_end_object(builder);
+
+    json_builder_set_member_name(builder, "hit_ratios");
+    json_builder_begin_object(builder);
+    g_hash_table_iter_init(&iter, counters);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const gchar *name      = key;
+        g_autofree gchar *base = NULL;
+        g_autofree gchar *miss = NULL;
+        guint64 hits           = GPOINTER_TO_SIZE(value);
+        guint64 misses;
+
+        if (!g_str_has_suffix(name, "-hit"))
+            continue;
+
+        base   = g_strndup(name, strlen(name) - strlen("-hit"));
+        miss   = g_strconcat(base, "-miss", NULL);
+        misses = GPOINTER_TO_SIZE(g_hash_table_lookup(counters, miss));
+
+        json_builder_set_member_name(builder, base);
+        json_builder_add_double_value(builder, (gdouble)hits / (hits + misses));
+    }
+    json_builder_end_object(builder);
+}
+
+/*
+ * Writes everything recorded so far to the file named by GS_VANILLA_META_METRICS
+ */
+gboolean
+gs_vanilla_meta_metrics_dump(GError **error)
+{
+    const gchar *path                  = get_dump_path();
+    g_autoptr(JsonBuilder) builder     = json_builder_new();
+    g_autoptr(JsonGenerator) generator = json_generator_new();
+    g_autoptr(JsonNode) root           = NULL;
+
+    if (path == NULL)
+        return TRUE;
+
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "pid");
+    json_builder_add_int_value(builder, getpid());
+    json_builder_set_member_name(builder, "time");
+    json_builder_add_int_value(builder, g_get_real_time() / G_USEC_PER_SEC);
+
+    g_mutex_lock(&metrics_mutex);
+    add_timings(builder);
+    add_counters(builder);
+    g_mutex_unlock(&metrics_mutex);
+
+    json_builder_end_object(builder);
+
+    root = json_builder_get_root(builder);
+    json_generator_set_root(generator, root);
+    json_generator_set_pretty(generator, TRUE);
+
+    g_debug("Dumping metrics to %s", path);
+    return json_generator_to_file(generator, path, error);
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Timings and counters of plugin operations. They're only collected when
+ * GS_VANILLA_META_METRICS names the file to dump them to, and timings are also
+ * emitted as sysprof marks when built with sysprof support.
+ */
+gboolean gs_vanilla_meta_metrics_enabled(void);
+gint64 gs_vanilla_meta_metrics_begin(void);
+void gs_vanilla_meta_metrics_end(gint64 begin_time, const gchar *name, const gchar *message);
+void gs_vanilla_meta_metrics_count(const gchar *name);
+gboolean gs_vanilla_meta_metrics_dump(GError **error);
+
+G_END_DECLS
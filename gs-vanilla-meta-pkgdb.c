@@ -0,0 +1,719 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include "config.h"
+
+#include <json-glib/json-glib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#ifdef HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+#include "gs-vanilla-meta-libpod.h"
+#include "gs-vanilla-meta-metrics.h"
+#include "gs-vanilla-meta-pkgdb.h"
+#include "gs-vanilla-meta-podman.h"
+#include "gs-vanilla-meta-subprocess.h"
+
+#define WHITEOUT_PREFIX ".wh."
+#define OPAQUE_MARKER   ".wh..wh..opq"
+
+typedef gboolean (*PkgdbReader)(gchar **layers, GHashTable *packages, GError **error);
+
+typedef void (*MappedLineFunc)(const gchar *line, gsize length, gpointer user_data);
+
+typedef enum {
+    LAYER_PATH_ABSENT,  /* look in the layers below */
+    LAYER_PATH_PRESENT, /* this layer has it */
+    LAYER_PATH_HIDDEN,  /* deleted, or can't be followed from here */
+} LayerPathState;
+
+typedef struct {
+    GHashTable *packages;
+    gchar *package; /* (owned) (nullable): of the current paragraph */
+    gboolean installed;
+} DpkgStatusData;
+
+typedef struct {
+    GHashTable *packages;
+    GString *text;  /* (owned): of the current element */
+    gchar *package; /* (owned) (nullable): whose dictionary is being read */
+    gchar *key;     /* (owned) (nullable): last key in the package's dictionary */
+    guint depth;
+} XbpsPkgdbData;
+
+static GMutex layers_mutex;
+static GHashTable *layers_cache; /* (owned): container name -> layer directories, topmost first */
+
+/*
+ * Collects the overlay layers of a container, from what `podman container inspect`
+ * prints or podman's socket answers for it
+ */
+static gchar **
+parse_layers(const gchar *json, GError **error)
+{
+    g_autoptr(JsonParser) parser = json_parser_new();
+    g_autoptr(GPtrArray) layers  = g_ptr_array_new_with_free_func(g_free);
+    JsonNode *root               = NULL;
+    JsonObject *container        = NULL;
+    JsonObject *graph_driver     = NULL;
+    JsonObject *data             = NULL;
+    const gchar *upper_dir       = NULL;
+    const gchar *lower_dir       = NULL;
+
+    if (!json_parser_load_from_data(parser, json, -1, error))
+        return NULL;
+
+    // The CLI prints an array of containers, the socket answers with the container
+    root = json_parser_get_root(parser);
+    if (root != NULL && JSON_NODE_HOLDS_ARRAY(root) &&
+        json_array_get_length(json_node_get_array(root)) > 0)
+        container = json_array_get_object_element(json_node_get_array(root), 0);
+    else if (root != NULL && JSON_NODE_HOLDS_OBJECT(root))
+        container = json_node_get_object(root);
+    if (container != NULL && json_object_has_member(container, "GraphDriver"))
+        graph_driver = json_object_get_object_member(container, "GraphDriver");
+    if (graph_driver == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "podman didn't tell the storage of the container");
+        return NULL;
+    }
+
+    if (g_strcmp0(json_object_get_string_member_with_default(graph_driver, "Name", NULL),
+                  "overlay") != 0 ||
+        !json_object_has_member(graph_driver, "Data")) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Container storage isn't overlay");
+        return NULL;
+    }
+
+    data      = json_object_get_object_member(graph_driver, "Data");
+    upper_dir = json_object_get_string_member_with_default(data, "UpperDir", NULL);
+    lower_dir = json_object_get_string_member_with_default(data, "LowerDir", NULL);
+    if (upper_dir == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Container storage has no upper layer");
+        return NULL;
+    }
+
+    g_ptr_array_add(layers, g_strdup(upper_dir));
+    if (lower_dir != NULL) {
+        g_auto(GStrv) lower_dirs = g_strsplit(lower_dir, ":", -1);
+
+        for (guint i = 0; lower_dirs[i] != NULL; i++) {
+            if (*lower_dirs[i] != '\0')
+                g_ptr_array_add(layers, g_steal_pointer(&lower_dirs[i]));
+        }
+    }
+    g_ptr_array_add(layers, NULL);
+
+    return (gchar **)g_ptr_array_free(g_steal_pointer(&layers), FALSE);
+}
+
+static void
+inspect_line_cb(const gchar *line, gpointer user_data)
+{
+    GString *output = user_data;
+
+    g_string_append(output, line);
+    g_string_append_c(output, '\n');
+}
+
+static gchar **
+fetch_layers(const gchar *container,
+             guint timeout_seconds,
+             GCancellable *cancellable,
+             GError **error)
+{
+    GsVanillaMetaLibpod *libpod   = gs_vanilla_meta_libpod_get_default();
+    const gchar *program          = gs_vanilla_meta_podman_get_program();
+    g_autoptr(GString) output     = g_string_new(NULL);
+    g_autofree gchar *response    = NULL;
+    g_autoptr(GError) local_error = NULL;
+    gint exit_status;
+
+    if (libpod != NULL) {
+        response = gs_vanilla_meta_libpod_inspect_container(libpod, container, timeout_seconds,
+                                                            cancellable, &local_error);
+        if (response != NULL)
+            return parse_layers(response, error);
+        if (!gs_vanilla_meta_libpod_can_fall_back(local_error)) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return NULL;
+        }
+    }
+
+    const gchar *inspect_argv[] = {program, "container", "inspect", container, NULL};
+    if (!gs_vanilla_meta_subprocess_run(inspect_argv, timeout_seconds, inspect_line_cb, NULL,
+                                        output, &exit_status, cancellable, error))
+        return NULL;
+    if (exit_status != EXIT_SUCCESS) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Failed to inspect container %s, podman exited with status %d", container,
+                    exit_status);
+        return NULL;
+    }
+
+    return parse_layers(output->str, error);
+}
+
+/*
+ * Gets the layers of a container, asking podman only the first time and after the
+ * container was created again, which leaves its upper layer behind. Containers not
+ * stored in overlay layers are remembered as an empty list.
+ */
+static gchar **
+get_layers(const gchar *container,
+           guint timeout_seconds,
+           GCancellable *cancellable,
+           GError **error)
+{
+    g_autoptr(GError) local_error = NULL;
+    gchar **layers                = NULL;
+
+    g_mutex_lock(&layers_mutex);
+    if (layers_cache == NULL)
+        layers_cache =
+            g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_strfreev);
+    layers = g_hash_table_lookup(layers_cache, container);
+    if (layers != NULL && (layers[0] == NULL || g_file_test(layers[0], G_FILE_TEST_IS_DIR)))
+        layers = g_strdupv(layers);
+    else
+        layers = NULL;
+    g_mutex_unlock(&layers_mutex);
+
+    if (layers == NULL) {
+        layers = fetch_layers(container, timeout_seconds, cancellable, &local_error);
+        if (layers == NULL &&
+            !g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return NULL;
+        }
+        if (layers == NULL)
+            layers = g_new0(gchar *, 1);
+
+        g_debug("Container %s is stored in %u layers", container, g_strv_length(layers));
+        g_mutex_lock(&layers_mutex);
+        g_hash_table_replace(layers_cache, g_strdup(container), g_strdupv(layers));
+        g_mutex_unlock(&layers_mutex);
+    }
+
+    if (layers[0] == NULL) {
+        g_strfreev(layers);
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Container %s isn't stored in overlay layers", container);
+        return NULL;
+    }
+
+    return layers;
+}
+
+/*
+ * Whether path was deleted in its layer, with a 0/0 character device in its place
+ * or a .wh. file next to it
+ */
+static gboolean
+is_whiteout(const gchar *path)
+{
+    g_autofree gchar *directory = g_path_get_dirname(path);
+    g_autofree gchar *name      = g_path_get_basename(path);
+    g_autofree gchar *marker    = g_strconcat(directory, "/" WHITEOUT_PREFIX, name, NULL);
+    struct stat info;
+
+    if (lstat(path, &info) == 0 && S_ISCHR(info.st_mode) && info.st_rdev == makedev(0, 0))
+        return TRUE;
+
+    return lstat(marker, &info) == 0;
+}
+
+/*
+ * Whether the directory at path hides its copies in the layers below
+ */
+static gboolean
+is_opaque(const gchar *path)
+{
+    g_autofree gchar *marker = g_build_filename(path, OPAQUE_MARKER, NULL);
+    gchar value;
+    struct stat info;
+
+    if (lstat(marker, &info) == 0)
+        return TRUE;
+
+    return (lgetxattr(path, "trusted.overlay.opaque", &value, 1) == 1 && value == 'y') ||
+           (lgetxattr(path, "user.overlay.opaque", &value, 1) == 1 && value == 'y');
+}
+
+/*
+ * Looks for relative_path in a single layer. out_opaque is set when a directory on
+ * the way, or the path itself, hides the layers below.
+ */
+static LayerPathState
+lookup_in_layer(const gchar *layer,
+                const gchar *relative_path,
+                gchar **out_path,
+                gboolean *out_opaque)
+{
+    g_auto(GStrv) components = g_strsplit(relative_path, "/", -1);
+    g_autoptr(GString) path  = g_string_new(layer);
+    struct stat info;
+
+    *out_opaque = FALSE;
+    for (guint i = 0; components[i] != NULL; i++) {
+        g_string_append_printf(path, "/%s", components[i]);
+
+        if (is_whiteout(path->str))
+            return LAYER_PATH_HIDDEN;
+        if (lstat(path->str, &info) != 0)
+            return LAYER_PATH_ABSENT;
+        // Links point into the container, following them here would read the host
+        if (S_ISLNK(info.st_mode))
+            return LAYER_PATH_HIDDEN;
+        if (S_ISDIR(info.st_mode) && is_opaque(path->str))
+            *out_opaque = TRUE;
+    }
+
+    *out_path = g_string_free(g_steal_pointer(&path), FALSE);
+    return LAYER_PATH_PRESENT;
+}
+
+/*
+ * Finds relative_path in the layers like overlayfs would, or returns NULL if the
+ * container doesn't have it
+ */
+static gchar *
+resolve_path(gchar **layers, const gchar *relative_path)
+{
+    for (guint i = 0; layers[i] != NULL; i++) {
+        gchar *path = NULL;
+        gboolean opaque;
+
+        switch (lookup_in_layer(layers[i], relative_path, &path, &opaque)) {
+        case LAYER_PATH_PRESENT:
+            return path;
+        case LAYER_PATH_HIDDEN:
+            return NULL;
+        case LAYER_PATH_ABSENT:
+            if (opaque)
+                return NULL;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Lists the directory at relative_path merged from the layers like overlayfs would,
+ * as a table of entry names to their path. Returns NULL if the container doesn't have it.
+ */
+static GHashTable *
+list_directory(gchar **layers, const gchar *relative_path)
+{
+    g_autoptr(GHashTable) entries = NULL;
+    g_autoptr(GHashTable) deleted = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    for (guint i = 0; layers[i] != NULL; i++) {
+        g_autofree gchar *path = NULL;
+        g_autoptr(GDir) dir    = NULL;
+        LayerPathState state;
+        const gchar *name;
+        gboolean opaque;
+
+        state = lookup_in_layer(layers[i], relative_path, &path, &opaque);
+        if (state == LAYER_PATH_HIDDEN || (state == LAYER_PATH_ABSENT && opaque))
+            break;
+        if (state == LAYER_PATH_ABSENT)
+            continue;
+
+        dir = g_dir_open(path, 0, NULL);
+        if (dir == NULL)
+            break;
+
+        if (entries == NULL)
+            entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+        // Upper layers win, and their whiteouts delete the entries of the lower ones
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            g_autofree gchar *entry_path = g_build_filename(path, name, NULL);
+
+            if (g_str_equal(name, OPAQUE_MARKER))
+                continue;
+            if (g_str_has_prefix(name, WHITEOUT_PREFIX)) {
+                g_hash_table_add(deleted, g_strdup(name + strlen(WHITEOUT_PREFIX)));
+                continue;
+            }
+            if (is_whiteout(entry_path)) {
+                g_hash_table_add(deleted, g_strdup(name));
+                continue;
+            }
+            if (g_hash_table_contains(entries, name) || g_hash_table_contains(deleted, name))
+                continue;
+
+            g_hash_table_insert(entries, g_strdup(name), g_steal_pointer(&entry_path));
+        }
+
+        if (opaque)
+            break;
+    }
+
+    return g_steal_pointer(&entries);
+}
+
+static gboolean
+has_prefix(const gchar *line, gsize length, const gchar *prefix)
+{
+    gsize prefix_length = strlen(prefix);
+
+    return length >= prefix_length && memcmp(line, prefix, prefix_length) == 0;
+}
+
+/*
+ * Maps the file at path and passes each of its lines to func, without the line
+ * terminator, and without copying them
+ */
+static gboolean
+map_lines(const gchar *path, MappedLineFunc func, gpointer user_data, GError **error)
+{
+    g_autoptr(GMappedFile) file = g_mapped_file_new(path, FALSE, error);
+    const gchar *line           = NULL;
+    const gchar *end            = NULL;
+
+    if (file == NULL)
+        return FALSE;
+
+    line = g_mapped_file_get_contents(file);
+    end  = line + g_mapped_file_get_length(file);
+    while (line != NULL && line < end) {
+        const gchar *newline = memchr(line, '\n', end - line);
+
+        if (newline == NULL)
+            newline = end;
+        func(line, newline - line, user_data);
+        line = newline + 1;
+    }
+
+    return TRUE;
+}
+
+static void
+dpkg_status_flush(DpkgStatusData *data)
+{
+    if (data->package != NULL && data->installed)
+        g_hash_table_add(data->packages, g_steal_pointer(&data->package));
+    g_clear_pointer(&data->package, g_free);
+    data->installed = FALSE;
+}
+
+static void
+dpkg_status_line_cb(const gchar *line, gsize length, gpointer user_data)
+{
+    DpkgStatusData *data = user_data;
+
+    if (length == 0) {
+        dpkg_status_flush(data);
+    } else if (has_prefix(line, length, "Package: ")) {
+        g_free(data->package);
+        data->package = g_strstrip(g_strndup(line + 9, length - 9));
+    } else if (has_prefix(line, length, "Status: ")) {
+        g_autofree gchar *status = g_strndup(line + 8, length - 8);
+
+        // Same as "ii" in `dpkg-query -W`, anything else isn't completely installed
+        data->installed =
+            g_str_has_prefix(status, "install ") && g_str_has_suffix(status, " installed");
+    }
+}
+
+/*
+ * Paragraphs of /var/lib/dpkg/status, with the Package and Status of each package
+ */
+static gboolean
+read_dpkg(gchar **layers, GHashTable *packages, GError **error)
+{
+    g_autofree gchar *path = resolve_path(layers, "var/lib/dpkg/status");
+    DpkgStatusData data    = {packages, NULL, FALSE};
+
+    if (path == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No dpkg status file");
+        return FALSE;
+    }
+
+    if (!map_lines(path, dpkg_status_line_cb, &data, error)) {
+        g_free(data.package);
+        return FALSE;
+    }
+    dpkg_status_flush(&data);
+
+    return TRUE;
+}
+
+/*
+ * A directory per package in /var/lib/pacman/local, named name-version-release
+ */
+static gboolean
+read_pacman(gchar **layers, GHashTable *packages, GError **error)
+{
+    g_autoptr(GHashTable) entries = list_directory(layers, "var/lib/pacman/local");
+    GHashTableIter iter;
+    gpointer name, path;
+
+    if (entries == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No pacman local database");
+        return FALSE;
+    }
+
+    g_hash_table_iter_init(&iter, entries);
+    while (g_hash_table_iter_next(&iter, &name, &path)) {
+        const gchar *release = strrchr(name, '-');
+        const gchar *version = NULL;
+
+        if (!g_file_test(path, G_FILE_TEST_IS_DIR) || release == NULL)
+            continue;
+
+        for (version = release - 1; version > (const gchar *)name && *version != '-'; version--)
+            ;
+        if (version > (const gchar *)name)
+            g_hash_table_add(packages, g_strndup(name, version - (const gchar *)name));
+    }
+
+    return TRUE;
+}
+
+static void
+apk_installed_line_cb(const gchar *line, gsize length, gpointer user_data)
+{
+    GHashTable *packages = user_data;
+
+    if (has_prefix(line, length, "P:") && length > 2)
+        g_hash_table_add(packages, g_strndup(line + 2, length - 2));
+}
+
+/*
+ * Records of /lib/apk/db/installed, the name of each package in its P: line
+ */
+static gboolean
+read_apk(gchar **layers, GHashTable *packages, GError **error)
+{
+    g_autofree gchar *path = resolve_path(layers, "lib/apk/db/installed");
+
+    if (path == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No apk installed database");
+        return FALSE;
+    }
+
+    return map_lines(path, apk_installed_line_cb, packages, error);
+}
+
+static void
+xbps_start_element_cb(GMarkupParseContext *context,
+                      const gchar *element_name,
+                      const gchar **attribute_names,
+                      const gchar **attribute_values,
+                      gpointer user_data,
+                      GError **error)
+{
+    XbpsPkgdbData *data = user_data;
+
+    data->depth++;
+    g_string_truncate(data->text, 0);
+}
+
+/*
+ * The package names are the keys of the top dictionary, each with a dictionary
+ * whose "state" is "installed" once it's completely installed
+ */
+static void
+xbps_end_element_cb(GMarkupParseContext *context,
+                    const gchar *element_name,
+                    gpointer user_data,
+                    GError **error)
+{
+    XbpsPkgdbData *data = user_data;
+
+    if (data->depth == 3 && g_str_equal(element_name, "key")) {
+        g_free(data->package);
+        data->package = g_strdup(data->text->str);
+        g_clear_pointer(&data->key, g_free);
+    } else if (data->depth == 4 && g_str_equal(element_name, "key")) {
+        g_free(data->key);
+        data->key = g_strdup(data->text->str);
+    } else if (data->depth == 4 && g_str_equal(element_name, "string") &&
+               g_strcmp0(data->key, "state") == 0 && g_str_equal(data->text->str, "installed") &&
+               data->package != NULL && !g_str_has_prefix(data->package, "_XBPS_")) {
+        g_hash_table_add(data->packages, g_strdup(data->package));
+    }
+
+    data->depth--;
+}
+
+static void
+xbps_text_cb(GMarkupParseContext *context,
+             const gchar *text,
+             gsize text_len,
+             gpointer user_data,
+             GError **error)
+{
+    XbpsPkgdbData *data = user_data;
+
+    g_string_append_len(data->text, text, text_len);
+}
+
+/*
+ * The /var/db/xbps/pkgdb-0.38.plist property list
+ */
+static gboolean
+read_xbps(gchar **layers, GHashTable *packages, GError **error)
+{
+    static const GMarkupParser parser      = {xbps_start_element_cb, xbps_end_element_cb,
+                                              xbps_text_cb, NULL, NULL};
+    g_autofree gchar *path                 = NULL;
+    g_autoptr(GMappedFile) file            = NULL;
+    g_autoptr(GMarkupParseContext) context = NULL;
+    XbpsPkgdbData data                     = {packages, NULL, NULL, NULL, 0};
+    gboolean success;
+
+    path = resolve_path(layers, "var/db/xbps/pkgdb-0.38.plist");
+    if (path == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No xbps package database");
+        return FALSE;
+    }
+
+    file = g_mapped_file_new(path, FALSE, error);
+    if (file == NULL)
+        return FALSE;
+
+    data.text = g_string_new(NULL);
+    context   = g_markup_parse_context_new(&parser, 0, &data, NULL);
+    success   = g_markup_parse_context_parse(context, g_mapped_file_get_contents(file),
+                                             g_mapped_file_get_length(file), error) &&
+                g_markup_parse_context_end_parse(context, error);
+
+    g_string_free(data.text, TRUE);
+    g_free(data.package);
+    g_free(data.key);
+
+    return success;
+}
+
+/*
+ * The Name index of the sqlite rpm database, read as it is on disk. A database with
+ * changes still in its write-ahead log isn't read, as that's not where they'd be.
+ */
+static gboolean
+read_rpm(gchar **layers, GHashTable *packages, GError **error)
+{
+#ifdef HAVE_SQLITE
+    static const gchar *const database_paths[] = {"usr/lib/sysimage/rpm/rpmdb.sqlite",
+                                                  "var/lib/rpm/rpmdb.sqlite", NULL};
+    g_autofree gchar *path     = NULL;
+    g_autofree gchar *wal_path = NULL;
+    g_autofree gchar *file_uri = NULL;
+    g_autofree gchar *uri      = NULL;
+    sqlite3 *database          = NULL;
+    sqlite3_stmt *statement    = NULL;
+    struct stat info;
+    gint result;
+
+    for (guint i = 0; path == NULL && database_paths[i] != NULL; i++) {
+        g_autofree gchar *wal_relative_path = g_strconcat(database_paths[i], "-wal", NULL);
+
+        path = resolve_path(layers, database_paths[i]);
+        if (path != NULL)
+            wal_path = resolve_path(layers, wal_relative_path);
+    }
+    if (path == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No sqlite rpm database");
+        return FALSE;
+    }
+    if (wal_path != NULL && stat(wal_path, &info) == 0 && info.st_size > 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "rpm database has changes in its write-ahead log");
+        return FALSE;
+    }
+
+    // Immutable, so nothing is ever written next to it
+    file_uri = g_filename_to_uri(path, NULL, error);
+    if (file_uri == NULL)
+        return FALSE;
+    uri = g_strconcat(file_uri, "?immutable=1", NULL);
+
+    result = sqlite3_open_v2(uri, &database, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL);
+    if (result == SQLITE_OK)
+        result = sqlite3_prepare_v2(database, "SELECT key FROM Name", -1, &statement, NULL);
+    if (result == SQLITE_OK) {
+        while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+            g_hash_table_add(packages, g_strdup((const gchar *)sqlite3_column_text(statement, 0)));
+    }
+    if (result != SQLITE_DONE)
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to read rpm database: %s",
+                    database != NULL ? sqlite3_errmsg(database) : sqlite3_errstr(result));
+
+    sqlite3_finalize(statement);
+    sqlite3_close(database);
+
+    return result == SQLITE_DONE;
+#else
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Built without sqlite support");
+    return FALSE;
+#endif
+}
+
+static PkgdbReader
+get_reader(ApxPackageManager package_manager)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        return read_dpkg;
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return read_pacman;
+    case APX_PACKAGE_MANAGER_DNF:
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        return read_rpm;
+    case APX_PACKAGE_MANAGER_APK:
+        return read_apk;
+    case APX_PACKAGE_MANAGER_XBPS:
+        return read_xbps;
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Lists all packages installed in a container from its package database, returning
+ * a set of package names, or NULL if the database couldn't be read, in which case
+ * the container has to be asked instead. Only podman is run, and only the first
+ * time a container is read.
+ */
+GHashTable *
+gs_vanilla_meta_pkgdb_list_installed(const gchar *container,
+                                     guint timeout_seconds,
+                                     GCancellable *cancellable,
+                                     GError **error)
+{
+    const ApxContainer *info       = apx_container_lookup(container);
+    PkgdbReader reader             = get_reader(info->package_manager);
+    g_autoptr(GHashTable) packages = NULL;
+    g_auto(GStrv) layers           = NULL;
+    gint64 metrics_begin;
+
+    if (reader == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Don't know the package database of container %s", info->name);
+        return NULL;
+    }
+
+    layers = get_layers(info->name, timeout_seconds, cancellable, error);
+    if (layers == NULL)
+        return NULL;
+
+    metrics_begin = gs_vanilla_meta_metrics_begin();
+    packages      = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (!reader(layers, packages, error))
+        return NULL;
+    gs_vanilla_meta_metrics_end(metrics_begin, "pkgdb-read", info->name);
+
+    return g_steal_pointer(&packages);
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "gs-vanilla-meta-containers.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Reads the installed packages of a container straight from its package database,
+ * found in the overlay layers podman keeps the container's files in. That doesn't
+ * need the container to be running, nor runs anything in it.
+ */
+GHashTable *gs_vanilla_meta_pkgdb_list_installed(const gchar *container,
+                                                 guint timeout_seconds,
+                                                 GCancellable *cancellable,
+                                                 GError **error);
+
+G_END_DECLS
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <json-glib/json-glib.h>
+
+#include "gs-vanilla-meta-libpod.h"
+#include "gs-vanilla-meta-podman.h"
+#include "gs-vanilla-meta-subprocess.h"
+
+// Seconds listing containers may take to seed the registry
+#define SEED_TIMEOUT 60
+// Seconds to wait before following events again when the stream ends
+#define EVENTS_RESTART_DELAY 30
+
+struct _GsVanillaMetaPodman {
+    GMutex mutex;
+    GHashTable *containers;    /* container names */
+    GPtrArray *pending_events; /* "+name" or "-name", received while seeding */
+    gboolean following;        /* the events stream is running */
+    gboolean seeded;           /* containers was filled from `podman container ls` */
+
+    /* Only accessed from the main context */
+    GCancellable *run_cancellable; /* (owned) (nullable): stops the events stream and seed */
+    guint generation;              /* bumped on each start, to ignore callbacks of old runs */
+    guint restart_id;
+    gboolean stopped;
+};
+
+typedef struct {
+    GsVanillaMetaPodman *podman; /* (owned) */
+    guint generation;
+} PodmanRun;
+
+static void start_run(GsVanillaMetaPodman *self);
+
+/*
+ * Gets the podman binary to run, which can be overridden with GS_VANILLA_META_PODMAN
+ * to point the plugin to a fake one.
+ */
+const gchar *
+gs_vanilla_meta_podman_get_program(void)
+{
+    const gchar *program = g_getenv("GS_VANILLA_META_PODMAN");
+
+    return program != NULL && *program != '\0' ? program : "podman";
+}
+
+static PodmanRun *
+podman_run_new(GsVanillaMetaPodman *self)
+{
+    PodmanRun *run = g_new0(PodmanRun, 1);
+
+    run->podman     = gs_vanilla_meta_podman_ref(self);
+    run->generation = self->generation;
+
+    return run;
+}
+
+static void
+podman_run_free(PodmanRun *run)
+{
+    gs_vanilla_meta_podman_unref(run->podman);
+    g_free(run);
+}
+
+/*
+ * Applies a "+name" or "-name" event. Called with the mutex held.
+ */
+static void
+apply_event(GsVanillaMetaPodman *self, const gchar *event)
+{
+    if (event[0] == '+')
+        g_hash_table_add(self->containers, g_strdup(event + 1));
+    else
+        g_hash_table_remove(self->containers, event + 1);
+}
+
+/*
+ * Collects the names in the JSON array printed by `podman container ls --format json`,
+ * which is also what podman's socket answers
+ */
+static GHashTable *
+parse_container_list(const gchar *json, GError **error)
+{
+    g_autoptr(JsonParser) parser = json_parser_new();
+    g_autoptr(GHashTable) names  = NULL;
+    JsonNode *root               = NULL;
+    JsonArray *containers        = NULL;
+
+    if (!json_parser_load_from_data(parser, json, -1, error))
+        return NULL;
+
+    root = json_parser_get_root(parser);
+    if (root == NULL || !JSON_NODE_HOLDS_ARRAY(root)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Expected an array of containers");
+        return NULL;
+    }
+
+    names      = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    containers = json_node_get_array(root);
+    for (guint i = 0; i < json_array_get_length(containers); i++) {
+        JsonObject *container = json_array_get_object_element(containers, i);
+        JsonNode *names_node  = NULL;
+
+        if (container == NULL || !json_object_has_member(container, "Names"))
+            continue;
+
+        // podman prints a list of names, older versions and docker a single string
+        names_node = json_object_get_member(container, "Names");
+        if (JSON_NODE_HOLDS_ARRAY(names_node)) {
+            JsonArray *container_names = json_node_get_array(names_node);
+
+            for (guint j = 0; j < json_array_get_length(container_names); j++)
+                g_hash_table_add(names,
+                                 g_strdup(json_array_get_string_element(container_names, j)));
+        } else if (json_node_get_string(names_node) != NULL) {
+            g_hash_table_add(names, g_strdup(json_node_get_string(names_node)));
+        }
+    }
+
+    return g_steal_pointer(&names);
+}
+
+static void
+seed_line_cb(const gchar *line, gpointer user_data)
+{
+    GString *output = user_data;
+
+    g_string_append(output, line);
+    g_string_append_c(output, '\n');
+}
+
+/*
+ * Lists the existing containers through podman's socket, or by running podman when
+ * that's not possible
+ */
+static void
+seed_thread_cb(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    GsVanillaMetaLibpod *libpod      = gs_vanilla_meta_libpod_get_default();
+    const gchar *program             = gs_vanilla_meta_podman_get_program();
+    g_autoptr(GString) output        = g_string_new(NULL);
+    g_autofree gchar *response       = NULL;
+    g_autoptr(GHashTable) containers = NULL;
+    g_autoptr(GError) error          = NULL;
+    gint exit_status;
+
+    if (libpod != NULL) {
+        response = gs_vanilla_meta_libpod_list_containers(libpod, SEED_TIMEOUT, cancellable,
+                                                          &error);
+        if (response == NULL && !gs_vanilla_meta_libpod_can_fall_back(error)) {
+            g_task_return_error(task, g_steal_pointer(&error));
+            return;
+        }
+        if (response == NULL) {
+            g_debug("Listing containers with podman instead of its socket: %s", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    const gchar *ls_argv[] = {program, "container", "ls", "-a", "--format", "json", NULL};
+    if (response == NULL) {
+        if (!gs_vanilla_meta_subprocess_run(ls_argv, SEED_TIMEOUT, seed_line_cb, NULL, output,
+                                            &exit_status, cancellable, &error)) {
+            g_prefix_error(&error, "Failed to list containers: ");
+            g_task_return_error(task, g_steal_pointer(&error));
+            return;
+        }
+        if (exit_status != EXIT_SUCCESS) {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                    "Failed to list containers, podman exited with status %d",
+                                    exit_status);
+            return;
+        }
+    }
+
+    containers = parse_container_list(response != NULL ? response : output->str, &error);
+    if (containers == NULL)
+        g_task_return_error(task, g_steal_pointer(&error));
+    else
+        g_task_return_pointer(task, g_steal_pointer(&containers),
+                              (GDestroyNotify)g_hash_table_unref);
+}
+
+static void
+seed_done_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    PodmanRun *run                   = user_data;
+    GsVanillaMetaPodman *self        = run->podman;
+    g_autoptr(GHashTable) containers = NULL;
+    g_autoptr(GError) error          = NULL;
+
+    containers = g_task_propagate_pointer(G_TASK(result), &error);
+
+    if (run->generation != self->generation) {
+        podman_run_free(run);
+        return;
+    }
+
+    if (containers == NULL) {
+        // Stopping the events stream schedules a retry
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_debug("%s", error->message);
+        g_cancellable_cancel(self->run_cancellable);
+        podman_run_free(run);
+        return;
+    }
+
+    g_mutex_lock(&self->mutex);
+    g_hash_table_unref(self->containers);
+    self->containers = g_steal_pointer(&containers);
+    for (guint i = 0; i < self->pending_events->len; i++)
+        apply_event(self, self->pending_events->pdata[i]);
+    g_ptr_array_set_size(self->pending_events, 0);
+    self->seeded = TRUE;
+    g_debug("Tracking %u podman containers", g_hash_table_size(self->containers));
+    g_mutex_unlock(&self->mutex);
+
+    podman_run_free(run);
+}
+
+static void
+events_line_cb(const gchar *line, gpointer user_data)
+{
+    PodmanRun *run               = user_data;
+    GsVanillaMetaPodman *self    = run->podman;
+    g_autoptr(JsonParser) parser = json_parser_new();
+    g_autoptr(GError) error      = NULL;
+    g_autofree gchar *event      = NULL;
+    JsonNode *root               = NULL;
+    JsonObject *object           = NULL;
+    const gchar *type            = NULL;
+    const gchar *status          = NULL;
+    const gchar *name            = NULL;
+
+    if (run->generation != self->generation)
+        return;
+
+    if (!json_parser_load_from_data(parser, line, -1, &error)) {
+        g_debug("Ignoring podman event that isn't JSON: %s", error->message);
+        return;
+    }
+
+    root = json_parser_get_root(parser);
+    if (root == NULL || !JSON_NODE_HOLDS_OBJECT(root))
+        return;
+
+    object = json_node_get_object(root);
+    type   = json_object_get_string_member_with_default(object, "Type", NULL);
+    status = json_object_get_string_member_with_default(object, "Status", NULL);
+    name   = json_object_get_string_member_with_default(object, "Name", NULL);
+    if (g_strcmp0(type, "container") != 0 || name == NULL)
+        return;
+
+    if (g_strcmp0(status, "create") == 0)
+        event = g_strdup_printf("+%s", name);
+    else if (g_strcmp0(status, "remove") == 0)
+        event = g_strdup_printf("-%s", name);
+    else
+        return;
+
+    // Until the seed arrives, we don't know if it already includes this event
+    g_mutex_lock(&self->mutex);
+    if (self->seeded)
+        apply_event(self, event);
+    else
+        g_ptr_array_add(self->pending_events, g_steal_pointer(&event));
+    g_mutex_unlock(&self->mutex);
+}
+
+static gboolean
+restart_cb(gpointer user_data)
+{
+    GsVanillaMetaPodman *self = user_data;
+
+    self->restart_id = 0;
+    start_run(self);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+events_done_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    PodmanRun *run            = user_data;
+    GsVanillaMetaPodman *self = run->podman;
+    g_autoptr(GError) error   = NULL;
+
+    if (!gs_vanilla_meta_subprocess_run_finish(result, NULL, &error) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_debug("Failed to follow podman events: %s", error->message);
+
+    if (run->generation != self->generation) {
+        podman_run_free(run);
+        return;
+    }
+
+    // Without events the set goes stale, stop answering lookups until we follow them again
+    g_mutex_lock(&self->mutex);
+    self->following = FALSE;
+    self->seeded    = FALSE;
+    g_ptr_array_set_size(self->pending_events, 0);
+    g_mutex_unlock(&self->mutex);
+    g_cancellable_cancel(self->run_cancellable);
+
+    if (!self->stopped && self->restart_id == 0) {
+        g_debug("Stopped following podman events, retrying in %u seconds", EVENTS_RESTART_DELAY);
+        self->restart_id =
+            g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, EVENTS_RESTART_DELAY, restart_cb,
+                                       gs_vanilla_meta_podman_ref(self),
+                                       (GDestroyNotify)gs_vanilla_meta_podman_unref);
+    }
+
+    podman_run_free(run);
+}
+
+/*
+ * Follows container events and, once that's running, lists the containers that
+ * already exist, so nothing happening in between is missed.
+ */
+static void
+start_run(GsVanillaMetaPodman *self)
+{
+    const gchar *program    = gs_vanilla_meta_podman_get_program();
+    g_autofree gchar *since = NULL;
+    PodmanRun *events_run   = NULL;
+    PodmanRun *seed_run     = NULL;
+    g_autoptr(GTask) task   = NULL;
+
+    if (self->run_cancellable != NULL)
+        g_cancellable_cancel(self->run_cancellable);
+    g_clear_object(&self->run_cancellable);
+    self->run_cancellable = g_cancellable_new();
+    self->generation++;
+
+    g_mutex_lock(&self->mutex);
+    self->following = TRUE;
+    self->seeded    = FALSE;
+    g_ptr_array_set_size(self->pending_events, 0);
+    g_mutex_unlock(&self->mutex);
+
+    // Only new events, the listing below covers what happened before
+    since = g_strdup_printf("%" G_GINT64_FORMAT, g_get_real_time() / G_USEC_PER_SEC);
+
+    const gchar *events_argv[] = {program, "events", "--format", "json", "--filter",
+                                  "type=container", "--since", since, NULL};
+
+    events_run = podman_run_new(self);
+    gs_vanilla_meta_subprocess_run_async(events_argv, 0, events_line_cb, NULL, events_run,
+                                         self->run_cancellable, events_done_cb, events_run);
+
+    seed_run = podman_run_new(self);
+    task     = g_task_new(NULL, self->run_cancellable, seed_done_cb, seed_run);
+    g_task_set_source_tag(task, start_run);
+    g_task_run_in_thread(task, seed_thread_cb);
+}
+
+static void
+gs_vanilla_meta_podman_clear(GsVanillaMetaPodman *self)
+{
+    g_mutex_clear(&self->mutex);
+    g_hash_table_unref(self->containers);
+    g_ptr_array_unref(self->pending_events);
+    g_clear_object(&self->run_cancellable);
+}
+
+GsVanillaMetaPodman *
+gs_vanilla_meta_podman_new(void)
+{
+    GsVanillaMetaPodman *self = g_atomic_rc_box_new0(GsVanillaMetaPodman);
+
+    g_mutex_init(&self->mutex);
+    self->containers     = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    self->pending_events = g_ptr_array_new_with_free_func(g_free);
+
+    return self;
+}
+
+GsVanillaMetaPodman *
+gs_vanilla_meta_podman_ref(GsVanillaMetaPodman *self)
+{
+    return g_atomic_rc_box_acquire(self);
+}
+
+void
+gs_vanilla_meta_podman_unref(GsVanillaMetaPodman *self)
+{
+    g_atomic_rc_box_release_full(self, (GDestroyNotify)gs_vanilla_meta_podman_clear);
+}
+
+/*
+ * Starts tracking containers. Events are handled in the thread-default main context
+ * of the caller, which must keep running until gs_vanilla_meta_podman_stop().
+ */
+void
+gs_vanilla_meta_podman_start(GsVanillaMetaPodman *self)
+{
+    self->stopped = FALSE;
+    start_run(self);
+}
+
+void
+gs_vanilla_meta_podman_stop(GsVanillaMetaPodman *self)
+{
+    self->stopped = TRUE;
+    if (self->restart_id != 0) {
+        g_source_remove(self->restart_id);
+        self->restart_id = 0;
+    }
+    if (self->run_cancellable != NULL)
+        g_cancellable_cancel(self->run_cancellable);
+}
+
+/*
+ * Checks if a container exists. Returns FALSE if the registry can't tell right now,
+ * because it's still seeding or lost the events stream, in which case callers should
+ * ask podman directly.
+ */
+gboolean
+gs_vanilla_meta_podman_lookup_container(GsVanillaMetaPodman *self,
+                                        const gchar *name,
+                                        gboolean *out_exists)
+{
+    gboolean known = FALSE;
+
+    g_mutex_lock(&self->mutex);
+    if (self->following && self->seeded) {
+        *out_exists = g_hash_table_contains(self->containers, name);
+        known       = TRUE;
+    }
+    g_mutex_unlock(&self->mutex);
+
+    return known;
+}
+
+/*
+ * Records a container we just created, without waiting for its event
+ */
+void
+gs_vanilla_meta_podman_add_container(GsVanillaMetaPodman *self, const gchar *name)
+{
+    g_mutex_lock(&self->mutex);
+    g_hash_table_add(self->containers, g_strdup(name));
+    g_mutex_unlock(&self->mutex);
+}
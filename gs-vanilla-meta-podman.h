@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Set of existing podman containers, seeded from podman's socket or `podman container
+ * ls` and kept current from the `podman events` stream.
+ */
+typedef struct _GsVanillaMetaPodman GsVanillaMetaPodman;
+
+const gchar *gs_vanilla_meta_podman_get_program(void);
+GsVanillaMetaPodman *gs_vanilla_meta_podman_new(void);
+GsVanillaMetaPodman *gs_vanilla_meta_podman_ref(GsVanillaMetaPodman *podman);
+void gs_vanilla_meta_podman_unref(GsVanillaMetaPodman *podman);
+void gs_vanilla_meta_podman_start(GsVanillaMetaPodman *podman);
+void gs_vanilla_meta_podman_stop(GsVanillaMetaPodman *podman);
+gboolean gs_vanilla_meta_podman_lookup_container(GsVanillaMetaPodman *podman,
+                                                 const gchar *name,
+                                                 gboolean *out_exists);
+void gs_vanilla_meta_podman_add_container(GsVanillaMetaPodman *podman, const gchar *name);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaPodman, gs_vanilla_meta_podman_unref)
+
+G_END_DECLS
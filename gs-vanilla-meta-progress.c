@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gs-vanilla-meta-progress.h"
+
+typedef enum {
+    PROGRESS_PHASE_NONE,
+    PROGRESS_PHASE_DOWNLOAD,
+    PROGRESS_PHASE_INSTALL,   /* unpacking, installing or removing packages */
+    PROGRESS_PHASE_CONFIGURE, /* post-install scripts and verification */
+} ProgressPhase;
+
+// Percentage each phase starts at, the next one's start is where it ends. Removals
+// don't download anything, so their install phase starts at 0.
+static const guint phase_start[] = {0, 0, 40, 90, 100};
+
+struct _GsVanillaMetaProgress {
+    GsApp *app; /* (owned) */
+    ApxPackageManager package_manager;
+    gboolean removing;
+    ProgressPhase phase;
+    guint current;    /* packages through the current phase */
+    guint total;      /* packages in the transaction, 0 while unknown */
+    guint percentage; /* last reported */
+};
+
+static const gchar *const pacman_install_verbs[] = {
+    "installing", "upgrading", "reinstalling", "downgrading", "removing", NULL};
+static const gchar *const dnf_install_verbs[] = {
+    "Installing", "Upgrading", "Reinstalling", "Downgrading", "Erasing", "Removing", NULL};
+static const gchar *const apk_install_verbs[] = {
+    "Installing", "Upgrading", "Downgrading", "Reinstalling", "Replacing", "Purging", "Deleting",
+    NULL};
+static const gchar *const zypper_install_verbs[] = {"Installing:", "Removing", NULL};
+static const gchar *const xbps_actions[] = {"install", "update", "reinstall", "downgrade",
+                                            "remove",  NULL};
+
+GsVanillaMetaProgress *
+gs_vanilla_meta_progress_new(GsApp *app, ApxPackageManager package_manager, gboolean removing)
+{
+    GsVanillaMetaProgress *self = g_new0(GsVanillaMetaProgress, 1);
+
+    self->app             = g_object_ref(app);
+    self->package_manager = package_manager;
+    self->removing        = removing;
+
+    // Until the first line we can make sense of
+    gs_app_set_progress(app, GS_APP_PROGRESS_UNKNOWN);
+
+    return self;
+}
+
+void
+gs_vanilla_meta_progress_free(GsVanillaMetaProgress *self)
+{
+    gs_app_set_allow_cancel(self->app, TRUE);
+    g_object_unref(self->app);
+    g_free(self);
+}
+
+static void
+progress_update(GsVanillaMetaProgress *self)
+{
+    guint start = phase_start[self->phase];
+    guint end   = phase_start[self->phase + 1];
+    guint percentage;
+
+    if (self->removing && self->phase == PROGRESS_PHASE_INSTALL)
+        start = 0;
+
+    percentage = start;
+    if (self->total > 0)
+        percentage = start + (end - start) * MIN(self->current, self->total) / self->total;
+
+    // Never go backwards, and leave 100 for when the command exits
+    percentage = MIN(percentage, 99);
+    if (percentage <= self->percentage)
+        return;
+
+    self->percentage = percentage;
+    gs_app_set_progress(self->app, percentage);
+}
+
+/*
+ * Records that a package went through phase. current and total are taken from the
+ * line when the backend prints them, pass 0 to count lines instead.
+ */
+static void
+progress_step(GsVanillaMetaProgress *self, ProgressPhase phase, guint current, guint total)
+{
+    if (phase != self->phase) {
+        self->phase   = phase;
+        self->current = 0;
+
+        // Past the download, interrupting the package manager could break the container
+        if (phase >= PROGRESS_PHASE_INSTALL)
+            gs_app_set_allow_cancel(self->app, FALSE);
+    }
+
+    self->current = current > 0 ? current : self->current + 1;
+    if (total > 0)
+        self->total = total;
+
+    progress_update(self);
+}
+
+/*
+ * Finds the first "(current/total)" in line
+ */
+static gboolean
+find_fraction(const gchar *line, guint *current, guint *total)
+{
+    for (const gchar *p = strchr(line, '('); p != NULL; p = strchr(p + 1, '(')) {
+        if (sscanf(p, "(%u/%u)", current, total) == 2 && *total > 0)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * "Get:1 http://...", "Unpacking foo (1.0) ...", "Setting up foo (1.0) ..."
+ */
+static void
+parse_apt_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    guint upgraded, installed, removed, current;
+
+    if (sscanf(line, "%u upgraded, %u newly installed, %u to remove", &upgraded, &installed,
+               &removed) == 3)
+        self->total = self->removing ? removed : upgraded + installed;
+    else if (sscanf(line, "Get:%u ", &current) == 1)
+        progress_step(self, PROGRESS_PHASE_DOWNLOAD, current, 0);
+    else if (g_str_has_prefix(line, "Unpacking ") || g_str_has_prefix(line, "Removing "))
+        progress_step(self, PROGRESS_PHASE_INSTALL, 0, 0);
+    else if (g_str_has_prefix(line, "Setting up "))
+        progress_step(self, PROGRESS_PHASE_CONFIGURE, 0, 0);
+}
+
+/*
+ * "Packages (2) foo-1.0 bar-2.0", " foo-1.0 downloading...", "(1/2) installing foo".
+ * yay prints the same lines once the AUR package is built.
+ */
+static void
+parse_pacman_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    guint current, total;
+    gchar verb[32];
+
+    if (sscanf(line, "Packages (%u)", &total) == 1)
+        self->total = total;
+    else if (g_str_has_suffix(line, "downloading..."))
+        progress_step(self, PROGRESS_PHASE_DOWNLOAD, 0, 0);
+    else if (sscanf(line, "(%u/%u) %31s", &current, &total, verb) == 3 &&
+             g_strv_contains(pacman_install_verbs, verb))
+        progress_step(self, PROGRESS_PHASE_INSTALL, current, total);
+}
+
+/*
+ * "(1/2): foo-1.0.rpm  1.0 MB/s | ...", "  Installing  : foo-1.0.x86_64   1/2",
+ * "  Verifying   : foo-1.0.x86_64   1/2"
+ */
+static void
+parse_dnf_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    g_autofree gchar *verb = NULL;
+    const gchar *separator = NULL;
+    const gchar *fraction  = NULL;
+    guint current, total;
+
+    if (line[0] == '(' && find_fraction(line, &current, &total)) {
+        progress_step(self, PROGRESS_PHASE_DOWNLOAD, current, total);
+        return;
+    }
+
+    separator = strstr(line, " : ");
+    fraction  = strrchr(line, ' ');
+    if (separator == NULL || fraction == NULL ||
+        sscanf(fraction + 1, "%u/%u", &current, &total) != 2)
+        return;
+
+    verb = g_strstrip(g_strndup(line, separator - line));
+    if (g_strv_contains(dnf_install_verbs, verb))
+        progress_step(self, PROGRESS_PHASE_INSTALL, current, total);
+    else if (g_strcmp0(verb, "Verifying") == 0)
+        progress_step(self, PROGRESS_PHASE_CONFIGURE, current, total);
+}
+
+/*
+ * "(1/2) Installing foo (1.0-r0)", "(1/1) Purging foo (1.0-r0)". apk downloads each
+ * package as it installs it, so there's no separate download phase.
+ */
+static void
+parse_apk_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    guint current, total;
+    gchar verb[32];
+
+    if (sscanf(line, "(%u/%u) %31s", &current, &total, verb) == 3 &&
+        g_strv_contains(apk_install_verbs, verb))
+        progress_step(self, PROGRESS_PHASE_INSTALL, current, total);
+}
+
+/*
+ * "Retrieving: foo-1.0.x86_64 (repo) (1/2), 1.0 MiB", "(1/2) Installing: foo-1.0 ...[done]",
+ * "(1/1) Removing foo-1.0 ...[done]"
+ */
+static void
+parse_zypper_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    guint current, total;
+    gchar verb[32];
+
+    if (g_str_has_prefix(line, "Retrieving") && find_fraction(line, &current, &total))
+        progress_step(self, PROGRESS_PHASE_DOWNLOAD, current, total);
+    else if (sscanf(line, "(%u/%u) %31s", &current, &total, verb) == 3 &&
+             g_strv_contains(zypper_install_verbs, verb))
+        progress_step(self, PROGRESS_PHASE_INSTALL, current, total);
+}
+
+/*
+ * The transaction table ("foo  install  -  1.0_1 ..."), then "[*] Downloading packages",
+ * "foo-1.0_1: unpacking ...", "foo-1.0_1: configuring ...", "foo-1.0_1: removing files ..."
+ */
+static void
+parse_xbps_line(GsVanillaMetaProgress *self, const gchar *line)
+{
+    g_auto(GStrv) fields = NULL;
+
+    if (g_str_has_prefix(line, "[*] Downloading")) {
+        progress_step(self, PROGRESS_PHASE_DOWNLOAD, 0, 0);
+    } else if (strstr(line, ": unpacking") != NULL || strstr(line, ": removing") != NULL) {
+        progress_step(self, PROGRESS_PHASE_INSTALL, 0, 0);
+    } else if (strstr(line, ": configuring") != NULL) {
+        progress_step(self, PROGRESS_PHASE_CONFIGURE, 0, 0);
+    } else if (self->phase == PROGRESS_PHASE_NONE) {
+        // Each row of the transaction table is a package
+        fields = g_strsplit_set(line, " \t", -1);
+        for (guint i = 1; fields[0] != NULL && fields[i] != NULL; i++) {
+            if (*fields[i] == '\0')
+                continue;
+            if (g_strv_contains(xbps_actions, fields[i]))
+                self->total++;
+            break;
+        }
+    }
+}
+
+/*
+ * Updates progress from a line of apx install or remove output
+ */
+void
+gs_vanilla_meta_progress_feed(GsVanillaMetaProgress *self, const gchar *line)
+{
+    switch (self->package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        parse_apt_line(self, line);
+        break;
+    case APX_PACKAGE_MANAGER_PACMAN:
+        parse_pacman_line(self, line);
+        break;
+    case APX_PACKAGE_MANAGER_DNF:
+        parse_dnf_line(self, line);
+        break;
+    case APX_PACKAGE_MANAGER_APK:
+        parse_apk_line(self, line);
+        break;
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        parse_zypper_line(self, line);
+        break;
+    case APX_PACKAGE_MANAGER_XBPS:
+        parse_xbps_line(self, line);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * GsVanillaMetaLineFunc for the stdout of apx install and remove, user_data is the
+ * GsVanillaMetaProgress.
+ */
+void
+gs_vanilla_meta_progress_line_cb(const gchar *line, gpointer user_data)
+{
+    g_debug("%s", line);
+    gs_vanilla_meta_progress_feed(user_data, line);
+}
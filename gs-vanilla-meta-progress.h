@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <gnome-software.h>
+
+#include "gs-vanilla-meta-util.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Turns the output of an apx install or remove into progress updates on the app,
+ * one line at a time.
+ */
+typedef struct _GsVanillaMetaProgress GsVanillaMetaProgress;
+
+GsVanillaMetaProgress *gs_vanilla_meta_progress_new(GsApp *app,
+                                                    ApxPackageManager package_manager,
+                                                    gboolean removing);
+void gs_vanilla_meta_progress_free(GsVanillaMetaProgress *progress);
+void gs_vanilla_meta_progress_feed(GsVanillaMetaProgress *progress, const gchar *line);
+void gs_vanilla_meta_progress_line_cb(const gchar *line, gpointer user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaProgress, gs_vanilla_meta_progress_free)
+
+G_END_DECLS
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gs-vanilla-meta-search.h"
+
+typedef struct {
+    guint component; /* position in ids */
+    guint weight;    /* best weight of the token in the component's text */
+} SearchMatch;
+
+typedef struct {
+    gchar *token;    /* (owned): folded */
+    GArray *matches; /* (owned) (element-type SearchMatch): ordered by component */
+} SearchToken;
+
+struct _GsVanillaMetaSearchIndex {
+    GPtrArray *ids;       /* (owned): component ids, matches refer to them by position */
+    GHashTable *building; /* (owned) (nullable): token -> SearchToken, until finished */
+    SearchToken *tokens;  /* (owned): sorted by token once finished */
+    guint n_tokens;
+};
+
+static void
+search_token_free(SearchToken *token)
+{
+    g_free(token->token);
+    g_array_unref(token->matches);
+    g_free(token);
+}
+
+GsVanillaMetaSearchIndex *
+gs_vanilla_meta_search_index_new(void)
+{
+    GsVanillaMetaSearchIndex *index = g_new0(GsVanillaMetaSearchIndex, 1);
+
+    index->ids = g_ptr_array_new_with_free_func(g_free);
+    index->building =
+        g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)search_token_free);
+
+    return index;
+}
+
+void
+gs_vanilla_meta_search_index_free(GsVanillaMetaSearchIndex *index)
+{
+    g_clear_pointer(&index->building, g_hash_table_unref);
+    for (guint i = 0; i < index->n_tokens; i++) {
+        g_free(index->tokens[i].token);
+        g_array_unref(index->tokens[i].matches);
+    }
+    g_free(index->tokens);
+    g_ptr_array_unref(index->ids);
+    g_free(index);
+}
+
+static void
+add_token(GsVanillaMetaSearchIndex *index, const gchar *text, guint component, guint weight)
+{
+    SearchToken *token = g_hash_table_lookup(index->building, text);
+    SearchMatch match  = {component, weight};
+    SearchMatch *last  = NULL;
+
+    if (token == NULL) {
+        token          = g_new0(SearchToken, 1);
+        token->token   = g_strdup(text);
+        token->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+        g_hash_table_insert(index->building, token->token, token);
+    }
+
+    // Components are added one after the other, so only the last match can be theirs
+    if (token->matches->len > 0)
+        last = &g_array_index(token->matches, SearchMatch, token->matches->len - 1);
+    if (last != NULL && last->component == component)
+        last->weight = MAX(last->weight, weight);
+    else
+        g_array_append_val(token->matches, match);
+}
+
+/*
+ * Indexes the tokens of text as part of the component id. All the text of a
+ * component must be added before moving on to the next one. Tokens are case and
+ * accent folded, and a higher weight, which can't be 0, ranks the component higher
+ * when they match.
+ */
+void
+gs_vanilla_meta_search_index_add(GsVanillaMetaSearchIndex *index,
+                                 const gchar *id,
+                                 const gchar *text,
+                                 guint weight)
+{
+    g_auto(GStrv) tokens     = NULL;
+    g_auto(GStrv) alternates = NULL;
+    guint component;
+
+    g_return_if_fail(index->building != NULL);
+
+    if (text == NULL)
+        return;
+
+    if (index->ids->len == 0 || g_strcmp0(index->ids->pdata[index->ids->len - 1], id) != 0)
+        g_ptr_array_add(index->ids, g_strdup(id));
+    component = index->ids->len - 1;
+
+    tokens = g_str_tokenize_and_fold(text, NULL, &alternates);
+    for (guint i = 0; tokens[i] != NULL; i++)
+        add_token(index, tokens[i], component, weight);
+    for (guint i = 0; alternates[i] != NULL; i++)
+        add_token(index, alternates[i], component, weight);
+}
+
+static gint
+search_token_compare(gconstpointer a, gconstpointer b)
+{
+    return strcmp(((const SearchToken *)a)->token, ((const SearchToken *)b)->token);
+}
+
+/*
+ * Sorts the tokens for lookups, once everything was added
+ */
+void
+gs_vanilla_meta_search_index_finish(GsVanillaMetaSearchIndex *index)
+{
+    GHashTableIter iter;
+    gpointer value;
+    guint i = 0;
+
+    g_return_if_fail(index->building != NULL);
+
+    index->n_tokens = g_hash_table_size(index->building);
+    index->tokens   = g_new(SearchToken, index->n_tokens);
+
+    // Move the tokens into the array, leaving empty shells for the table to free
+    g_hash_table_iter_init(&iter, index->building);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        SearchToken *token = value;
+
+        index->tokens[i++] = *token;
+        g_hash_table_iter_steal(&iter);
+        g_free(token);
+    }
+    g_clear_pointer(&index->building, g_hash_table_unref);
+
+    qsort(index->tokens, index->n_tokens, sizeof(SearchToken), search_token_compare);
+
+    g_debug("Indexed %u search tokens of %u components", index->n_tokens, index->ids->len);
+}
+
+/*
+ * Finds the first token not sorting before prefix
+ */
+static guint
+find_first_token(GsVanillaMetaSearchIndex *index, const gchar *prefix)
+{
+    guint low  = 0;
+    guint high = index->n_tokens;
+
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+
+        if (strcmp(index->tokens[middle].token, prefix) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/*
+ * Scores every component with a token starting with term. Whole token matches
+ * count twice as much as prefix ones.
+ */
+static GHashTable *
+match_term(GsVanillaMetaSearchIndex *index, const gchar *term)
+{
+    GHashTable *scores = g_hash_table_new(NULL, NULL);
+
+    for (guint i = find_first_token(index, term);
+         i < index->n_tokens && g_str_has_prefix(index->tokens[i].token, term); i++) {
+        SearchToken *token = &index->tokens[i];
+        gboolean exact     = strcmp(token->token, term) == 0;
+
+        for (guint j = 0; j < token->matches->len; j++) {
+            SearchMatch *match = &g_array_index(token->matches, SearchMatch, j);
+            gpointer key       = GUINT_TO_POINTER(match->component + 1);
+            guint score        = exact ? match->weight * 2 : match->weight;
+
+            if (score > GPOINTER_TO_UINT(g_hash_table_lookup(scores, key)))
+                g_hash_table_insert(scores, key, GUINT_TO_POINTER(score));
+        }
+    }
+
+    return scores;
+}
+
+static gint
+search_result_compare(gconstpointer a, gconstpointer b)
+{
+    const GsVanillaMetaSearchResult *result_a = a;
+    const GsVanillaMetaSearchResult *result_b = b;
+
+    if (result_a->score != result_b->score)
+        return result_a->score > result_b->score ? -1 : 1;
+    return strcmp(result_a->id, result_b->id);
+}
+
+/*
+ * Finds the components matching every term of keywords, best first
+ */
+GArray *
+gs_vanilla_meta_search_index_query(GsVanillaMetaSearchIndex *index, const gchar *const *keywords)
+{
+    GArray *results              = g_array_new(FALSE, FALSE, sizeof(GsVanillaMetaSearchResult));
+    g_autoptr(GHashTable) scores = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_return_val_if_fail(index->building == NULL, results);
+
+    for (guint i = 0; keywords != NULL && keywords[i] != NULL; i++) {
+        g_auto(GStrv) terms = g_str_tokenize_and_fold(keywords[i], NULL, NULL);
+
+        for (guint j = 0; terms[j] != NULL; j++) {
+            g_autoptr(GHashTable) term_scores = match_term(index, terms[j]);
+
+            if (scores == NULL) {
+                scores = g_steal_pointer(&term_scores);
+                continue;
+            }
+
+            // Only keep the components matching all the terms so far
+            g_hash_table_iter_init(&iter, scores);
+            while (g_hash_table_iter_next(&iter, &key, &value)) {
+                guint term_score = GPOINTER_TO_UINT(g_hash_table_lookup(term_scores, key));
+
+                if (term_score == 0)
+                    g_hash_table_iter_remove(&iter);
+                else
+                    g_hash_table_iter_replace(
+                        &iter, GUINT_TO_POINTER(GPOINTER_TO_UINT(value) + term_score));
+            }
+        }
+    }
+
+    if (scores == NULL)
+        return results;
+
+    g_hash_table_iter_init(&iter, scores);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GsVanillaMetaSearchResult result = {
+            index->ids->pdata[GPOINTER_TO_UINT(key) - 1],
+            GPOINTER_TO_UINT(value),
+        };
+
+        g_array_append_val(results, result);
+    }
+    g_array_sort(results, search_result_compare);
+
+    return results;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Token index of the text of catalog components, answering searches by exact and
+ * prefix matches on the folded tokens.
+ */
+typedef struct _GsVanillaMetaSearchIndex GsVanillaMetaSearchIndex;
+
+typedef struct {
+    const gchar *id; /* owned by the index */
+    guint score;     /* sum of the best match of every search term */
+} GsVanillaMetaSearchResult;
+
+GsVanillaMetaSearchIndex *gs_vanilla_meta_search_index_new(void);
+void gs_vanilla_meta_search_index_free(GsVanillaMetaSearchIndex *index);
+void gs_vanilla_meta_search_index_add(GsVanillaMetaSearchIndex *index,
+                                      const gchar *id,
+                                      const gchar *text,
+                                      guint weight);
+void gs_vanilla_meta_search_index_finish(GsVanillaMetaSearchIndex *index);
+GArray *gs_vanilla_meta_search_index_query(GsVanillaMetaSearchIndex *index,
+                                           const gchar *const *keywords);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaSearchIndex, gs_vanilla_meta_search_index_free)
+
+G_END_DECLS
@@ -0,0 +1,452 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "gs-vanilla-meta-sizes.h"
+#include "gs-vanilla-meta-util.h"
+
+// Bump when the layout of the cache file changes, older files are discarded
+#define SIZE_CACHE_VERSION 1
+
+/*
+ * Each package is stored in the group of its container as a list of its catalog
+ * version (empty if the catalog has none), package version, time of the query in
+ * seconds, download size and installed size. Sizes are 0 when the package manager
+ * didn't report them.
+ */
+enum {
+    ENTRY_CATALOG_VERSION,
+    ENTRY_VERSION,
+    ENTRY_TIMESTAMP,
+    ENTRY_DOWNLOAD,
+    ENTRY_INSTALLED,
+    ENTRY_FIELDS,
+};
+
+struct _GsVanillaMetaSizeCache {
+    GMutex mutex;
+    GKeyFile *key_file; /* (owned) */
+    gchar *path;        /* (owned) */
+    gint64 max_age;     /* seconds an entry is trusted, whatever its catalog version */
+};
+
+typedef struct {
+    gchar *version;
+    guint64 download;
+    guint64 installed;
+} PackageSize;
+
+/*
+ * "Key: value" fields of backends which print one block per package
+ */
+typedef struct {
+    const gchar *name;
+    const gchar *version;
+    const gchar *download;
+    const gchar *installed;
+    guint64 download_unit; /* of sizes printed without one */
+    guint64 installed_unit;
+} SizeFields;
+
+static const SizeFields apt_fields    = {"Package", "Version", "Size", "Installed-Size", 1, 1024};
+static const SizeFields pacman_fields = {"Name",           "Version", "Download Size",
+                                         "Installed Size", 1,         1};
+static const SizeFields zypper_fields = {"Name", "Version", NULL, "Installed Size", 1, 1};
+// pkgver is "name-version_revision"
+static const SizeFields xbps_fields = {"pkgver", NULL, "filename-size", "installed_size", 1, 1};
+
+typedef struct {
+    ApxPackageManager package_manager;
+    GHashTable *sizes;    /* package name -> PackageSize */
+    PackageSize *current; /* (nullable): block being parsed */
+} SizeQueryData;
+
+static void
+package_size_free(PackageSize *size)
+{
+    g_free(size->version);
+    g_free(size);
+}
+
+static gchar *
+get_cache_path(void)
+{
+    return g_build_filename(g_get_user_cache_dir(), "vanilla_meta", "sizes.ini", NULL);
+}
+
+GsVanillaMetaSizeCache *
+gs_vanilla_meta_size_cache_new(guint max_age_seconds)
+{
+    GsVanillaMetaSizeCache *self = g_new0(GsVanillaMetaSizeCache, 1);
+    g_autoptr(GError) error      = NULL;
+
+    g_mutex_init(&self->mutex);
+    self->key_file = g_key_file_new();
+    self->path     = get_cache_path();
+    self->max_age  = max_age_seconds;
+
+    if (!g_key_file_load_from_file(self->key_file, self->path, G_KEY_FILE_NONE, &error)) {
+        if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+            g_debug("Failed to load size cache, starting over: %s", error->message);
+    } else if (g_key_file_get_integer(self->key_file, "Cache", "Version", NULL) !=
+               SIZE_CACHE_VERSION) {
+        g_debug("Size cache is from another version, starting over");
+        g_key_file_free(self->key_file);
+        self->key_file = g_key_file_new();
+    }
+
+    return self;
+}
+
+void
+gs_vanilla_meta_size_cache_free(GsVanillaMetaSizeCache *self)
+{
+    g_key_file_free(self->key_file);
+    g_free(self->path);
+    g_mutex_clear(&self->mutex);
+    g_free(self);
+}
+
+/*
+ * Gets the sizes of package_name in container if they're cached and still current:
+ * its catalog version didn't change and the entry isn't older than the maximum age,
+ * as distributions update packages without the catalog changing. A size of 0 means
+ * the package manager doesn't know it.
+ */
+gboolean
+gs_vanilla_meta_size_cache_lookup(GsVanillaMetaSizeCache *self,
+                                  const gchar *container,
+                                  const gchar *package_name,
+                                  const gchar *catalog_version,
+                                  guint64 *out_download,
+                                  guint64 *out_installed)
+{
+    g_auto(GStrv) entry = NULL;
+    gsize length        = 0;
+    gint64 timestamp;
+
+    g_mutex_lock(&self->mutex);
+    entry = g_key_file_get_string_list(self->key_file, container, package_name, &length, NULL);
+    g_mutex_unlock(&self->mutex);
+
+    if (entry == NULL || length != ENTRY_FIELDS)
+        return FALSE;
+
+    if (catalog_version == NULL)
+        catalog_version = "";
+    if (g_strcmp0(entry[ENTRY_CATALOG_VERSION], catalog_version) != 0)
+        return FALSE;
+
+    timestamp = g_ascii_strtoll(entry[ENTRY_TIMESTAMP], NULL, 10);
+    if (g_get_real_time() / G_USEC_PER_SEC - timestamp > self->max_age)
+        return FALSE;
+
+    *out_download  = g_ascii_strtoull(entry[ENTRY_DOWNLOAD], NULL, 10);
+    *out_installed = g_ascii_strtoull(entry[ENTRY_INSTALLED], NULL, 10);
+    return TRUE;
+}
+
+/*
+ * Parses sizes like "1234", "1.5 MiB" or "1024KB". Units are treated as powers of
+ * 1024, which is what package managers print them as.
+ */
+static guint64
+parse_size(const gchar *value, guint64 default_unit)
+{
+    gchar *end     = NULL;
+    guint64 unit   = default_unit;
+    gdouble number = g_ascii_strtod(value, &end);
+
+    if (end == value || number < 0)
+        return 0;
+
+    while (*end == ' ')
+        end++;
+
+    switch (g_ascii_toupper(*end)) {
+    case 'B':
+        unit = 1;
+        break;
+    case 'K':
+        unit = 1024;
+        break;
+    case 'M':
+        unit = 1024 * 1024;
+        break;
+    case 'G':
+        unit = 1024 * 1024 * 1024;
+        break;
+    default:
+        break;
+    }
+
+    return (guint64)(number * unit);
+}
+
+/*
+ * Splits "name-version" at the dash before the version, which is the last one for
+ * xbps ("foo-bar-1.0_1") and the second to last for apk ("foo-bar-1.0-r0").
+ */
+static gchar *
+split_name_version(const gchar *pkgver, guint version_dashes, gchar **out_version)
+{
+    const gchar *dash = pkgver + strlen(pkgver);
+
+    for (guint i = 0; i < version_dashes; i++) {
+        do {
+            dash--;
+        } while (dash > pkgver && *dash != '-');
+        if (dash <= pkgver)
+            return NULL;
+    }
+
+    *out_version = g_strdup(dash + 1);
+    return g_strndup(pkgver, dash - pkgver);
+}
+
+static void
+add_package_size(SizeQueryData *data, gchar *name, gchar *version)
+{
+    data->current          = g_new0(PackageSize, 1);
+    data->current->version = version;
+    g_hash_table_replace(data->sizes, name, data->current);
+}
+
+/*
+ * One "Key: value" line of apt, pacman, zypper and xbps
+ */
+static void
+parse_fields_line(SizeQueryData *data, const SizeFields *fields, const gchar *line)
+{
+    const gchar *colon    = strchr(line, ':');
+    g_autofree gchar *key = NULL;
+    const gchar *value    = NULL;
+    gchar *version        = NULL;
+    gchar *name           = NULL;
+
+    if (colon == NULL)
+        return;
+
+    key   = g_strstrip(g_strndup(line, colon - line));
+    value = colon + 1;
+    while (*value == ' ')
+        value++;
+
+    if (g_strcmp0(key, fields->name) == 0) {
+        if (fields->version != NULL)
+            name = g_strdup(value);
+        else
+            name = split_name_version(value, 1, &version);
+        if (name != NULL)
+            add_package_size(data, name, version);
+        else
+            data->current = NULL;
+    } else if (data->current == NULL) {
+        return;
+    } else if (g_strcmp0(key, fields->version) == 0) {
+        g_free(data->current->version);
+        data->current->version = g_strdup(value);
+    } else if (g_strcmp0(key, fields->download) == 0) {
+        data->current->download = parse_size(value, fields->download_unit);
+    } else if (g_strcmp0(key, fields->installed) == 0) {
+        data->current->installed = parse_size(value, fields->installed_unit);
+    }
+}
+
+/*
+ * "name,epoch:version-release,download size,installed size", from our --qf
+ */
+static void
+parse_dnf_line(SizeQueryData *data, const gchar *line)
+{
+    g_auto(GStrv) fields = g_strsplit(line, ",", 4);
+
+    if (g_strv_length(fields) != 4)
+        return;
+
+    add_package_size(data, g_strdup(fields[0]), g_strdup(fields[1]));
+    data->current->download  = parse_size(fields[2], 1);
+    data->current->installed = parse_size(fields[3], 1);
+}
+
+/*
+ * "foo-1.0-r0 installed size:" followed by "123 KiB"
+ */
+static void
+parse_apk_line(SizeQueryData *data, const gchar *line)
+{
+    g_autofree gchar *pkgver = NULL;
+    gchar *version           = NULL;
+    gchar *name              = NULL;
+
+    if (g_str_has_suffix(line, " installed size:")) {
+        pkgver = g_strndup(line, strlen(line) - strlen(" installed size:"));
+        name   = split_name_version(pkgver, 2, &version);
+        if (name != NULL)
+            add_package_size(data, name, version);
+        else
+            data->current = NULL;
+    } else if (data->current != NULL && *line != '\0') {
+        data->current->installed = parse_size(line, 1);
+        data->current            = NULL;
+    }
+}
+
+static void
+size_query_line_cb(const gchar *line, gpointer user_data)
+{
+    SizeQueryData *data = user_data;
+
+    switch (data->package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        parse_fields_line(data, &apt_fields, line);
+        break;
+    case APX_PACKAGE_MANAGER_PACMAN:
+        parse_fields_line(data, &pacman_fields, line);
+        break;
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        parse_fields_line(data, &zypper_fields, line);
+        break;
+    case APX_PACKAGE_MANAGER_XBPS:
+        parse_fields_line(data, &xbps_fields, line);
+        break;
+    case APX_PACKAGE_MANAGER_DNF:
+        parse_dnf_line(data, line);
+        break;
+    case APX_PACKAGE_MANAGER_APK:
+        parse_apk_line(data, line);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Command printing the sizes of the packages appended to it, in the container. Fields
+ * are localized by some backends, so everything runs in the C locale.
+ */
+static const gchar *
+get_size_query_command(ApxPackageManager package_manager)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        return "env LC_ALL=C apt-cache show --no-all-versions";
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return "env LC_ALL=C pacman -Si";
+    case APX_PACKAGE_MANAGER_DNF:
+        return "env LC_ALL=C dnf repoquery -q --latest-limit=1 "
+               "'--qf=%{name},%{evr},%{downloadsize},%{installsize}\\n'";
+    case APX_PACKAGE_MANAGER_APK:
+        return "env LC_ALL=C apk info -s";
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        return "env LC_ALL=C zypper --no-refresh info";
+    case APX_PACKAGE_MANAGER_XBPS:
+        // xbps-query only shows one package at a time
+        return "sh -c 'for p; do xbps-query -R -S \"$p\"; done' sh";
+    default:
+        return NULL;
+    }
+}
+
+static void
+save_cache(GsVanillaMetaSizeCache *self)
+{
+    g_autofree gchar *directory = g_path_get_dirname(self->path);
+    g_autoptr(GError) error     = NULL;
+
+    g_key_file_set_integer(self->key_file, "Cache", "Version", SIZE_CACHE_VERSION);
+
+    if (g_mkdir_with_parents(directory, 0755) != 0 ||
+        !g_key_file_save_to_file(self->key_file, self->path, &error))
+        g_debug("Failed to save size cache: %s",
+                error != NULL ? error->message : g_strerror(errno));
+}
+
+/*
+ * Queries the sizes of packages in container with a single command, and caches
+ * them. packages maps package names to their catalog version, or "" if there is none.
+ * Packages the package manager doesn't know about are cached without sizes, so
+ * they aren't queried again until their catalog version changes. That's only done
+ * when the package manager answered for some package, a command which failed
+ * outright is an error and leaves the cache alone.
+ */
+gboolean
+gs_vanilla_meta_size_cache_query(GsVanillaMetaSizeCache *self,
+                                 const gchar *container,
+                                 GHashTable *packages,
+                                 guint timeout_seconds,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+    ApxPackageManager package_manager = apx_container_package_manager_from_name(container);
+    const gchar *query_cmd            = get_size_query_command(package_manager);
+    g_autoptr(GString) cmd            = NULL;
+    g_autoptr(GHashTable) sizes       = NULL;
+    g_autofree gchar *timestamp       = NULL;
+    SizeQueryData data                = {0};
+    GHashTableIter iter;
+    gpointer package_name, catalog_version;
+    gint exit_status;
+
+    if (query_cmd == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Don't know how to query sizes in container %s", container);
+        return FALSE;
+    }
+
+    cmd   = g_string_new(query_cmd);
+    sizes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                  (GDestroyNotify)package_size_free);
+
+    g_hash_table_iter_init(&iter, packages);
+    while (g_hash_table_iter_next(&iter, &package_name, NULL)) {
+        g_autofree gchar *quoted = g_shell_quote(package_name);
+        g_string_append_printf(cmd, " %s", quoted);
+    }
+
+    g_debug("Querying sizes of %u packages in %s", g_hash_table_size(packages), container);
+
+    // Unknown packages make most backends exit with an error after printing the others,
+    // so whatever was printed is used regardless of the exit status
+    data.package_manager = package_manager;
+    data.sizes           = sizes;
+    if (!gs_vanilla_meta_run_in_container(container, cmd->str, timeout_seconds, size_query_line_cb,
+                                          &data, &exit_status, cancellable, error))
+        return FALSE;
+
+    if (exit_status != EXIT_SUCCESS && g_hash_table_size(sizes) == 0) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                    "Failed to query sizes in %s, the command exited with status %d", container,
+                    exit_status);
+        return FALSE;
+    }
+
+    timestamp = g_strdup_printf("%" G_GINT64_FORMAT, g_get_real_time() / G_USEC_PER_SEC);
+
+    g_mutex_lock(&self->mutex);
+    g_hash_table_iter_init(&iter, packages);
+    while (g_hash_table_iter_next(&iter, &package_name, &catalog_version)) {
+        PackageSize *size           = g_hash_table_lookup(sizes, package_name);
+        g_autofree gchar *download  = NULL;
+        g_autofree gchar *installed = NULL;
+        const gchar *entry[ENTRY_FIELDS];
+
+        download  = g_strdup_printf("%" G_GUINT64_FORMAT, size != NULL ? size->download : 0);
+        installed = g_strdup_printf("%" G_GUINT64_FORMAT, size != NULL ? size->installed : 0);
+
+        entry[ENTRY_CATALOG_VERSION] = catalog_version != NULL ? catalog_version : "";
+        entry[ENTRY_VERSION]         = size != NULL && size->version != NULL ? size->version : "";
+        entry[ENTRY_TIMESTAMP]       = timestamp;
+        entry[ENTRY_DOWNLOAD]        = download;
+        entry[ENTRY_INSTALLED]       = installed;
+        g_key_file_set_string_list(self->key_file, container, package_name, entry, ENTRY_FIELDS);
+    }
+    save_cache(self);
+    g_mutex_unlock(&self->mutex);
+
+    g_debug("Got sizes of %u packages in %s", g_hash_table_size(sizes), container);
+    return TRUE;
+}
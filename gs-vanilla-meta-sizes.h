@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Download and installed sizes of packages, queried from the package manager of
+ * their container and kept on disk until the catalog version of the package changes
+ * or they reach their maximum age.
+ */
+typedef struct _GsVanillaMetaSizeCache GsVanillaMetaSizeCache;
+
+GsVanillaMetaSizeCache *gs_vanilla_meta_size_cache_new(guint max_age_seconds);
+void gs_vanilla_meta_size_cache_free(GsVanillaMetaSizeCache *cache);
+gboolean gs_vanilla_meta_size_cache_lookup(GsVanillaMetaSizeCache *cache,
+                                           const gchar *container,
+                                           const gchar *package_name,
+                                           const gchar *catalog_version,
+                                           guint64 *out_download,
+                                           guint64 *out_installed);
+gboolean gs_vanilla_meta_size_cache_query(GsVanillaMetaSizeCache *cache,
+                                          const gchar *container,
+                                          GHashTable *packages,
+                                          guint timeout_seconds,
+                                          GCancellable *cancellable,
+                                          GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GsVanillaMetaSizeCache, gs_vanilla_meta_size_cache_free)
+
+G_END_DECLS
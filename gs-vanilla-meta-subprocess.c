@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "gs-vanilla-meta-metrics.h"
+#include "gs-vanilla-meta-subprocess.h"
+
+typedef struct {
+    gchar *command;                  /* (owned): argv joined, for messages */
+    GSubprocess *subprocess;         /* (owned) */
+    GPid pid;                        /* also the id of the child's process group */
+    gint exited;                     /* (atomic) */
+    GDataInputStream *stdout_stream; /* (owned) (nullable) */
+    GDataInputStream *stderr_stream; /* (owned) (nullable) */
+    GCancellable *io_cancellable;    /* (owned): aborts the reads once the child is killed */
+    GCancellable *cancellable;       /* (owned) (nullable) */
+    gulong cancelled_id;
+    GSource *timeout_source; /* (owned) (nullable) */
+    guint timeout_seconds;
+    gboolean timed_out;
+    GsVanillaMetaLineFunc stdout_func;
+    GsVanillaMetaLineFunc stderr_func;
+    gpointer line_data;
+    guint pending;       /* readers and the wait still running */
+    GError *error;       /* (owned) (nullable): first error reading or waiting */
+    gchar *metrics_name; /* (owned): kind of command, for metrics */
+    gint64 metrics_begin;
+} RunData;
+
+/*
+ * Stops watching for timeouts and cancellation, once the child is gone
+ */
+static void
+run_data_stop(RunData *data)
+{
+    if (data->timeout_source != NULL) {
+        g_source_destroy(data->timeout_source);
+        g_clear_pointer(&data->timeout_source, g_source_unref);
+    }
+    if (data->cancelled_id != 0) {
+        g_cancellable_disconnect(data->cancellable, data->cancelled_id);
+        data->cancelled_id = 0;
+    }
+}
+
+static void
+run_data_free(RunData *data)
+{
+    run_data_stop(data);
+    g_clear_object(&data->cancellable);
+    g_clear_object(&data->io_cancellable);
+    g_clear_object(&data->stdout_stream);
+    g_clear_object(&data->stderr_stream);
+    g_clear_object(&data->subprocess);
+    g_clear_error(&data->error);
+    g_free(data->command);
+    g_free(data->metrics_name);
+    g_free(data);
+}
+
+/*
+ * Gets the program and its first non-option argument, e.g. "subprocess:apx install" for
+ * `apx --dnf install -y foo`, looking into shell commands
+ */
+static gchar *
+get_command_kind(const gchar *const *argv)
+{
+    g_auto(GStrv) shell_argv  = NULL;
+    g_autofree gchar *program = NULL;
+
+    if (g_strv_length((gchar **)argv) >= 3 && g_str_equal(argv[1], "-c") &&
+        g_shell_parse_argv(argv[2], NULL, &shell_argv, NULL))
+        argv = (const gchar *const *)shell_argv;
+
+    program = g_path_get_basename(argv[0]);
+    for (guint i = 1; argv[i] != NULL; i++) {
+        if (argv[i][0] != '-')
+            return g_strdup_printf("subprocess:%s %s", program, argv[i]);
+    }
+
+    return g_strdup_printf("subprocess:%s", program);
+}
+
+/*
+ * Runs in the child before exec. apx runs podman, which runs the package manager,
+ * so put them all in a process group that can be killed at once.
+ */
+static void
+child_setup_cb(gpointer user_data)
+{
+    setpgid(0, 0);
+}
+
+/*
+ * Kills the child and everything it started. Can be called from any thread.
+ */
+static void
+kill_subprocess(RunData *data)
+{
+    if (!g_atomic_int_get(&data->exited) && data->pid > 0 && kill(-data->pid, SIGKILL) != 0)
+        g_subprocess_force_exit(data->subprocess);
+
+    // Grandchildren may still hold the pipes open, don't wait for them to close
+    g_cancellable_cancel(data->io_cancellable);
+}
+
+static void
+run_cancelled_cb(GCancellable *cancellable, gpointer user_data)
+{
+    kill_subprocess(user_data);
+}
+
+static gboolean
+run_timeout_cb(gpointer user_data)
+{
+    RunData *data = user_data;
+
+    g_debug("`%s` timed out after %u seconds, killing it", data->command, data->timeout_seconds);
+    data->timed_out = TRUE;
+    kill_subprocess(data);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Completes the task once the child was reaped and both streams were drained
+ */
+static void
+run_step_done(GTask *task)
+{
+    RunData *data = g_task_get_task_data(task);
+
+    if (--data->pending > 0)
+        return;
+
+    run_data_stop(data);
+    gs_vanilla_meta_metrics_end(data->metrics_begin, data->metrics_name, data->command);
+
+    if (g_task_return_error_if_cancelled(task))
+        return;
+
+    if (data->timed_out) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                                "`%s` timed out after %u seconds", data->command,
+                                data->timeout_seconds);
+        return;
+    }
+
+    if (data->error != NULL) {
+        g_task_return_error(task, g_steal_pointer(&data->error));
+        return;
+    }
+
+    if (!g_subprocess_get_if_exited(data->subprocess)) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "`%s` was terminated by a signal", data->command);
+        return;
+    }
+
+    g_task_return_int(task, g_subprocess_get_exit_status(data->subprocess));
+}
+
+static void
+read_line_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    g_autoptr(GTask) task    = user_data;
+    RunData *data            = g_task_get_task_data(task);
+    GDataInputStream *stream = G_DATA_INPUT_STREAM(source_object);
+    g_autofree gchar *line   = NULL;
+    g_autoptr(GError) error  = NULL;
+
+    line = g_data_input_stream_read_line_finish(stream, result, NULL, &error);
+    if (line == NULL) {
+        // End of output, or the child was killed
+        if (error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+            data->error == NULL)
+            data->error = g_steal_pointer(&error);
+        run_step_done(task);
+        return;
+    }
+
+    if (stream == data->stdout_stream)
+        data->stdout_func(line, data->line_data);
+    else
+        data->stderr_func(line, data->line_data);
+
+    g_data_input_stream_read_line_async(stream, G_PRIORITY_DEFAULT, data->io_cancellable,
+                                        read_line_cb, g_steal_pointer(&task));
+}
+
+static void
+wait_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    g_autoptr(GTask) task   = user_data;
+    RunData *data           = g_task_get_task_data(task);
+    g_autoptr(GError) error = NULL;
+
+    if (!g_subprocess_wait_finish(data->subprocess, result, &error) && data->error == NULL)
+        data->error = g_steal_pointer(&error);
+    g_atomic_int_set(&data->exited, TRUE);
+
+    run_step_done(task);
+}
+
+static GDataInputStream *
+start_reading(GTask *task, GInputStream *pipe)
+{
+    RunData *data            = g_task_get_task_data(task);
+    GDataInputStream *stream = g_data_input_stream_new(pipe);
+
+    // Progress bars redraw with \r, so treat it as a line end too
+    g_data_input_stream_set_newline_type(stream, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+    data->pending++;
+    g_data_input_stream_read_line_async(stream, G_PRIORITY_DEFAULT, data->io_cancellable,
+                                        read_line_cb, g_object_ref(task));
+
+    return stream;
+}
+
+/*
+ * Runs argv, calling stdout_func and stderr_func with each line of output as it's
+ * printed, without ever buffering the whole output. A NULL func discards that
+ * stream. The child and everything it started are killed when cancellable is
+ * cancelled or after timeout_seconds, if not 0. Line funcs and callback are called
+ * in the thread-default main context of the caller.
+ */
+void
+gs_vanilla_meta_subprocess_run_async(const gchar *const *argv,
+                                     guint timeout_seconds,
+                                     GsVanillaMetaLineFunc stdout_func,
+                                     GsVanillaMetaLineFunc stderr_func,
+                                     gpointer line_data,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+    g_autoptr(GTask) task                   = NULL;
+    g_autoptr(GSubprocessLauncher) launcher = NULL;
+    g_autoptr(GError) error                 = NULL;
+    GSubprocessFlags flags                  = G_SUBPROCESS_FLAGS_NONE;
+    const gchar *identifier                 = NULL;
+    RunData *data                           = NULL;
+
+    task = g_task_new(NULL, cancellable, callback, user_data);
+    g_task_set_source_tag(task, gs_vanilla_meta_subprocess_run_async);
+
+    data                  = g_new0(RunData, 1);
+    data->command         = g_strjoinv(" ", (gchar **)argv);
+    data->io_cancellable  = g_cancellable_new();
+    data->cancellable     = cancellable != NULL ? g_object_ref(cancellable) : NULL;
+    data->timeout_seconds = timeout_seconds;
+    data->stdout_func     = stdout_func;
+    data->stderr_func     = stderr_func;
+    data->line_data       = line_data;
+    g_task_set_task_data(task, data, (GDestroyNotify)run_data_free);
+
+    flags |= stdout_func != NULL ? G_SUBPROCESS_FLAGS_STDOUT_PIPE
+                                 : G_SUBPROCESS_FLAGS_STDOUT_SILENCE;
+    flags |= stderr_func != NULL ? G_SUBPROCESS_FLAGS_STDERR_PIPE
+                                 : G_SUBPROCESS_FLAGS_STDERR_SILENCE;
+
+    launcher = g_subprocess_launcher_new(flags);
+    g_subprocess_launcher_set_child_setup(launcher, child_setup_cb, NULL, NULL);
+
+    g_debug("Running `%s`", data->command);
+    data->metrics_name  = get_command_kind(argv);
+    data->metrics_begin = gs_vanilla_meta_metrics_begin();
+    data->subprocess    = g_subprocess_launcher_spawnv(launcher, argv, &error);
+    if (data->subprocess == NULL) {
+        g_task_return_error(task, g_steal_pointer(&error));
+        return;
+    }
+
+    identifier = g_subprocess_get_identifier(data->subprocess);
+    if (identifier != NULL)
+        data->pid = (GPid)g_ascii_strtoll(identifier, NULL, 10);
+
+    // Not cancellable, the child is killed instead so it's always reaped
+    data->pending = 1;
+    g_subprocess_wait_async(data->subprocess, NULL, wait_cb, g_object_ref(task));
+
+    if (stdout_func != NULL)
+        data->stdout_stream =
+            start_reading(task, g_subprocess_get_stdout_pipe(data->subprocess));
+    if (stderr_func != NULL)
+        data->stderr_stream =
+            start_reading(task, g_subprocess_get_stderr_pipe(data->subprocess));
+
+    if (timeout_seconds > 0) {
+        data->timeout_source = g_timeout_source_new_seconds(timeout_seconds);
+        g_source_set_callback(data->timeout_source, run_timeout_cb, data, NULL);
+        g_source_attach(data->timeout_source, g_task_get_context(task));
+    }
+
+    // Called right away if it's already cancelled
+    if (cancellable != NULL)
+        data->cancelled_id =
+            g_cancellable_connect(cancellable, G_CALLBACK(run_cancelled_cb), data, NULL);
+}
+
+/*
+ * Gets the exit status of a command run with gs_vanilla_meta_subprocess_run_async().
+ * A command that ran and failed isn't an error, check out_exit_status for that.
+ */
+gboolean
+gs_vanilla_meta_subprocess_run_finish(GAsyncResult *result, gint *out_exit_status, GError **error)
+{
+    gssize exit_status;
+
+    g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+
+    exit_status = g_task_propagate_int(G_TASK(result), error);
+    if (exit_status < 0)
+        return FALSE;
+
+    if (out_exit_status != NULL)
+        *out_exit_status = (gint)exit_status;
+    return TRUE;
+}
+
+static void
+run_sync_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    GAsyncResult **result_out = user_data;
+
+    *result_out = g_object_ref(result);
+}
+
+/*
+ * Synchronous version of gs_vanilla_meta_subprocess_run_async(), for the legacy
+ * sync vfuncs. It iterates a private main context while waiting, so output is
+ * streamed to the line funcs and timeouts and cancellation keep working.
+ */
+gboolean
+gs_vanilla_meta_subprocess_run(const gchar *const *argv,
+                               guint timeout_seconds,
+                               GsVanillaMetaLineFunc stdout_func,
+                               GsVanillaMetaLineFunc stderr_func,
+                               gpointer line_data,
+                               gint *out_exit_status,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+    g_autoptr(GMainContext) context = g_main_context_new();
+    g_autoptr(GAsyncResult) result  = NULL;
+
+    g_main_context_push_thread_default(context);
+
+    gs_vanilla_meta_subprocess_run_async(argv, timeout_seconds, stdout_func, stderr_func,
+                                         line_data, cancellable, run_sync_cb, &result);
+    while (result == NULL)
+        g_main_context_iteration(context, TRUE);
+
+    g_main_context_pop_thread_default(context);
+
+    return gs_vanilla_meta_subprocess_run_finish(result, out_exit_status, error);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Called with each line a subprocess prints, without the line terminator
+ */
+typedef void (*GsVanillaMetaLineFunc)(const gchar *line, gpointer user_data);
+
+void gs_vanilla_meta_subprocess_run_async(const gchar *const *argv,
+                                          guint timeout_seconds,
+                                          GsVanillaMetaLineFunc stdout_func,
+                                          GsVanillaMetaLineFunc stderr_func,
+                                          gpointer line_data,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data);
+gboolean gs_vanilla_meta_subprocess_run_finish(GAsyncResult *result,
+                                               gint *out_exit_status,
+                                               GError **error);
+gboolean gs_vanilla_meta_subprocess_run(const gchar *const *argv,
+                                        guint timeout_seconds,
+                                        GsVanillaMetaLineFunc stdout_func,
+                                        GsVanillaMetaLineFunc stderr_func,
+                                        gpointer line_data,
+                                        gint *out_exit_status,
+                                        GCancellable *cancellable,
+                                        GError **error);
+
+G_END_DECLS
@@ -3,6 +3,9 @@
  */
 
 #include "gs-vanilla-meta-util.h"
+#include "gs-vanilla-meta-libpod.h"
+#include "gs-vanilla-meta-pkgdb.h"
+#include "gs-vanilla-meta-subprocess.h"
 
 void
 gs_vanilla_meta_app_set_packaging_info(GsApp *app)
@@ -15,75 +18,455 @@ gs_vanilla_meta_app_set_packaging_info(GsApp *app)
 }
 
 /*
- * Retrieve flag to use in subcommand, which is always the suffix of apx_managed,
- * unless it's empty, which means it's apt and no flag is required.
+ * Reads a numeric setting from the GS_VANILLA_META_<name> environment variable,
+ * returning default_value when it's unset or invalid.
  */
-const gchar *
-apx_container_flag_from_name(const gchar *container)
+guint
+gs_vanilla_meta_get_setting_uint(const gchar *name, guint default_value)
+{
+    g_autofree gchar *variable = g_strdup_printf("GS_VANILLA_META_%s", name);
+    const gchar *value         = g_getenv(variable);
+    guint64 parsed;
+
+    if (value == NULL)
+        return default_value;
+
+    if (!g_ascii_string_to_unsigned(value, 10, 0, G_MAXUINT, &parsed, NULL)) {
+        g_debug("Ignoring invalid value `%s` for %s", value, variable);
+        return default_value;
+    }
+
+    return (guint)parsed;
+}
+
+/*
+ * Reads a setting which is one of choices from the GS_VANILLA_META_<name> environment
+ * variable, returning the index of its value, or default_value when it's unset or invalid.
+ */
+guint
+gs_vanilla_meta_get_setting_choice(const gchar *name,
+                                   const gchar *const *choices,
+                                   guint default_value)
+{
+    g_autofree gchar *variable = g_strdup_printf("GS_VANILLA_META_%s", name);
+    const gchar *value         = g_getenv(variable);
+
+    if (value == NULL)
+        return default_value;
+
+    for (guint i = 0; choices[i] != NULL; i++) {
+        if (g_ascii_strcasecmp(value, choices[i]) == 0)
+            return i;
+    }
+
+    g_debug("Ignoring invalid value `%s` for %s", value, variable);
+    return default_value;
+}
+
+/*
+ * Runs a shell command in container, through the podman socket when it's there and
+ * with `apx run` otherwise, or when the container isn't running. Works like
+ * gs_vanilla_meta_subprocess_run(), with the container's output going to line_func.
+ * Either way the command is only interpreted by a shell in the container.
+ */
+gboolean
+gs_vanilla_meta_run_in_container(const gchar *container,
+                                 const gchar *command,
+                                 guint timeout_seconds,
+                                 GsVanillaMetaLineFunc line_func,
+                                 gpointer line_data,
+                                 gint *out_exit_status,
+                                 GCancellable *cancellable,
+                                 GError **error)
 {
-    g_autoptr(GString) container_flag = g_string_new(container);
+    GsVanillaMetaLibpod *libpod   = gs_vanilla_meta_libpod_get_default();
+    const ApxContainer *info      = apx_container_lookup(container);
+    g_autoptr(GError) local_error = NULL;
 
-    g_string_replace(container_flag, "apx_managed", "", 1);
-    if (container_flag->len > 0) {
-        // Remove underscore
-        g_string_erase(container_flag, 0, 1);
+    const gchar *exec_argv[] = {"sh", "-c", command, NULL};
+    if (libpod != NULL) {
+        if (gs_vanilla_meta_libpod_exec(libpod, info->name, exec_argv, timeout_seconds, line_func,
+                                        NULL, line_data, out_exit_status, cancellable,
+                                        &local_error))
+            return TRUE;
 
-        g_string_prepend(container_flag, "--");
-        return g_strdup(container_flag->str);
-    } else {
-        // Default apt container
-        return g_strdup("--apt");
+        if (!gs_vanilla_meta_libpod_can_fall_back(local_error)) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return FALSE;
+        }
+        g_debug("Running in %s with apx instead of podman's socket: %s", info->name,
+                local_error->message);
+    }
+
+    const gchar *apx_argv[] = {"apx", info->flag, "run", "sh", "-c", command, NULL};
+    return gs_vanilla_meta_subprocess_run(apx_argv, timeout_seconds, line_func, NULL, line_data,
+                                          out_exit_status, cancellable, error);
+}
+
+/*
+ * Command that prints every installed package in the container, one per line.
+ * Output format is backend-specific and handled by parse_installed_line().
+ */
+static const gchar *
+installed_list_cmd_for_package_manager(ApxPackageManager package_manager)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        return "dpkg-query -W -f='${db:Status-Abbrev}${Package}\\n'";
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return "pacman -Qq";
+    case APX_PACKAGE_MANAGER_DNF:
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        return "rpm -qa --qf '%{NAME}\\n'";
+    case APX_PACKAGE_MANAGER_APK:
+        return "apk info";
+    case APX_PACKAGE_MANAGER_XBPS:
+        return "xbps-query -l";
+    default:
+        return NULL;
     }
 }
 
 /*
- * Runs subprocess and returns an input stream to stdout, or NULL on error.
+ * Extracts the package name from one line of the installed list, or returns NULL
+ * if the line doesn't describe an installed package.
  */
-SubprocessOutput *
-gs_vanilla_meta_run_subprocess(const gchar *cmd,
-                               GSubprocessFlags flags,
-                               GCancellable *cancellable,
-                               GError **error)
+static gchar *
+parse_installed_line(ApxPackageManager package_manager, const gchar *line)
 {
-    SubprocessOutput *output;
-    output = malloc(sizeof(SubprocessOutput));
+    g_auto(GStrv) fields = NULL;
+    const gchar *dash    = NULL;
+
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        // "ii  name", anything else is half-installed or only has config files left
+        if (!g_str_has_prefix(line, "ii") || strlen(line) < 4)
+            return NULL;
+        return g_strstrip(g_strdup(line + 3));
+    case APX_PACKAGE_MANAGER_XBPS:
+        // "ii name-1.0_1  Description", the version is everything after the last dash
+        fields = g_strsplit_set(line, " \t", 3);
+        if (g_strv_length(fields) < 2 || g_strcmp0(fields[0], "ii"))
+            return NULL;
+        dash = strrchr(fields[1], '-');
+        if (dash == NULL)
+            return g_strdup(fields[1]);
+        return g_strndup(fields[1], dash - fields[1]);
+    default:
+        if (*line == '\0')
+            return NULL;
+        return g_strstrip(g_strdup(line));
+    }
+}
 
-    g_autoptr(GSubprocess) subprocess = NULL;
-    GInputStream *input_stream;
+typedef struct {
+    ApxPackageManager package_manager;
+    GHashTable *packages;
+} InstalledListData;
 
-    subprocess = g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, error, "sh", "-c", cmd, NULL);
+static void
+installed_list_line_cb(const gchar *line, gpointer user_data)
+{
+    InstalledListData *data = user_data;
+    gchar *package_name     = parse_installed_line(data->package_manager, line);
+
+    if (package_name != NULL)
+        g_hash_table_add(data->packages, package_name);
+}
+
+/*
+ * Lists all packages installed in a container from its package database, or with a
+ * single command when that can't be read, returning a set of package names, or NULL
+ * on error.
+ */
+GHashTable *
+gs_vanilla_meta_list_installed_packages(const gchar *container,
+                                        guint timeout_seconds,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+    ApxPackageManager package_manager = apx_container_package_manager_from_name(container);
+    const gchar *list_cmd             = installed_list_cmd_for_package_manager(package_manager);
+    g_autoptr(GHashTable) packages    = NULL;
+    g_autoptr(GError) local_error     = NULL;
+    InstalledListData data;
+    gint exit_status;
+
+    // Reading the package database is much cheaper than asking the container
+    packages = gs_vanilla_meta_pkgdb_list_installed(container, timeout_seconds, cancellable,
+                                                    &local_error);
+    if (packages != NULL) {
+        g_debug("Container %s has %u packages installed, according to its package database",
+                container, g_hash_table_size(packages));
+        return g_steal_pointer(&packages);
+    }
+    if (g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_propagate_error(error, g_steal_pointer(&local_error));
+        return NULL;
+    }
+    g_debug("Asking container %s for its packages: %s", container, local_error->message);
 
-    if (subprocess == NULL)
+    if (list_cmd == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Don't know how to list packages in container %s", container);
         return NULL;
-    if (!g_subprocess_wait(subprocess, cancellable, error))
+    }
+
+    packages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    // Packages are added as lines arrive, the whole listing is never buffered
+    data.package_manager = package_manager;
+    data.packages        = packages;
+    if (!gs_vanilla_meta_run_in_container(container, list_cmd, timeout_seconds,
+                                          installed_list_line_cb, &data, &exit_status, cancellable,
+                                          error))
         return NULL;
 
-    input_stream         = g_subprocess_get_stdout_pipe(subprocess);
-    output->input_stream = g_steal_pointer(&input_stream);
-    output->exit_code    = g_subprocess_get_exit_status(subprocess);
+    if (exit_status != EXIT_SUCCESS) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "`%s` exited with status %d", list_cmd,
+                    exit_status);
+        return NULL;
+    }
 
-    return output;
+    g_debug("Container %s has %u packages installed", container, g_hash_table_size(packages));
+    return g_steal_pointer(&packages);
 }
 
 /*
- * Gets the "pretty" name from container name (e.g. "apx_managed_aur" returns "AUR")
+ * Command that prints the installed packages of the container with a newer version
+ * in its repositories, from the metadata the container already has. Output format is
+ * backend-specific and handled by parse_upgradable_line().
+ */
+static const gchar *
+upgradable_list_cmd_for_package_manager(ApxPackageManager package_manager)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        return "apt list --upgradable";
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return "pacman -Qu";
+    case APX_PACKAGE_MANAGER_DNF:
+        return "dnf -q check-update";
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        return "zypper --quiet --non-interactive list-updates";
+    case APX_PACKAGE_MANAGER_APK:
+        return "apk version -l '<'";
+    case APX_PACKAGE_MANAGER_XBPS:
+        return "xbps-install -un";
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Whether the upgradable list command succeeded. dnf exits with 100 when there are
+ * updates, and pacman with 1 when there are none.
+ */
+static gboolean
+upgradable_list_succeeded(ApxPackageManager package_manager, gint exit_status)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_DNF:
+        return exit_status == EXIT_SUCCESS || exit_status == 100;
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return exit_status == EXIT_SUCCESS || exit_status == 1;
+    default:
+        return exit_status == EXIT_SUCCESS;
+    }
+}
+
+/*
+ * Splits line on runs of whitespace, without empty fields
+ */
+static GStrv
+split_whitespace(const gchar *line)
+{
+    g_auto(GStrv) split = g_strsplit_set(line, " \t", -1);
+    GPtrArray *fields   = g_ptr_array_new();
+
+    for (guint i = 0; split[i] != NULL; i++) {
+        if (*split[i] != '\0')
+            g_ptr_array_add(fields, g_strdup(split[i]));
+    }
+    g_ptr_array_add(fields, NULL);
+
+    return (GStrv)g_ptr_array_free(fields, FALSE);
+}
+
+/*
+ * Splits "name-version" at the dash before the version, which is the last dash for
+ * xbps and the one before the release for apk
+ */
+static gboolean
+split_package_version(const gchar *pkgver,
+                      guint version_dashes,
+                      gchar **out_name,
+                      gchar **out_version)
+{
+    const gchar *dash = pkgver + strlen(pkgver);
+
+    for (guint i = 0; i < version_dashes; i++) {
+        do {
+            if (dash == pkgver)
+                return FALSE;
+            dash--;
+        } while (*dash != '-');
+    }
+
+    *out_name    = g_strndup(pkgver, dash - pkgver);
+    *out_version = g_strdup(dash + 1);
+    return TRUE;
+}
+
+/*
+ * Extracts the package name and the version it can be updated to from one line of
+ * the upgradable list. Returns FALSE if the line doesn't describe an update.
+ */
+static gboolean
+parse_upgradable_line(ApxPackageManager package_manager,
+                      const gchar *line,
+                      gchar **out_name,
+                      gchar **out_version)
+{
+    g_auto(GStrv) fields = NULL;
+    const gchar *slash   = NULL;
+    const gchar *dot     = NULL;
+
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        // "name/suite 1.1 amd64 [upgradable from: 1.0]"
+        fields = split_whitespace(line);
+        if (g_strv_length(fields) < 2 || strstr(line, "[upgradable from:") == NULL)
+            return FALSE;
+        slash = strchr(fields[0], '/');
+        if (slash == NULL)
+            return FALSE;
+        *out_name    = g_strndup(fields[0], slash - fields[0]);
+        *out_version = g_strdup(fields[1]);
+        return TRUE;
+    case APX_PACKAGE_MANAGER_PACMAN:
+        // "name 1.0-1 -> 1.1-1"
+        fields = split_whitespace(line);
+        if (g_strv_length(fields) != 4 || g_strcmp0(fields[2], "->"))
+            return FALSE;
+        *out_name    = g_strdup(fields[0]);
+        *out_version = g_strdup(fields[3]);
+        return TRUE;
+    case APX_PACKAGE_MANAGER_DNF:
+        // "name.arch  1.1-1.fc38  updates", obsoleted packages are indented below
+        fields = split_whitespace(line);
+        if (g_ascii_isspace(*line) || g_strv_length(fields) != 3)
+            return FALSE;
+        dot = strrchr(fields[0], '.');
+        if (dot == NULL)
+            return FALSE;
+        *out_name    = g_strndup(fields[0], dot - fields[0]);
+        *out_version = g_strdup(fields[1]);
+        return TRUE;
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        // "v | repository | name | 1.0 | 1.1 | x86_64"
+        fields = g_strsplit(line, "|", -1);
+        if (g_strv_length(fields) < 6 || g_strcmp0(g_strstrip(fields[0]), "v"))
+            return FALSE;
+        *out_name    = g_strdup(g_strstrip(fields[2]));
+        *out_version = g_strdup(g_strstrip(fields[4]));
+        return TRUE;
+    case APX_PACKAGE_MANAGER_APK:
+        // "name-1.0-r0  < 1.1-r0"
+        fields = split_whitespace(line);
+        if (g_strv_length(fields) < 3 || g_strcmp0(fields[1], "<"))
+            return FALSE;
+        if (!split_package_version(fields[0], 2, out_name, out_version))
+            return FALSE;
+        g_free(*out_version);
+        *out_version = g_strdup(fields[2]);
+        return TRUE;
+    case APX_PACKAGE_MANAGER_XBPS:
+        // "name-1.1_1 update x86_64 repository ..."
+        fields = split_whitespace(line);
+        if (g_strv_length(fields) < 2 || g_strcmp0(fields[1], "update"))
+            return FALSE;
+        return split_package_version(fields[0], 1, out_name, out_version);
+    default:
+        return FALSE;
+    }
+}
+
+/*
+ * Command that updates the packages appended to it in the container, run with
+ * `apx run`. Unlike installing, it updates packages which are installed already.
  */
 const gchar *
-apx_container_name_to_alias(const gchar *container)
-{
-    if (!g_strcmp0(container, "apx_managed")) {
-        return "APT";
-    } else if (!g_strcmp0(container, "apx_managed_aur")) {
-        return "AUR";
-    } else if (!g_strcmp0(container, "apx_managed_dnf")) {
-        return "DNF";
-    } else if (!g_strcmp0(container, "apx_managed_apk")) {
-        return "APK";
-    } else if (!g_strcmp0(container, "apx_managed_zypper")) {
-        return "ZYPPER";
-    } else if (!g_strcmp0(container, "apx_managed_xbps")) {
-        return "XBPS";
-    } else {
-        return "";
+gs_vanilla_meta_upgrade_cmd_for_package_manager(ApxPackageManager package_manager)
+{
+    switch (package_manager) {
+    case APX_PACKAGE_MANAGER_APT:
+        return "sudo apt-get install --only-upgrade -y";
+    case APX_PACKAGE_MANAGER_PACMAN:
+        return "sudo pacman -S --noconfirm";
+    case APX_PACKAGE_MANAGER_DNF:
+        return "sudo dnf upgrade -y";
+    case APX_PACKAGE_MANAGER_ZYPPER:
+        return "sudo zypper --non-interactive update";
+    case APX_PACKAGE_MANAGER_APK:
+        return "sudo apk add -u";
+    case APX_PACKAGE_MANAGER_XBPS:
+        return "sudo xbps-install -yu";
+    default:
+        return NULL;
     }
 }
+
+static void
+upgradable_list_line_cb(const gchar *line, gpointer user_data)
+{
+    InstalledListData *data = user_data;
+    gchar *package_name     = NULL;
+    gchar *version          = NULL;
+
+    if (parse_upgradable_line(data->package_manager, line, &package_name, &version))
+        g_hash_table_replace(data->packages, package_name, version);
+}
+
+/*
+ * Lists the packages of a container which can be updated with a single command,
+ * returning a table of package names to the version they'd be updated to, or NULL
+ * on error. Repositories aren't refreshed, so it's only as recent as the container's
+ * metadata.
+ */
+GHashTable *
+gs_vanilla_meta_list_upgradable_packages(const gchar *container,
+                                         guint timeout_seconds,
+                                         GCancellable *cancellable,
+                                         GError **error)
+{
+    ApxPackageManager package_manager = apx_container_package_manager_from_name(container);
+    const gchar *list_cmd             = upgradable_list_cmd_for_package_manager(package_manager);
+    g_autoptr(GHashTable) packages    = NULL;
+    InstalledListData data;
+    gint exit_status;
+
+    if (list_cmd == NULL) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                    "Don't know how to list updates in container %s", container);
+        return NULL;
+    }
+
+    packages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    data.package_manager = package_manager;
+    data.packages        = packages;
+    if (!gs_vanilla_meta_run_in_container(container, list_cmd, timeout_seconds,
+                                          upgradable_list_line_cb, &data, &exit_status,
+                                          cancellable, error))
+        return NULL;
+
+    if (!upgradable_list_succeeded(package_manager, exit_status)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "`%s` exited with status %d", list_cmd,
+                    exit_status);
+        return NULL;
+    }
+
+    g_debug("Container %s has %u packages to update", container, g_hash_table_size(packages));
+    return g_steal_pointer(&packages);
+}
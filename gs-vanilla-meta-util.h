@@ -7,19 +7,32 @@
 #include <glib.h>
 #include <gnome-software.h>
 
-G_BEGIN_DECLS
+#include "gs-vanilla-meta-containers.h"
+#include "gs-vanilla-meta-subprocess.h"
 
-typedef struct _SubprocessOutput {
-    GInputStream *input_stream;
-    gint exit_code;
-} SubprocessOutput;
+G_BEGIN_DECLS
 
 void gs_vanilla_meta_app_set_packaging_info(GsApp *app);
-const gchar *apx_container_flag_from_name(const gchar *container);
-SubprocessOutput *gs_vanilla_meta_run_subprocess(const gchar *cmd,
-                                                 GSubprocessFlags flags,
-                                                 GCancellable *cancellable,
-                                                 GError **error);
-const gchar *apx_container_name_to_alias(const gchar *container);
+guint gs_vanilla_meta_get_setting_uint(const gchar *name, guint default_value);
+guint gs_vanilla_meta_get_setting_choice(const gchar *name,
+                                         const gchar *const *choices,
+                                         guint default_value);
+gboolean gs_vanilla_meta_run_in_container(const gchar *container,
+                                          const gchar *command,
+                                          guint timeout_seconds,
+                                          GsVanillaMetaLineFunc line_func,
+                                          gpointer line_data,
+                                          gint *out_exit_status,
+                                          GCancellable *cancellable,
+                                          GError **error);
+GHashTable *gs_vanilla_meta_list_installed_packages(const gchar *container,
+                                                    guint timeout_seconds,
+                                                    GCancellable *cancellable,
+                                                    GError **error);
+const gchar *gs_vanilla_meta_upgrade_cmd_for_package_manager(ApxPackageManager package_manager);
+GHashTable *gs_vanilla_meta_list_upgradable_packages(const gchar *container,
+                                                     guint timeout_seconds,
+                                                     GCancellable *cancellable,
+                                                     GError **error);
 
 G_END_DECLS
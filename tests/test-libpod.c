@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "gs-vanilla-meta-libpod.h"
+
+// Seconds any call may take, the fake answers right away
+#define CALL_TIMEOUT 10
+
+/*
+ * Fake podman socket, answering the few libpod requests the plugin makes. Each
+ * connection is served by a thread of the service until the client closes it.
+ */
+typedef struct {
+    GMainContext *context; /* (owned): runs the service, in its own thread */
+    GMainLoop *loop;       /* (owned) */
+    GSocketService *service;
+
+    GMutex mutex;
+    GPtrArray *open;   /* (owned) (element-type GSocketConnection): being served */
+    guint connections; /* accepted so far */
+    guint requests;    /* answered so far */
+    gchar *exec_body;  /* (owned) (nullable): body of the last exec request */
+} FakeServer;
+
+typedef struct {
+    GPtrArray *lines; /* "out:line" or "err:line" */
+} ExecOutput;
+
+static FakeServer server;
+
+static gboolean
+write_string(GOutputStream *output, const gchar *string, gsize size)
+{
+    return g_output_stream_write_all(output, string, size, NULL, NULL, NULL);
+}
+
+static gboolean
+write_response(GOutputStream *output, const gchar *status, const gchar *body)
+{
+    g_autoptr(GString) response = g_string_new(NULL);
+
+    g_string_printf(response, "HTTP/1.1 %s\r\n", status);
+    if (body != NULL)
+        g_string_append_printf(response,
+                               "Content-Type: application/json\r\nContent-Length: %zu\r\n",
+                               strlen(body));
+    g_string_append(response, "\r\n");
+    if (body != NULL)
+        g_string_append(response, body);
+
+    return write_string(output, response->str, response->len);
+}
+
+/*
+ * Answers the container list in several chunks, the way podman streams it
+ */
+static gboolean
+write_chunked_list(GOutputStream *output)
+{
+    const gchar *chunks[] = {"[{\"Names\":[\"apx_m", "anaged\"]},{\"Names\":",
+                             "[\"apx_managed_aur\"]}]", NULL};
+    g_autoptr(GString) response = g_string_new(NULL);
+
+    g_string_append(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                              "Transfer-Encoding: chunked\r\n\r\n");
+    for (guint i = 0; chunks[i] != NULL; i++)
+        g_string_append_printf(response, "%zx%s\r\n%s\r\n", strlen(chunks[i]),
+                               i == 0 ? ";ext=1" : "", chunks[i]);
+    g_string_append(response, "0\r\nX-Trailer: 1\r\n\r\n");
+
+    return write_string(output, response->str, response->len);
+}
+
+static gboolean
+write_frame(GOutputStream *output, guint8 stream, const gchar *payload)
+{
+    guint8 header[8] = {stream, 0, 0, 0};
+    guint32 size     = GUINT32_TO_BE(strlen(payload));
+
+    // The header goes in two writes, so the client has to wait for the rest of it
+    memcpy(header + 4, &size, sizeof(size));
+    return write_string(output, (const gchar *)header, 3) &&
+           write_string(output, (const gchar *)header + 3, sizeof(header) - 3) &&
+           write_string(output, payload, strlen(payload));
+}
+
+/*
+ * Streams the output of an exec, with lines split across frames and interleaved
+ * between stdout and stderr, then closes the connection like podman does
+ */
+static gboolean
+write_exec_output(GOutputStream *output)
+{
+    const gchar *head = "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: application/vnd.docker.multiplexed-stream\r\n\r\n";
+
+    write_string(output, head, strlen(head));
+    write_frame(output, 1, "hello\nwor");
+    write_frame(output, 2, "warn");
+    write_frame(output, 1, "ld\r\n");
+    write_frame(output, 2, "ing\n");
+    write_frame(output, 1, "last");
+
+    return FALSE;
+}
+
+/*
+ * Answers a request, returning whether the connection stays open
+ */
+static gboolean
+answer(GOutputStream *output, const gchar *method, const gchar *path, const gchar *body)
+{
+    if (g_str_equal(method, "GET") && g_str_equal(path, "/libpod/containers/json?all=true"))
+        return write_chunked_list(output);
+
+    if (g_str_equal(method, "GET") && g_str_equal(path, "/libpod/containers/apx_managed/exists"))
+        return write_response(output, "204 No Content", NULL);
+
+    if (g_str_equal(method, "POST") && g_str_equal(path, "/libpod/containers/apx_managed/exec")) {
+        g_mutex_lock(&server.mutex);
+        g_free(server.exec_body);
+        server.exec_body = g_strdup(body);
+        g_mutex_unlock(&server.mutex);
+        return write_response(output, "201 Created", "{\"Id\":\"e1\"}");
+    }
+
+    if (g_str_equal(method, "POST") && g_str_equal(path, "/libpod/exec/e1/start"))
+        return write_exec_output(output);
+
+    if (g_str_equal(method, "GET") && g_str_equal(path, "/libpod/exec/e1/json"))
+        return write_response(output, "200 OK", "{\"ExitCode\":3,\"Running\":false}");
+
+    return write_response(output, "404 Not Found",
+                          "{\"cause\":\"no such container\",\"message\":\"no such container\"}");
+}
+
+/*
+ * Reads a request, returning FALSE once the client closed the connection
+ */
+static gboolean
+read_request(GDataInputStream *input, gchar **out_method, gchar **out_path, gchar **out_body)
+{
+    g_autofree gchar *request_line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+    g_auto(GStrv) fields           = NULL;
+    g_autofree gchar *body         = NULL;
+    gsize content_length           = 0;
+
+    if (request_line == NULL)
+        return FALSE;
+
+    fields = g_strsplit(request_line, " ", 3);
+    if (g_strv_length(fields) != 3)
+        return FALSE;
+
+    while (TRUE) {
+        g_autofree gchar *line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+
+        if (line == NULL)
+            return FALSE;
+        if (*line == '\0')
+            break;
+        if (g_ascii_strncasecmp(line, "Content-Length:", 15) == 0)
+            content_length = g_ascii_strtoull(line + 15, NULL, 10);
+    }
+
+    body = g_malloc0(content_length + 1);
+    if (!g_input_stream_read_all(G_INPUT_STREAM(input), body, content_length, NULL, NULL, NULL))
+        return FALSE;
+
+    *out_method = g_strdup(fields[0]);
+    *out_path   = g_strdup(fields[1]);
+    *out_body   = g_steal_pointer(&body);
+    return TRUE;
+}
+
+static gboolean
+run_cb(GThreadedSocketService *service,
+       GSocketConnection *connection,
+       GObject *source_object,
+       gpointer user_data)
+{
+    GOutputStream *output             = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    g_autoptr(GDataInputStream) input = g_data_input_stream_new(
+        g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+
+    g_data_input_stream_set_newline_type(input, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+
+    g_mutex_lock(&server.mutex);
+    server.connections++;
+    g_ptr_array_add(server.open, g_object_ref(connection));
+    g_mutex_unlock(&server.mutex);
+
+    while (TRUE) {
+        g_autofree gchar *method = NULL;
+        g_autofree gchar *path   = NULL;
+        g_autofree gchar *body   = NULL;
+        gboolean keep_open;
+
+        if (!read_request(input, &method, &path, &body))
+            break;
+
+        keep_open = answer(output, method, path, body);
+
+        g_mutex_lock(&server.mutex);
+        server.requests++;
+        g_mutex_unlock(&server.mutex);
+
+        if (!keep_open)
+            break;
+    }
+
+    g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+
+    g_mutex_lock(&server.mutex);
+    g_ptr_array_remove(server.open, connection);
+    g_mutex_unlock(&server.mutex);
+
+    return TRUE;
+}
+
+static gpointer
+server_thread_cb(gpointer user_data)
+{
+    g_main_context_push_thread_default(server.context);
+    g_main_loop_run(server.loop);
+    g_main_context_pop_thread_default(server.context);
+
+    return NULL;
+}
+
+static void
+server_start(const gchar *socket_path)
+{
+    g_autoptr(GSocketAddress) address = g_unix_socket_address_new(socket_path);
+    g_autoptr(GError) error           = NULL;
+
+    g_mutex_init(&server.mutex);
+    server.open    = g_ptr_array_new_with_free_func(g_object_unref);
+    server.context = g_main_context_new();
+    server.loop    = g_main_loop_new(server.context, FALSE);
+
+    // Connections are accepted in the context the service was started in
+    g_main_context_push_thread_default(server.context);
+    server.service = g_threaded_socket_service_new(-1);
+    g_socket_listener_add_address(G_SOCKET_LISTENER(server.service), address,
+                                  G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL,
+                                  &error);
+    g_assert_no_error(error);
+    g_signal_connect(server.service, "run", G_CALLBACK(run_cb), NULL);
+    g_socket_service_start(server.service);
+    g_main_context_pop_thread_default(server.context);
+
+    g_thread_unref(g_thread_new("fake-podman-socket", server_thread_cb, NULL));
+}
+
+static void
+server_get_counts(guint *out_connections, guint *out_requests)
+{
+    g_mutex_lock(&server.mutex);
+    *out_connections = server.connections;
+    *out_requests    = server.requests;
+    g_mutex_unlock(&server.mutex);
+}
+
+/*
+ * Closes every connection on podman's side, like it does with idle ones after a while
+ */
+static void
+server_drop_connections(void)
+{
+    gboolean open = TRUE;
+
+    g_mutex_lock(&server.mutex);
+    for (guint i = 0; i < server.open->len; i++) {
+        GSocketConnection *connection = server.open->pdata[i];
+
+        g_socket_shutdown(g_socket_connection_get_socket(connection), TRUE, TRUE, NULL);
+    }
+    g_mutex_unlock(&server.mutex);
+
+    while (open) {
+        g_mutex_lock(&server.mutex);
+        open = server.open->len > 0;
+        g_mutex_unlock(&server.mutex);
+        if (open)
+            g_usleep(G_USEC_PER_SEC / 100);
+    }
+}
+
+static void
+stdout_line_cb(const gchar *line, gpointer user_data)
+{
+    ExecOutput *output = user_data;
+
+    g_ptr_array_add(output->lines, g_strdup_printf("out:%s", line));
+}
+
+static void
+stderr_line_cb(const gchar *line, gpointer user_data)
+{
+    ExecOutput *output = user_data;
+
+    g_ptr_array_add(output->lines, g_strdup_printf("err:%s", line));
+}
+
+/*
+ * The chunked list comes back whole, and later requests reuse the same connection
+ */
+static void
+test_libpod_keep_alive(void)
+{
+    GsVanillaMetaLibpod *libpod = gs_vanilla_meta_libpod_get_default();
+    g_autoptr(GError) error     = NULL;
+    guint connections           = 0;
+    guint requests              = 0;
+    guint connections_after;
+    guint requests_after;
+
+    g_assert_nonnull(libpod);
+
+    for (guint i = 0; i < 4; i++) {
+        g_autofree gchar *list = NULL;
+
+        // The first one may open the connection the others reuse
+        if (i == 1)
+            server_get_counts(&connections, &requests);
+
+        list = gs_vanilla_meta_libpod_list_containers(libpod, CALL_TIMEOUT, NULL, &error);
+        g_assert_no_error(error);
+        g_assert_cmpstr(list, ==,
+                        "[{\"Names\":[\"apx_managed\"]},{\"Names\":[\"apx_managed_aur\"]}]");
+    }
+
+    server_get_counts(&connections_after, &requests_after);
+    g_assert_cmpuint(connections_after, ==, connections);
+    g_assert_cmpuint(requests_after, ==, requests + 3);
+}
+
+/*
+ * Answers without a body and with a Content-Length one keep the connection as well
+ */
+static void
+test_libpod_exists(void)
+{
+    GsVanillaMetaLibpod *libpod = gs_vanilla_meta_libpod_get_default();
+    g_autoptr(GError) error     = NULL;
+    g_autofree gchar *inspect   = NULL;
+    gboolean exists             = FALSE;
+    guint connections;
+    guint requests;
+    guint connections_after;
+    guint requests_after;
+
+    g_assert_true(gs_vanilla_meta_libpod_container_exists(libpod, "apx_managed", CALL_TIMEOUT,
+                                                          &exists, NULL, &error));
+    g_assert_no_error(error);
+    g_assert_true(exists);
+
+    server_get_counts(&connections, &requests);
+
+    g_assert_true(gs_vanilla_meta_libpod_container_exists(libpod, "missing", CALL_TIMEOUT,
+                                                          &exists, NULL, &error));
+    g_assert_no_error(error);
+    g_assert_false(exists);
+
+    inspect = gs_vanilla_meta_libpod_inspect_container(libpod, "missing", CALL_TIMEOUT, NULL,
+                                                       &error);
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+    g_assert_null(inspect);
+    g_assert_true(gs_vanilla_meta_libpod_can_fall_back(error));
+
+    server_get_counts(&connections_after, &requests_after);
+    g_assert_cmpuint(connections_after, ==, connections);
+    g_assert_cmpuint(requests_after, ==, requests + 2);
+}
+
+/*
+ * Connections podman closed while idle are replaced without failing the request
+ */
+static void
+test_libpod_reconnect(void)
+{
+    GsVanillaMetaLibpod *libpod = gs_vanilla_meta_libpod_get_default();
+    g_autoptr(GError) error     = NULL;
+    gboolean exists             = FALSE;
+    guint connections;
+    guint requests;
+    guint connections_after;
+    guint requests_after;
+
+    server_drop_connections();
+    server_get_counts(&connections, &requests);
+
+    for (guint i = 0; i < 2; i++) {
+        g_assert_true(gs_vanilla_meta_libpod_container_exists(libpod, "apx_managed",
+                                                              CALL_TIMEOUT, &exists, NULL,
+                                                              &error));
+        g_assert_no_error(error);
+        g_assert_true(exists);
+    }
+
+    server_get_counts(&connections_after, &requests_after);
+    g_assert_cmpuint(connections_after, ==, connections + 1);
+    g_assert_cmpuint(requests_after, ==, requests + 2);
+}
+
+/*
+ * The frames of an exec are split back into stdout and stderr lines
+ */
+static void
+test_libpod_exec(void)
+{
+    GsVanillaMetaLibpod *libpod = gs_vanilla_meta_libpod_get_default();
+    const gchar *argv[]         = {"sh", "-c", "true", NULL};
+    const gchar *expected[]     = {"out:hello", "out:world", "err:warning", "out:last", NULL};
+    ExecOutput output           = {g_ptr_array_new_with_free_func(g_free)};
+    g_autoptr(GError) error     = NULL;
+    gint exit_status            = -1;
+
+    g_assert_true(gs_vanilla_meta_libpod_exec(libpod, "apx_managed", argv, CALL_TIMEOUT,
+                                              stdout_line_cb, stderr_line_cb, &output,
+                                              &exit_status, NULL, &error));
+    g_assert_no_error(error);
+    g_assert_cmpint(exit_status, ==, 3);
+
+    g_mutex_lock(&server.mutex);
+    g_assert_nonnull(strstr(server.exec_body, "\"Cmd\":[\"sh\",\"-c\",\"true\"]"));
+    g_mutex_unlock(&server.mutex);
+
+    g_ptr_array_add(output.lines, NULL);
+    g_assert_cmpstrv((const gchar *const *)output.lines->pdata, expected);
+    g_ptr_array_unref(output.lines);
+}
+
+int
+main(int argc, char **argv)
+{
+    g_autoptr(GError) error       = NULL;
+    g_autofree gchar *tmp_dir     = NULL;
+    g_autofree gchar *socket_path = NULL;
+    int result;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmp_dir = g_dir_make_tmp("gs-vanilla-meta-test-libpod-XXXXXX", &error);
+    g_assert_no_error(error);
+    socket_path = g_build_filename(tmp_dir, "podman.sock", NULL);
+
+    // Read once, by the first call to gs_vanilla_meta_libpod_get_default()
+    g_setenv("GS_VANILLA_META_PODMAN_SOCKET", socket_path, TRUE);
+    server_start(socket_path);
+
+    g_test_add_func("/libpod/keep-alive", test_libpod_keep_alive);
+    g_test_add_func("/libpod/exists", test_libpod_exists);
+    g_test_add_func("/libpod/reconnect", test_libpod_reconnect);
+    g_test_add_func("/libpod/exec", test_libpod_exec);
+
+    result = g_test_run();
+
+    g_unlink(socket_path);
+    g_rmdir(tmp_dir);
+
+    return result;
+}
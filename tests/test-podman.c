@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2023 Mateus Melchiades
+ */
+
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gs-vanilla-meta-podman.h"
+
+// Seconds to wait for the registry to catch up with the fake
+#define WAIT_TIMEOUT 10
+
+typedef struct {
+    gchar *tmp_dir;         /* (owned) */
+    gchar *containers_path; /* (owned): what `container ls` prints */
+    gchar *release_path;    /* (owned): `container ls` waits until it exists */
+    gchar *events_path;     /* (owned): fifo `events` prints */
+    gchar *log_path;        /* (owned): arguments of every podman run */
+    gint events_fd;         /* write end of the events fifo */
+} Fixture;
+
+static void
+fixture_set_up(Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GError) error = NULL;
+
+    fixture->tmp_dir = g_dir_make_tmp("gs-vanilla-meta-test-podman-XXXXXX", &error);
+    g_assert_no_error(error);
+    fixture->containers_path = g_build_filename(fixture->tmp_dir, "containers.json", NULL);
+    fixture->release_path    = g_build_filename(fixture->tmp_dir, "release", NULL);
+    fixture->events_path     = g_build_filename(fixture->tmp_dir, "events", NULL);
+    fixture->log_path        = g_build_filename(fixture->tmp_dir, "podman.log", NULL);
+
+    g_file_set_contents(fixture->containers_path,
+                        "[{\"Names\":[\"apx_managed\"]},{\"Names\":\"apx_managed_aur\"},"
+                        "{\"Names\":[\"old\"]}]\n",
+                        -1, &error);
+    g_assert_no_error(error);
+
+    // Opened for reading as well, so it doesn't block until podman opens it
+    g_assert_cmpint(mkfifo(fixture->events_path, 0600), ==, 0);
+    fixture->events_fd = g_open(fixture->events_path, O_RDWR | O_CLOEXEC, 0);
+    g_assert_cmpint(fixture->events_fd, >=, 0);
+
+    g_setenv("GS_VANILLA_META_PODMAN", FAKE_PODMAN, TRUE);
+    g_setenv("FAKE_PODMAN_CONTAINERS", fixture->containers_path, TRUE);
+    g_setenv("FAKE_PODMAN_RELEASE", fixture->release_path, TRUE);
+    g_setenv("FAKE_PODMAN_EVENTS", fixture->events_path, TRUE);
+    g_setenv("FAKE_PODMAN_LOG", fixture->log_path, TRUE);
+}
+
+static void
+fixture_tear_down(Fixture *fixture, gconstpointer user_data)
+{
+    if (fixture->events_fd >= 0)
+        close(fixture->events_fd);
+
+    g_unlink(fixture->containers_path);
+    g_unlink(fixture->release_path);
+    g_unlink(fixture->events_path);
+    g_unlink(fixture->log_path);
+    g_rmdir(fixture->tmp_dir);
+
+    g_free(fixture->containers_path);
+    g_free(fixture->release_path);
+    g_free(fixture->events_path);
+    g_free(fixture->log_path);
+    g_free(fixture->tmp_dir);
+}
+
+static void
+send_event(Fixture *fixture, const gchar *event)
+{
+    g_autofree gchar *line = g_strdup_printf("%s\n", event);
+
+    g_assert_cmpint(write(fixture->events_fd, line, strlen(line)), ==, strlen(line));
+}
+
+static void
+send_container_event(Fixture *fixture, const gchar *status, const gchar *name)
+{
+    g_autofree gchar *event = g_strdup_printf(
+        "{\"Type\":\"container\",\"Status\":\"%s\",\"Name\":\"%s\",\"ID\":\"0\"}", status, name);
+
+    send_event(fixture, event);
+}
+
+/*
+ * Runs the main context, where events are handled, until looking up name gives the
+ * expected answer
+ */
+static void
+wait_for_lookup(GsVanillaMetaPodman *podman, const gchar *name, gboolean known, gboolean exists)
+{
+    gint64 deadline = g_get_monotonic_time() + WAIT_TIMEOUT * G_USEC_PER_SEC;
+
+    while (TRUE) {
+        gboolean found = FALSE;
+
+        if (gs_vanilla_meta_podman_lookup_container(podman, name, &found) == known &&
+            (!known || found == exists))
+            return;
+
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+        g_usleep(G_USEC_PER_SEC / 100);
+    }
+}
+
+static void
+assert_exists(GsVanillaMetaPodman *podman, const gchar *name, gboolean expected)
+{
+    gboolean exists = !expected;
+
+    g_assert_true(gs_vanilla_meta_podman_lookup_container(podman, name, &exists));
+    g_assert_cmpint(exists, ==, expected);
+}
+
+/*
+ * Events that arrive while seeding are applied on top of the listed containers, later
+ * ones as they come, and lookups stop once the events stream ends
+ */
+static void
+test_podman_events(Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GsVanillaMetaPodman) podman = gs_vanilla_meta_podman_new();
+    g_autofree gchar *log                 = NULL;
+    g_autoptr(GError) error               = NULL;
+    gboolean exists;
+
+    gs_vanilla_meta_podman_start(podman);
+    g_assert_false(gs_vanilla_meta_podman_lookup_container(podman, "apx_managed", &exists));
+
+    send_container_event(fixture, "create", "late");
+    send_container_event(fixture, "remove", "old");
+
+    // Give the events a chance to arrive before the listing, they're kept until then
+    for (guint i = 0; i < 20; i++) {
+        while (g_main_context_iteration(NULL, FALSE))
+            ;
+        g_usleep(G_USEC_PER_SEC / 100);
+    }
+    g_assert_false(gs_vanilla_meta_podman_lookup_container(podman, "apx_managed", &exists));
+
+    g_file_set_contents(fixture->release_path, "", -1, &error);
+    g_assert_no_error(error);
+    wait_for_lookup(podman, "apx_managed", TRUE, TRUE);
+
+    assert_exists(podman, "apx_managed", TRUE);
+    assert_exists(podman, "apx_managed_aur", TRUE);
+    assert_exists(podman, "late", TRUE);
+    assert_exists(podman, "old", FALSE);
+    assert_exists(podman, "missing", FALSE);
+
+    // Only creations and removals of containers count, anything else is skipped
+    send_container_event(fixture, "create", "apx_managed_dnf");
+    send_container_event(fixture, "remove", "apx_managed_aur");
+    send_container_event(fixture, "start", "started");
+    send_event(fixture, "{\"Type\":\"image\",\"Status\":\"remove\",\"Name\":\"apx_managed\"}");
+    send_event(fixture, "not json");
+    send_event(fixture, "[]");
+    send_container_event(fixture, "create", "sentinel");
+    wait_for_lookup(podman, "sentinel", TRUE, TRUE);
+
+    assert_exists(podman, "apx_managed", TRUE);
+    assert_exists(podman, "apx_managed_dnf", TRUE);
+    assert_exists(podman, "apx_managed_aur", FALSE);
+    assert_exists(podman, "started", FALSE);
+
+    gs_vanilla_meta_podman_add_container(podman, "added");
+    assert_exists(podman, "added", TRUE);
+
+    // Without the stream the registry can't tell anymore
+    close(fixture->events_fd);
+    fixture->events_fd = -1;
+    wait_for_lookup(podman, "apx_managed", FALSE, FALSE);
+
+    gs_vanilla_meta_podman_stop(podman);
+
+    g_file_get_contents(fixture->log_path, &log, NULL, &error);
+    g_assert_no_error(error);
+    g_assert_nonnull(strstr(log, "events --format json --filter type=container --since "));
+    g_assert_nonnull(strstr(log, "container ls -a --format json\n"));
+}
+
+int
+main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    // A fake podman disables the socket, so the fake is the only source
+    g_unsetenv("GS_VANILLA_META_PODMAN_SOCKET");
+
+    g_test_add("/podman/events", Fixture, NULL, fixture_set_up, test_podman_events,
+               fixture_tear_down);
+
+    return g_test_run();
+}